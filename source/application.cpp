@@ -1,5 +1,7 @@
 #include "application.hpp"
 #include <bit>
+#include <chrono>
+#include <thread>
 
 #include "raytracing_backend/scene.hpp"
 #include "utils.hpp"
@@ -102,11 +104,23 @@ void Application::ui_update()
 
     ImGui::Begin("Render controls window");
     if (ImGui::Button("Reload Scene", {100, 20})) { state.scene_file_browser.Open(); }
+    ImGui::SameLine();
+    ImGui::Checkbox("Instanced", &state.instanced_scene);
     if (ImGui::Button("Raytrace View", {100, 20})) 
     { 
         scene.light_position = state.light_position;
+        raytracer.set_track_traversal_steps(state.track_traversal_steps);
+        raytracer.set_traversal_mode(static_cast<TraversalMode>(state.traversal_mode));
+        raytracer.set_packet_interval_culling(state.packet_interval_culling);
         state.raytrace_time = raytracer.raytrace_scene(scene, camera); 
     }
+    ImGui::Combo("Traversal mode", &state.traversal_mode, "Single ray\0Packet\0Stream\0Interleaved\0Stackless\0");
+    if(state.traversal_mode != TraversalMode::SINGLE_RAY) { ImGui::BeginDisabled(); }
+    ImGui::Checkbox("Track traversal steps", &state.track_traversal_steps);
+    if(state.traversal_mode != TraversalMode::SINGLE_RAY) { ImGui::EndDisabled(); }
+    if(state.traversal_mode != TraversalMode::PACKET) { ImGui::BeginDisabled(); }
+    ImGui::Checkbox("Packet interval culling", &state.packet_interval_culling);
+    if(state.traversal_mode != TraversalMode::PACKET) { ImGui::EndDisabled(); }
     f32 light_pos[] = {state.light_position.x, state.light_position.y, state.light_position.z};
     ImGui::SliderFloat3("Light position", light_pos, 0.0f, 10000.0f);
     state.light_position.x = light_pos[0];
@@ -139,32 +153,87 @@ void Application::ui_update()
     ImGui::Text("average leaf depth : %f", state.bvh_stats.average_leaf_depth);
     ImGui::Text("average primitives in leaf: %f", state.bvh_stats.average_primitives_in_leaf);
     ImGui::Text("bvh max depth: %u", state.bvh_stats.max_tree_depth);
-    ImGui::Text("total cost : %.3f", state.bvh_stats.total_cost);
+    ImGui::Text("split cost sum : %.3f", state.bvh_stats.total_cost);
+    ImGui::Text("SAH cost : %.3f", state.bvh_quality.sah_cost);
+    ImGui::Text("EPO : %.3f", state.bvh_quality.epo);
+    ImGui::Text("sibling overlap : %.3f", state.bvh_quality.sibling_overlap);
+    ImGui::Text("duplication factor : %.3f", state.bvh_quality.duplication_factor);
     ImGui::Text("build time : %.3f ms", state.bvh_stats.build_time);
+    if(state.bvh_stats.quantized_memory_ratio > 0.0f)
+    {
+        ImGui::Text("quantized memory ratio : %.3f", state.bvh_stats.quantized_memory_ratio);
+        ImGui::Text("quantized traversal slowdown : %.3f", state.bvh_stats.quantized_traversal_slowdown);
+    }
     ImGui::Separator();
     ImGui::Text("raytrace time : %.3f ms", state.raytrace_time);
+    if(state.track_traversal_steps && state.traversal_mode == TraversalMode::SINGLE_RAY)
+    {
+        const auto & step_stats = raytracer.get_traversal_step_stats();
+        ImGui::Text("min traversal steps : %d", step_stats.min_traversal_steps);
+        ImGui::Text("max traversal steps : %d", step_stats.max_traversal_steps);
+        ImGui::Text("avg traversal steps : %.3f", step_stats.avg_traversal_steps);
+    }
     ImGui::End();
 
     ImGui::Begin("BVH build parameters");
     i32 slider_tmp = state.bvh_info.spatial_bin_count;
     ImGui::InputFloat("Ray-triangle cost", &state.bvh_info.ray_primitive_intersection_cost);
     ImGui::InputFloat("Ray-AABB cost", &state.bvh_info.ray_aabb_intersection_cost);
+    if(cost_calibration.valid() && cost_calibration.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        apply_cost_calibration();
+    }
+    const bool calibrating = cost_calibration.valid();
+    if(calibrating) { ImGui::BeginDisabled(); }
+    if (ImGui::Button("Calibrate costs", {100, 20})) { calibrate_costs(); }
+    if(calibrating) { ImGui::EndDisabled(); }
+    if(calibrating)
+    {
+        ImGui::SameLine();
+        ImGui::Text("calibrating...");
+    } else if(state.ray_triangle_test_ns > 0.0) {
+        ImGui::SameLine();
+        ImGui::Text("AABB %.2f ns, triangle %.2f ns", state.ray_aabb_test_ns, state.ray_triangle_test_ns);
+    }
+    i32 splitting_tmp = state.bvh_info.reference_splitting;
+    ImGui::Combo("Reference splitting", &splitting_tmp, "Spatial splits\0Early split clipping\0");
+    state.bvh_info.reference_splitting = static_cast<ReferenceSplitting>(splitting_tmp);
+    const bool early_split_clipping = state.bvh_info.reference_splitting == ReferenceSplitting::EARLY_SPLIT_CLIPPING;
+    if(early_split_clipping) { ImGui::BeginDisabled(); }
     ImGui::SliderInt("Spatial Splits", &slider_tmp, 1, 256);
     ImGui::InputFloat("Spatial alpha", &state.bvh_info.spatial_alpha, 0.0001f, 0.001f, "%.6f");
+    if(early_split_clipping) { ImGui::EndDisabled(); }
+    if(!early_split_clipping) { ImGui::BeginDisabled(); }
+    ImGui::InputFloat("Early split budget", &state.bvh_info.early_split_budget, 0.05f, 0.1f, "%.2f");
+    if(!early_split_clipping) { ImGui::EndDisabled(); }
+    ImGui::Checkbox("Collapse leaves", &state.bvh_info.collapse_leaves);
+    if(state.bvh_info.collapse_leaves) { ImGui::BeginDisabled(); }
     ImGui::Checkbox("Join leaves", &state.bvh_info.join_leaves);
+    if(state.bvh_info.collapse_leaves) { ImGui::EndDisabled(); }
 
-    if(!state.bvh_info.join_leaves) { ImGui::BeginDisabled(); }
+    // the collapse pass caps the leaf size as well but ignores the join depth
+    const bool joining = state.bvh_info.join_leaves && !state.bvh_info.collapse_leaves;
+    if(!joining && !state.bvh_info.collapse_leaves) { ImGui::BeginDisabled(); }
     ImGui::InputInt("Max triangles in leaf", &state.bvh_info.max_triangles_in_leaves);
+    if(!joining && !state.bvh_info.collapse_leaves) { ImGui::EndDisabled(); }
+    if(!joining) { ImGui::BeginDisabled(); }
     ImGui::InputInt("Min join depth", &state.bvh_info.min_depth_for_join);
-    if(!state.bvh_info.join_leaves) { ImGui::EndDisabled(); }
+    if(!joining) { ImGui::EndDisabled(); }
 
+    ImGui::Checkbox("Quantize leaves", &state.bvh_info.quantize_leaves);
+    ImGui::Checkbox("Use BVH cache", &state.use_bvh_cache);
     if (ImGui::Button("Rebuild BVH", {100, 20})) { rebuild_bvh(state.bvh_info); }
+    if (ImGui::Button("Load BVH", {100, 20})) { state.bvh_load_file_browser.Open(); }
+    ImGui::SameLine();
+    if (ImGui::Button("Save BVH", {100, 20})) { state.bvh_save_file_browser.Open(); }
     ImGui::End();
 
     state.bvh_info.spatial_bin_count = slider_tmp;
 
     state.scene_file_browser.Display();
     state.view_file_browser.Display();
+    state.bvh_load_file_browser.Display();
+    state.bvh_save_file_browser.Display();
 
     if(state.scene_file_browser.HasSelected())
     {
@@ -176,6 +245,26 @@ void Application::ui_update()
         camera.parse_view_file(state.view_file_browser.GetSelected().string());
         state.view_file_browser.ClearSelected();
     }
+    if(state.bvh_load_file_browser.HasSelected())
+    {
+        BVHStats loaded_stats = {};
+        // BVH files hold a single flattened BVH
+        if(!scene.raytracing_scene.is_instanced() && scene.raytracing_scene.bvh.load_from_file(state.bvh_load_file_browser.GetSelected().string(), loaded_stats))
+        {
+            state.bvh_stats = loaded_stats;
+            state.bvh_quality = scene.raytracing_scene.bvh.get_quality_metrics();
+            renderer.reload_bvh_data(scene.raytracing_scene);
+        }
+        state.bvh_load_file_browser.ClearSelected();
+    }
+    if(state.bvh_save_file_browser.HasSelected())
+    {
+        if(!scene.raytracing_scene.is_instanced())
+        {
+            scene.raytracing_scene.bvh.save_to_file(state.bvh_save_file_browser.GetSelected().string(), state.bvh_stats);
+        }
+        state.bvh_save_file_browser.ClearSelected();
+    }
 
     ImGui::Render();
 }
@@ -196,12 +285,15 @@ Application::Application() :
         .minimized = 0u,
         .scene_file_browser = ImGui::FileBrowser(ImGuiFileBrowserFlags_NoModal),
         .view_file_browser = ImGui::FileBrowser(ImGuiFileBrowserFlags_NoModal),
+        .bvh_load_file_browser = ImGui::FileBrowser(ImGuiFileBrowserFlags_NoModal),
+        .bvh_save_file_browser = ImGui::FileBrowser(ImGuiFileBrowserFlags_NoModal | ImGuiFileBrowserFlags_EnterNewFilename),
         .bvh_info = ConstructBVHInfo{
             .ray_primitive_intersection_cost = 2.0f,
             .ray_aabb_intersection_cost = 3.0f,
             .spatial_bin_count = 8,
             .spatial_alpha = 10e-5,
-            .join_leaves = true
+            .join_leaves = true,
+            .early_split_budget = 0.3f
         }
     },
     renderer{window},
@@ -213,28 +305,80 @@ Application::Application() :
         .fov = glm::radians(50.0f)
     }},
     scene{"resources/scenes/cubes/cubes.fbx"},
-    raytracer{{800, 800}}
+    raytracer{{800, 800}},
+    bvh_cache{{
+        .directory = "bvh_cache",
+        .max_size_bytes = 4ull * 1024 * 1024 * 1024
+    }}
 {
     state.view_file_browser.SetTitle("Select view file");
     state.view_file_browser.SetTypeFilters({ ".view", ".VIEW" });
 
     state.scene_file_browser.SetTitle("Select scene file");
     state.scene_file_browser.SetTypeFilters({ ".fbx", ".obj", ".bin" });
+
+    state.bvh_load_file_browser.SetTitle("Select BVH file");
+    state.bvh_load_file_browser.SetTypeFilters({ ".bvh" });
+
+    state.bvh_save_file_browser.SetTitle("Save BVH file");
+    state.bvh_save_file_browser.SetTypeFilters({ ".bvh" });
 }
 
 void Application::reload_scene(const std::string & path)
 {
-    scene = Scene(path);
+    // the running calibration reads the triangles of the current scene
+    if(cost_calibration.valid()) { apply_cost_calibration(); }
+    scene = Scene(path, state.instanced_scene ? SceneGeometry::INSTANCED : SceneGeometry::FLATTENED);
     state.bvh_stats = {};
+    state.bvh_quality = {};
     state.raytrace_time = 0.0;
     renderer.reload_scene_data(scene);
-    renderer.reload_bvh_data(scene.raytracing_scene.bvh);
+    renderer.reload_bvh_data(scene.raytracing_scene);
 }
 
 void Application::rebuild_bvh(const ConstructBVHInfo & info)
 {
-    state.bvh_stats = scene.build_bvh(info);
-    renderer.reload_bvh_data(scene.raytracing_scene.bvh);
+    state.bvh_stats = scene.build_bvh(info, state.use_bvh_cache ? &bvh_cache : nullptr);
+    // the metrics cover the single level BVH, instanced scenes keep them empty
+    state.bvh_quality = scene.raytracing_scene.is_instanced() ? BVHQualityMetrics{} : scene.raytracing_scene.bvh.get_quality_metrics();
+    renderer.reload_bvh_data(scene.raytracing_scene);
+}
+
+void Application::calibrate_costs()
+{
+    // the fit traces the primary rays of the current camera at a reduced resolution, instanced
+    // scenes only get the microbenchmarked costs as the fit builds the single level BVH
+    std::vector<Ray> rays;
+    if(!scene.raytracing_scene.is_instanced())
+    {
+        const u32vec2 resolution = u32vec2(256, 256);
+        rays.reserve(static_cast<size_t>(resolution.x) * resolution.y);
+        for(u32 y = 0; y < resolution.y; y++)
+        {
+            for(u32 x = 0; x < resolution.x; x++) { rays.push_back(camera.get_ray({x, y}, resolution)); }
+        }
+    }
+    // the fit builds and traces for seconds so it runs on a worker thread, ui_update applies the costs once it finishes
+    const IndexedTriangles triangles = rays.empty() ? IndexedTriangles{} : scene.raytracing_scene.get_triangles();
+    cost_calibration = std::async(std::launch::async,
+        [base_info = state.bvh_info, triangles, rays = std::move(rays)]() -> SAHCostCalibration
+        {
+            return calibrate_sah_costs({
+                .base_info = base_info,
+                .triangles = triangles,
+                .rays = rays,
+                .trace_info = {.thread_count = glm::max(std::thread::hardware_concurrency(), 1u)}
+            });
+        });
+}
+
+void Application::apply_cost_calibration()
+{
+    const SAHCostCalibration calibration = cost_calibration.get();
+    state.bvh_info.ray_primitive_intersection_cost = calibration.info.ray_primitive_intersection_cost;
+    state.bvh_info.ray_aabb_intersection_cost = calibration.info.ray_aabb_intersection_cost;
+    state.ray_aabb_test_ns = calibration.ray_aabb_test_ns;
+    state.ray_triangle_test_ns = calibration.ray_triangle_test_ns;
 }
 
 void Application::update_app_state()
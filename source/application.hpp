@@ -1,11 +1,14 @@
 #pragma once
 
+#include <future>
+
 #include "external/imgui_file_dialog.hpp"
 #include "window.hpp"
 #include "types.hpp"
 #include "rendering_backend/renderer.hpp"
 #include "raytracing_backend/scene.hpp"
 #include "raytracing_backend/raytracer.hpp"
+#include "raytracing_backend/bvh_calibration.hpp"
 
 struct Application 
 {
@@ -38,11 +41,23 @@ struct Application
         f32vec3 light_position = f32vec3(-11.0f, 15.0f, 7.0f);
         ImGui::FileBrowser scene_file_browser;
         ImGui::FileBrowser view_file_browser;
+        ImGui::FileBrowser bvh_load_file_browser;
+        ImGui::FileBrowser bvh_save_file_browser;
         ConstructBVHInfo bvh_info;
         BVHStats bvh_stats;
+        BVHQualityMetrics bvh_quality = {};
+        // kernel timings of the last cost calibration, zero until it is run
+        f64 ray_aabb_test_ns = 0.0;
+        f64 ray_triangle_test_ns = 0.0;
         CameraInfo camera_info;
 
         bool selecting_scene_path = false;
+        bool track_traversal_steps = false;
+        bool use_bvh_cache = true;
+        // applies to the next loaded scene
+        bool instanced_scene = false;
+        i32 traversal_mode = TraversalMode::SINGLE_RAY;
+        bool packet_interval_culling = true;
 
         i32 visualized_depth;
 
@@ -62,6 +77,9 @@ struct Application
         Camera camera;
         Scene scene;
         Raytracer raytracer;
+        BVHCache bvh_cache;
+        // running cost calibration, invalid when there is none
+        std::future<SAHCostCalibration> cost_calibration;
 
         void init_window();
         void mouse_callback(const f64 x, const f64 y);
@@ -69,6 +87,9 @@ struct Application
         void window_resize_callback(const i32 width, const i32 height);
         void key_callback(const i32 key, const i32 code, const i32 action, const i32 mods);
         void rebuild_bvh(const ConstructBVHInfo & info);
+        void calibrate_costs();
+        // waits for the running calibration and applies its costs to the build parameters
+        void apply_cost_calibration();
         void reload_scene(const std::string & path);
         void ui_update();
         void update_app_state();
@@ -10,6 +10,45 @@
 #include <queue>
 #include <array>
 #include <tuple>
+#include <bit>
+#include <numeric>
+#include <iterator>
+
+// early split clipping leaves references whose box area is at most this multiple of their triangle area whole - a right
+// triangle lying in an axis plane fills half of one side of its flat box
+static constexpr f32 ESC_MIN_AREA_RATIO = 4.0f;
+
+// area of a planar convex polygon
+static auto get_polygon_area(const types::Polygon & polygon) -> f64
+{
+    f64vec3 doubled_area = f64vec3(0.0);
+    for(size_t i = 2; i < polygon.size(); i++)
+    {
+        doubled_area += glm::cross(f64vec3(polygon[i - 1] - polygon[0]), f64vec3(polygon[i] - polygon[0]));
+    }
+    return 0.5 * glm::length(doubled_area);
+}
+
+// Orders the primitives by their centroid along the axis - ties are broken by the area and the primitive index
+// so the resulting order does not depend on the order the primitives were in
+static auto sort_primitive_aabbs(std::span<PrimitiveAABB> primitive_aabbs, Axis axis) -> void
+{
+    auto compare_op = [axis](const PrimitiveAABB & first, const PrimitiveAABB & second) -> bool
+    {
+        auto centroid_first = first.aabb.get_axis_centroid(axis);
+        auto centroid_second = second.aabb.get_axis_centroid(axis);
+        if(centroid_first == centroid_second)
+        {
+            if(first.aabb.get_area() == second.aabb.get_area())
+            {
+                return first.primitive_index < second.primitive_index;
+            }
+            return first.aabb.get_area() < second.aabb.get_area();
+        }
+        return centroid_first < centroid_second;
+    };
+    std::sort(primitive_aabbs.begin(), primitive_aabbs.end(), compare_op);
+}
 
 auto BVH::project_primitive_into_bin_fast(const ProjectPrimitiveInfo & info) -> void
 {
@@ -161,9 +200,30 @@ auto BVH::clip_axis_plane(const ClipAxisPlaneInfo & info) -> void
     }
 }
 
-static u32 spatial_index = 0;
 // Adapted from: 
 // https://github.com/LLNL/axom/blob/develop/src/axom/primal/operators/clip.hpp
+auto BVH::get_clipped_area(const Triangle & triangle, const AABB & box, std::array<types::Polygon, 2> & polygons) -> f64
+{
+    types::Polygon * back_polygon = &polygons.at(0);
+    types::Polygon * curr_polygon = &polygons.at(1);
+    curr_polygon->assign({triangle[0], triangle[1], triangle[2]});
+    for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
+    {
+        for(const bool far : {false, true})
+        {
+            std::swap(back_polygon, curr_polygon);
+            clip_axis_plane(ClipAxisPlaneInfo{
+                .curr_polygon = curr_polygon,
+                .back_polygon = back_polygon,
+                .clip_axis = static_cast<Axis>(axis),
+                .clip_coord = far ? box.max_bounds[axis] : box.min_bounds[axis],
+                .far = far
+            });
+        }
+    }
+    return get_polygon_area(*curr_polygon);
+}
+
 auto BVH::project_primitive_into_bin_slow(const ProjectPrimitiveInfo & info) -> void
 {
     AABB triangle_aabb = AABB(info.triangle);
@@ -248,7 +308,7 @@ auto BVH::spatial_best_split(const SpatialSplitInfo & info) -> BestSplitInfo
     std::span<PrimitiveAABB> node_primitive_aabbs(primitive_aabbs_global.begin() + info.node_span.start, info.node_span.size);
     for(const auto & primitive_aabb : node_primitive_aabbs)
     {
-        const auto & primitive = *primitive_aabb.primitive;
+        const Triangle primitive = view.triangles.get_triangle(primitive_aabb.primitive_index);
 
         i32vec3 start_bin_idx = glm::trunc(((primitive_aabb.aabb.min_bounds) - parent_aabb.min_bounds) / bin_size);
         i32vec3 end_bin_idx = glm::trunc(((primitive_aabb.aabb.max_bounds) - parent_aabb.min_bounds) / bin_size);
@@ -272,7 +332,7 @@ auto BVH::spatial_best_split(const SpatialSplitInfo & info) -> BestSplitInfo
                 AABB dummy_bin_aabb = parent_aabb;
                 dummy_bin_aabb.min_bounds[axis] = parent_aabb.min_bounds[axis] + bin_size[axis] * start_bin_idx[axis];
                 dummy_bin_aabb.max_bounds[axis] = parent_aabb.min_bounds[axis] + bin_size[axis] * (start_bin_idx[axis] + 1);
-                if(dummy_bin_aabb.contains(*primitive_aabb.primitive))
+                if(dummy_bin_aabb.contains(primitive))
                 {
                     bin_aabbs.at(axis).at(start_bin_idx[axis]).expand_bounds(primitive_aabb.aabb);
                 } 
@@ -295,7 +355,7 @@ auto BVH::spatial_best_split(const SpatialSplitInfo & info) -> BestSplitInfo
             // produce any artifacts so we can safely use it. We also use it if the current box is small enough compared
             // to the bounding box of the entire scene. This is because the benefit of using slow projection will be small
             // on these small nodes so we prefer the speed and simplicity of the fast projection method.
-            if(parent_node.bounding_box.contains(*primitive_aabb.primitive) ||
+            if(parent_node.bounding_box.contains(primitive) ||
                primitive_aabb.aabb.get_area() < bvh_nodes.at(0).bounding_box.get_area() / 1000.0f ||
                glm::any(glm::lessThan(primitive_aabb.aabb.max_bounds - primitive_aabb.aabb.min_bounds, f32vec3(0.01f))))
             {
@@ -426,21 +486,7 @@ auto BVH::SAH_greedy_best_split(const SAHGreedySplitInfo & info) -> BestSplitInf
     std::span<PrimitiveAABB> node_primitive_aabbs(primitive_aabbs_global.begin() + info.node_span.start, info.node_span.size);
     for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
     {
-        auto compare_op = [axis](const PrimitiveAABB & first, const PrimitiveAABB & second) -> bool
-        {
-            auto centroid_first = first.aabb.get_axis_centroid(static_cast<Axis>(axis));
-            auto centroid_second = second.aabb.get_axis_centroid(static_cast<Axis>(axis));
-            if(centroid_first == centroid_second)
-            {
-                if(first.aabb.get_area() == second.aabb.get_area())
-                {
-                    return first.primitive < second.primitive;
-                }
-                return first.aabb.get_area() < second.aabb.get_area();
-            }
-            return centroid_first < centroid_second;
-        };
-        std::sort(node_primitive_aabbs.begin(), node_primitive_aabbs.end(), compare_op);
+        sort_primitive_aabbs(node_primitive_aabbs, static_cast<Axis>(axis));
 
         // left sweep
         std::vector<AABB> left_sweep_aabbs(node_primitive_aabbs.size());
@@ -497,22 +543,8 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
 {
     auto object_split = [&]()
     {
-        auto compare_op = [&info](const PrimitiveAABB & first, const PrimitiveAABB & second) -> bool
-        {
-            auto centroid_first = first.aabb.get_axis_centroid(static_cast<Axis>(info.split.axis));
-            auto centroid_second = second.aabb.get_axis_centroid(static_cast<Axis>(info.split.axis));
-            if(centroid_first == centroid_second)
-            {
-                if(first.aabb.get_area() == second.aabb.get_area())
-                {
-                    return first.primitive < second.primitive;
-                }
-                return first.aabb.get_area() < second.aabb.get_area();
-            }
-            return centroid_first < centroid_second;
-        };
         std::span<PrimitiveAABB> node_primitive_aabbs(primitive_aabbs_global.begin() + info.node_span.start, info.node_span.size);
-        std::sort(node_primitive_aabbs.begin(), node_primitive_aabbs.end(), compare_op);
+        sort_primitive_aabbs(node_primitive_aabbs, info.split.axis);
 
         auto & left_child = bvh_nodes.emplace_back();
         left_child.bounding_box = info.split.left_bounding_box;
@@ -591,13 +623,14 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
             // to the bounding box of the entire scene. This is because the benefit of using slow projection will be small
             // on these small nodes so we prefer the speed and simplicity of the fast projection method.
             const auto border_primitive = *it;
-            if( parent_node.bounding_box.contains(*border_primitive.primitive) ||
+            const Triangle border_triangle = view.triangles.get_triangle(border_primitive.primitive_index);
+            if( parent_node.bounding_box.contains(border_triangle) ||
                 border_primitive.aabb.get_area() < bvh_nodes.at(0).bounding_box.get_area() / 1000.0f ||
                 glm::any(glm::lessThan(border_primitive.aabb.max_bounds - border_primitive.aabb.min_bounds, f32vec3(0.01f))))
             {
                 // because of how project primitive into bin is written we need three projections here
                 project_primitive_into_bin_fast({
-                    .triangle = *border_primitive.primitive,
+                    .triangle = border_triangle,
                     .splitting_axis = info.split.axis,
                     .left_plane_axis_coord = parent_node.bounding_box.min_bounds[info.split.axis] - offset,
                     .right_plane_axis_coord = parent_node.bounding_box.min_bounds[info.split.axis],
@@ -607,7 +640,7 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
                 });
 
                 project_primitive_into_bin_fast({
-                    .triangle = *border_primitive.primitive,
+                    .triangle = border_triangle,
                     .splitting_axis = info.split.axis,
                     .left_plane_axis_coord = parent_node.bounding_box.min_bounds[info.split.axis],
                     .right_plane_axis_coord = splitting_plane,
@@ -617,7 +650,7 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
                 });
 
                 project_primitive_into_bin_fast({
-                    .triangle = *border_primitive.primitive,
+                    .triangle = border_triangle,
                     .splitting_axis = info.split.axis,
                     .left_plane_axis_coord = splitting_plane,
                     .right_plane_axis_coord = parent_node.bounding_box.max_bounds[info.split.axis],
@@ -630,7 +663,7 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
             } else 
             {
                 project_primitive_into_bin_slow({
-                    .triangle = *border_primitive.primitive,
+                    .triangle = border_triangle,
                     .splitting_axis = info.split.axis,
                     .left_plane_axis_coord = parent_node.bounding_box.min_bounds[info.split.axis],
                     .right_plane_axis_coord = splitting_plane,
@@ -641,7 +674,7 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
                 expanded_left_aabb.expand_bounds(left_clipped_aabb);
 
                 project_primitive_into_bin_slow({
-                    .triangle = *border_primitive.primitive,
+                    .triangle = border_triangle,
                     .splitting_axis = info.split.axis,
                     .left_plane_axis_coord = splitting_plane,
                     .right_plane_axis_coord = parent_node.bounding_box.max_bounds[info.split.axis],
@@ -689,7 +722,7 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
                 right_aabb = expanded_right_aabb;
                 right_span.size += 1;
                 // store into a side vector so we don't ruin our iterators by using push_back() on the global primitive vector
-                duplicated_primitive_aabbs.push_back(PrimitiveAABB{right_clipped_aabb, border_primitive.primitive});
+                duplicated_primitive_aabbs.push_back(PrimitiveAABB{right_clipped_aabb, border_primitive.primitive_index});
 
                 it++;
             }
@@ -752,9 +785,39 @@ auto BVH::split_node(const SplitNodeInfo & info) -> SplitPrimitives
     return {};
 }
 
-auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, const ConstructBVHInfo & info) -> BVHStats
+auto BVH::construct_bvh_from_data(const IndexedTriangles & triangles, const ConstructBVHInfo & info) -> BVHStats
+{
+    return construct_bvh(triangles, info, {}, {});
+}
+
+auto BVH::rebuild(const IndexedTriangles & triangles, const ConstructBVHInfo & info) -> BVHStats
+{
+    const bool same_triangles = 
+        built_triangles.positions.data() == triangles.positions.data() && built_triangles.positions.size() == triangles.positions.size() &&
+        built_triangles.indices.data() == triangles.indices.data() && built_triangles.indices.size() == triangles.indices.size();
+    // only the leaf joining parameters are tracked per node, any other change affects every decision
+    const bool same_parameters =
+        built_info.ray_primitive_intersection_cost == info.ray_primitive_intersection_cost &&
+        built_info.ray_aabb_intersection_cost == info.ray_aabb_intersection_cost &&
+        built_info.spatial_bin_count == info.spatial_bin_count &&
+        built_info.spatial_alpha == info.spatial_alpha &&
+        built_info.reference_splitting == info.reference_splitting &&
+        built_info.early_split_budget == info.early_split_budget;
+    if(build_decisions.empty() || !same_triangles || !same_parameters)
+    {
+        return construct_bvh(triangles, info, {}, {});
+    }
+    const std::vector<BVHNode> previous_nodes = std::move(bvh_nodes);
+    const std::vector<BuildDecision> previous_decisions = std::move(build_decisions);
+    return construct_bvh(triangles, info, previous_nodes, previous_decisions);
+}
+
+auto BVH::construct_bvh(
+    const IndexedTriangles & triangles,
+    const ConstructBVHInfo & info,
+    std::span<const BVHNode> previous_nodes,
+    std::span<const BuildDecision> previous_decisions) -> BVHStats
 {
-    spatial_index = 0;
     u64 leaf_depth_sum = 0ul;
     BVHStats stats = BVHStats {
         .triangle_count = 0,
@@ -765,36 +828,102 @@ auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, cons
         .average_primitives_in_leaf = 0.0f,
         .max_tree_depth = 0u,
         .total_cost = 0.0f,
-        .build_time = 0.0
+        .build_time = 0.0,
+        .quantized_memory_ratio = 0.0f,
+        .quantized_traversal_slowdown = 0.0f
     };
     auto start_time = std::chrono::high_resolution_clock::now();
     bvh_nodes.clear();
     bvh_leaves.clear();
+    leaf_primitive_indices.clear();
+    stackless_links.clear();
+    quantized_leaves.clear();
+    quantized_vertices.clear();
+    quantized_corners.clear();
+    exact_leaf_positions.clear();
+    exact_leaf_indices.clear();
     primitive_aabbs_global.clear();
-    // Generate vector of Primitive AABBs from the vector of primitives
-    primitive_aabbs_global.reserve(primitives.size());
-    for(int i = 0; i < primitives.size(); i++)
+    spatial_split_planes.clear();
+    build_decisions.clear();
+    built_info = info;
+    built_triangles = triangles;
+    refit_data = RefitData{};
+    built_sah_cost = -1.0f;
+    ray_primitive_intersection_cost = info.ray_primitive_intersection_cost;
+    ray_aabb_intersection_cost = info.ray_aabb_intersection_cost;
+    mapped_file.reset();
+    // the builder fetches the triangles through the view, leaves store them as triangle indices
+    view = BVHView{.triangles = triangles};
+    // Generate vector of Primitive AABBs from the triangles
+    primitive_aabbs_global.reserve(triangles.size());
+    for(u32 i = 0; i < triangles.size(); i++)
     {
         primitive_aabbs_global.emplace_back(PrimitiveAABB{
-            .aabb = AABB(primitives.at(i)),
-            .primitive = &primitives.at(i)
+            .aabb = AABB(triangles.get_triangle(i)),
+            .primitive_index = i
         });
     }
 
+    if(info.reference_splitting == ReferenceSplitting::EARLY_SPLIT_CLIPPING) { early_split_clipping(triangles, info.early_split_budget); }
+
     // Calculate the AABB of the scene -> stored in root node
     const u32 root_node_idx = 0;
     bvh_nodes.emplace_back();
     std::for_each(primitive_aabbs_global.begin(), primitive_aabbs_global.end(), [&](const PrimitiveAABB & aabb)
         {bvh_nodes.at(root_node_idx).bounding_box.expand_bounds(aabb.aabb);});
 
-    using ProcessNode = std::tuple<u32, NodeSpan, u32>; 
+    // the collapse pass needs the full tree down to single triangles
+    ConstructBVHInfo split_info = info;
+    if(info.collapse_leaves) { split_info.join_leaves = false; }
+    build_subtree({
+        .construct_info = split_info,
+        .stats = stats,
+        .leaf_depth_sum = leaf_depth_sum,
+        .node_idx = root_node_idx,
+        .node_span = NodeSpan{0, primitive_aabbs_global.size()},
+        .depth = 0,
+        .previous_nodes = previous_nodes,
+        .previous_decisions = previous_decisions
+    });
+    build_decisions.resize(bvh_nodes.size());
+    if(info.collapse_leaves)
+    {
+        const u32 max_leaf_size = glm::max(u32(glm::max(info.max_triangles_in_leaves, 1)), COLLAPSED_LEAF_WIDTH);
+        leaf_depth_sum = collapse_leaves((max_leaf_size + COLLAPSED_LEAF_WIDTH - 1) / COLLAPSED_LEAF_WIDTH * COLLAPSED_LEAF_WIDTH, stats);
+        // the recorded decisions describe the tree before the collapse, a rebuild starts from scratch
+        build_decisions.clear();
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+    stats.build_time = ms_double.count();
+    stats.inner_node_count = bvh_nodes.size() - bvh_leaves.size();
+    stats.triangle_count = triangles.size();
+    stats.leaf_count = bvh_leaves.size();
+    stats.average_leaf_depth = f32(leaf_depth_sum) / f32(stats.leaf_count);
+    stats.average_primitives_in_leaf = f32(stats.leaf_primitives_count) / f32(bvh_leaves.size());
+
+    build_stackless_links();
+    update_view(triangles);
+    if(info.quantize_leaves) { quantize_leaves(stats); }
+    return stats;
+}
+
+auto BVH::build_subtree(const BuildSubtreeInfo & info) -> void
+{
+    // the last element is the node of the previous build whose decision may be replayed, -1 if there is none
+    using ProcessNode = std::tuple<u32, NodeSpan, u32, i32>; 
     std::stack<ProcessNode> nodes;
-    nodes.push({root_node_idx, NodeSpan{0, primitive_aabbs_global.size()}, 0});
+    nodes.push({info.node_idx, info.node_span, info.depth, info.previous_decisions.empty() ? -1 : i32(info.node_idx)});
+    auto record_decision = [&](u32 node_idx, const BuildDecision & decision)
+    {
+        if(node_idx >= build_decisions.size()) { build_decisions.resize(bvh_nodes.size()); }
+        build_decisions.at(node_idx) = decision;
+    };
 
     while(!nodes.empty())
     {
-        auto [node_idx, node_span, depth] = nodes.top();
-        stats.max_tree_depth = glm::max(stats.max_tree_depth, depth);
+        auto [node_idx, node_span, depth, previous_idx] = nodes.top();
+        info.stats.max_tree_depth = glm::max(info.stats.max_tree_depth, depth);
 
         // Get rid of degenerated aabbs
         for(i32 idx = node_span.start; idx < node_span.start + node_span.size; )
@@ -813,9 +942,10 @@ auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, cons
 
         if(node_span.size == 1) 
         { 
-            leaf_depth_sum += depth;
+            info.leaf_depth_sum += depth;
+            record_decision(node_idx, BuildDecision{.axis = Axis::LAST, .event = -1, .primitive_count = 1, .replayable = true});
             create_leaf({
-                .stats = stats,
+                .stats = info.stats,
                 .node_idx = node_idx,
                 .node_span = node_span
             }); 
@@ -824,25 +954,57 @@ auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, cons
         }
 
         bool join_leaves = 
-            (info.join_leaves) &&
-            (node_span.size < info.max_triangles_in_leaves) &&
-            (depth > info.min_depth_for_join) ?
+            (info.construct_info.join_leaves) &&
+            (node_span.size < info.construct_info.max_triangles_in_leaves) &&
+            (depth > info.construct_info.min_depth_for_join) ?
             true : false;
 
-        BestSplitInfo object_split = SAH_greedy_best_split({
-            .ray_primitive_cost = info.ray_primitive_intersection_cost,
-            .ray_aabb_test_cost = info.ray_aabb_intersection_cost,
-            .node_idx = node_idx,
-            .node_span = node_span,
-            .join_leaves = join_leaves
-        });
+        // The leaf joining parameters only add the option to end the node in a leaf - a split which won with the option
+        // available wins without it as well. Decisions those parameters could have changed are searched for again
+        const BuildDecision * previous = previous_idx != -1 ? &info.previous_decisions[previous_idx] : nullptr;
+        const bool replay = 
+            previous != nullptr && previous->replayable && previous->primitive_count == node_span.size &&
+            (previous->join_leaves == join_leaves || (previous->join_leaves && previous->axis != Axis::LAST));
+
+        BestSplitInfo object_split;
+        if(replay)
+        {
+            object_split = BestSplitInfo{
+                .axis = previous->axis,
+                .type = previous->type,
+                .event = previous->event,
+                .cost = previous->cost
+            };
+            // the search leaves the primitives sorted along the last axis and the spatial split and leaf primitive
+            // order depend on it, object splits sort the primitives themselves
+            if(previous->type == SplitType::SPATIAL || previous->axis == Axis::LAST)
+            {
+                sort_primitive_aabbs(std::span(primitive_aabbs_global.begin() + node_span.start, node_span.size), Axis::Z);
+            }
+        } else {
+            object_split = SAH_greedy_best_split({
+                .ray_primitive_cost = info.construct_info.ray_primitive_intersection_cost,
+                .ray_aabb_test_cost = info.construct_info.ray_aabb_intersection_cost,
+                .node_idx = node_idx,
+                .node_span = node_span,
+                .join_leaves = join_leaves
+            });
+        }
         BestSplitInfo best_split = object_split;
 
         if(best_split.axis == Axis::LAST)
         {
             DEBUG_OUT("Early leaf with primitive count " + std::to_string(node_span.size) + " node index " + std::to_string(node_idx));
+            record_decision(node_idx, BuildDecision{
+                .axis = Axis::LAST,
+                .event = -1,
+                .cost = best_split.cost,
+                .primitive_count = u32(node_span.size),
+                .join_leaves = join_leaves,
+                .replayable = true
+            });
             create_leaf({
-                .stats = stats,
+                .stats = info.stats,
                 .node_idx = node_idx,
                 .node_span = node_span
             });
@@ -853,19 +1015,20 @@ auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, cons
         // try spatial split only if the boxes intersect and their intersection is big enough 
         // compared to the AABB of the of the scene -> this allows spatial splits only in the 
         // upper levels of the BVH where spatial splits are the most efficient
-        if(do_aabbs_intersect(best_split.left_bounding_box, best_split.right_bounding_box))
+        const bool spatial_splits = info.construct_info.reference_splitting == ReferenceSplitting::SPATIAL_SPLITS;
+        if(!replay && spatial_splits && do_aabbs_intersect(best_split.left_bounding_box, best_split.right_bounding_box))
         {
             f32 lambda = get_intersection_aabb(
                 best_split.left_bounding_box,
                 best_split.right_bounding_box).get_area();
 
             // check for the intersection size
-            if(lambda / bvh_nodes.at(root_node_idx).bounding_box.get_area() > info.spatial_alpha)
+            if(lambda / bvh_nodes.at(0).bounding_box.get_area() > info.construct_info.spatial_alpha)
             {
                 BestSplitInfo spatial_split = spatial_best_split({
-                    .ray_primitive_cost = info.ray_primitive_intersection_cost,
-                    .ray_aabb_test_cost = info.ray_aabb_intersection_cost,
-                    .bin_count = info.spatial_bin_count,
+                    .ray_primitive_cost = info.construct_info.ray_primitive_intersection_cost,
+                    .ray_aabb_test_cost = info.construct_info.ray_aabb_intersection_cost,
+                    .bin_count = info.construct_info.spatial_bin_count,
                     .node_idx = node_idx,
                     .node_span = node_span
                 });
@@ -887,19 +1050,20 @@ auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, cons
             DEBUG_OUT("best spatial event unsplit with primitive count " + std::to_string(node_span.size) + " node index " + std::to_string(node_idx));
         }
 #endif
-        stats.total_cost += best_split.cost;
+        info.stats.total_cost += best_split.cost;
 
         auto [left_span, right_span] = split_node({
             .split = best_split,
             .node_span = node_span,
             .node_idx = node_idx,
-            .ray_primitive_intersection_cost = info.ray_primitive_intersection_cost,
-            .ray_aabb_intersection_cost = info.ray_aabb_intersection_cost
+            .ray_primitive_intersection_cost = info.construct_info.ray_primitive_intersection_cost,
+            .ray_aabb_intersection_cost = info.construct_info.ray_aabb_intersection_cost
         });
         
         // There may occur a case where we calculate a spatial split but later unsplit this reference so that left has all the primitives
         // and right has none which than just creates and identical node we need to perform object split on this node instead
-        if(left_span.size == 0 || right_span.size == 0)
+        const bool ignored_spatial_split = left_span.size == 0 || right_span.size == 0;
+        if(ignored_spatial_split)
         {
             bvh_nodes.pop_back();
             bvh_nodes.pop_back();
@@ -908,48 +1072,331 @@ auto BVH::construct_bvh_from_data(const std::vector<Triangle> & primitives, cons
                 .split = object_split,
                 .node_span = node_span,
                 .node_idx = node_idx,
-                .ray_primitive_intersection_cost = info.ray_primitive_intersection_cost,
-                .ray_aabb_intersection_cost = info.ray_aabb_intersection_cost
+                .ray_primitive_intersection_cost = info.construct_info.ray_primitive_intersection_cost,
+                .ray_aabb_intersection_cost = info.construct_info.ray_aabb_intersection_cost
+            });
+        }
+        else if(best_split.type == SplitType::SPATIAL)
+        {
+            spatial_split_planes.push_back(SpatialSplitPlane{
+                .node_index = i32(node_idx),
+                .axis = best_split.axis,
+                .coordinate = std::get<f32>(best_split.event)
             });
         }
 
+        // only the decision is recorded, children of a replayed object split are bounded by their primitives
+        if(replay && best_split.type == SplitType::OBJECT)
+        {
+            for(const auto & [child_idx, child_span] : {std::pair(bvh_nodes.at(node_idx).left_index, left_span), std::pair(bvh_nodes.at(node_idx).right_index, right_span)})
+            {
+                AABB child_aabb;
+                for(size_t i = child_span.start; i < child_span.start + child_span.size; i++) { child_aabb.expand_bounds(primitive_aabbs_global[i].aabb); }
+                bvh_nodes.at(child_idx).bounding_box = child_aabb;
+            }
+        }
+        record_decision(node_idx, BuildDecision{
+            .axis = best_split.axis,
+            .type = best_split.type,
+            .event = best_split.event,
+            .cost = best_split.cost,
+            .primitive_count = u32(node_span.size),
+            .join_leaves = join_leaves,
+            .replayable = !ignored_spatial_split
+        });
+        // as long as the decisions match the previous build the children are matched to the previous children
+        const bool same_decision =
+            previous != nullptr && previous->replayable && !ignored_spatial_split &&
+            previous->axis == best_split.axis && previous->type == best_split.type && previous->event == best_split.event;
+        const i32 previous_left_idx = same_decision ? info.previous_nodes[previous_idx].left_index : -1;
+        const i32 previous_right_idx = same_decision ? info.previous_nodes[previous_idx].right_index : -1;
+
         nodes.pop();
-        if(left_span.size >= 1) {nodes.emplace(bvh_nodes.at(node_idx).left_index, left_span, depth + 1);}
-        if(right_span.size >= 1) {nodes.emplace(bvh_nodes.at(node_idx).right_index, right_span, depth + 1);}
+        if(left_span.size >= 1) {nodes.emplace(bvh_nodes.at(node_idx).left_index, left_span, depth + 1, previous_left_idx);}
+        if(right_span.size >= 1) {nodes.emplace(bvh_nodes.at(node_idx).right_index, right_span, depth + 1, previous_right_idx);}
     }
-    auto end_time = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
-    stats.build_time = ms_double.count();
-    stats.inner_node_count = bvh_nodes.size() - bvh_leaves.size();
-    stats.triangle_count = primitives.size();
-    stats.leaf_count = bvh_leaves.size();
-    stats.average_leaf_depth = f32(leaf_depth_sum) / f32(stats.leaf_count);
-    stats.average_primitives_in_leaf = f32(bvh_leaves.size()) / f32(stats.leaf_primitives_count);
+}
 
-    return stats;
+auto BVH::early_split_clipping(const IndexedTriangles & triangles, f32 budget) -> void
+{
+    // Early Split Clipping (Ernst and Greiner) - the reference wasting the most box area is halved at the middle of its
+    // longest axis and the triangle is clipped to both halves, the pieces compete with the other references again
+    const size_t max_reference_count = primitive_aabbs_global.size() + size_t(f64(primitive_aabbs_global.size()) * glm::max(budget, 0.0f));
+    using Candidate = std::pair<f32, u32>;
+    std::priority_queue<Candidate> candidates;
+    std::array<types::Polygon, 2> polygons;
+    // The area ratio alone is only a lower bound - nearly every triangle not lying in an axis plane passes it, slivers
+    // far smaller than the rest of the scene included. Boxes below the average triangle box area barely change the SAH
+    // of the tree and are left whole, of the others the box area the triangle does not cover decides the order - a box
+    // hugging a large triangle costs little to keep while a thin diagonal triangle wastes most of its box
+    f64 box_area_sum = 0.0;
+    for(const auto & reference : primitive_aabbs_global) { box_area_sum += reference.aabb.get_area(); }
+    const f32 min_box_area = f32(box_area_sum / f64(glm::max(primitive_aabbs_global.size(), size_t(1))));
+    auto push_candidate = [&](u32 reference_idx, const Triangle & triangle)
+    {
+        const AABB & aabb = primitive_aabbs_global[reference_idx].aabb;
+        const f32 box_area = aabb.get_area();
+        if(box_area < min_box_area) { return; }
+        const f32 triangle_area = f32(get_clipped_area(triangle, aabb, polygons));
+        if(box_area <= ESC_MIN_AREA_RATIO * triangle_area) { return; }
+        candidates.push({box_area - triangle_area, reference_idx});
+    };
+    for(u32 reference_idx = 0; reference_idx < primitive_aabbs_global.size(); reference_idx++)
+    {
+        push_candidate(reference_idx, triangles.get_triangle(primitive_aabbs_global[reference_idx].primitive_index));
+    }
+
+    while(primitive_aabbs_global.size() < max_reference_count && !candidates.empty())
+    {
+        const u32 reference_idx = candidates.top().second;
+        candidates.pop();
+        const PrimitiveAABB reference = primitive_aabbs_global[reference_idx];
+        const f32vec3 extent = reference.aabb.max_bounds - reference.aabb.min_bounds;
+        const Axis axis = extent.x >= extent.y && extent.x >= extent.z ? Axis::X : (extent.y >= extent.z ? Axis::Y : Axis::Z);
+        const f32 middle = 0.5f * (reference.aabb.min_bounds[axis] + reference.aabb.max_bounds[axis]);
+        const Triangle triangle = triangles.get_triangle(reference.primitive_index);
+
+        AABB left_aabb;
+        AABB right_aabb;
+        AABB unused_aabb;
+        for(const auto & [min_coord, max_coord, piece_aabb] : {
+                std::tuple<f32, f32, AABB &>(reference.aabb.min_bounds[axis], middle, left_aabb),
+                std::tuple<f32, f32, AABB &>(middle, reference.aabb.max_bounds[axis], right_aabb)})
+        {
+            project_primitive_into_bin_slow({
+                .triangle = triangle,
+                .splitting_axis = axis,
+                .left_plane_axis_coord = min_coord,
+                .right_plane_axis_coord = max_coord,
+                .parent_aabb = reference.aabb,
+                .left_aabb = piece_aabb,
+                .right_aabb = unused_aabb
+            });
+        }
+        // the triangle only touches one of the halves or the pieces degenerated, the reference stays whole
+        if(!left_aabb.check_if_valid() || !right_aabb.check_if_valid()) { continue; }
+
+        primitive_aabbs_global[reference_idx].aabb = left_aabb;
+        primitive_aabbs_global.push_back(PrimitiveAABB{.aabb = right_aabb, .primitive_index = reference.primitive_index});
+        push_candidate(reference_idx, triangle);
+        push_candidate(u32(primitive_aabbs_global.size() - 1), triangle);
+    }
+}
+
+auto BVH::collapse_leaves(u32 max_leaf_size, BVHStats & stats) -> u64
+{
+    // Children are created after their parents so a backward sweep reaches both children before their parent.
+    // The cost of a subtree is the SAH cost with absolute areas, the sorted unique triangles are only kept
+    // for subtrees small enough to become a leaf - a parent of a subtree too large is too large as well
+    std::vector<f32> subtree_costs(bvh_nodes.size());
+    std::vector<std::vector<u32>> subtree_primitives(bvh_nodes.size());
+    std::vector<bool> too_large(bvh_nodes.size(), false);
+    std::vector<bool> collapsed(bvh_nodes.size(), false);
+    for(i32 node_idx = i32(bvh_nodes.size()) - 1; node_idx >= 0; node_idx--)
+    {
+        const auto & node = bvh_nodes[node_idx];
+        const f32 area = node.bounding_box.get_area();
+        auto & primitives = subtree_primitives[node_idx];
+        if(node.left_index == -1)
+        {
+            const auto & leaf = bvh_leaves[node.right_index];
+            primitives.assign(
+                leaf_primitive_indices.begin() + leaf.first_primitive,
+                leaf_primitive_indices.begin() + leaf.first_primitive + leaf.primitive_count);
+            std::sort(primitives.begin(), primitives.end());
+            subtree_costs[node_idx] = area * f32(leaf.primitive_count) * ray_primitive_intersection_cost;
+            too_large[node_idx] = primitives.size() > max_leaf_size;
+            continue;
+        }
+
+        const f32 inner_cost = area * 2.0f * ray_aabb_intersection_cost + subtree_costs[node.left_index] + subtree_costs[node.right_index];
+        subtree_costs[node_idx] = inner_cost;
+        too_large[node_idx] = too_large[node.left_index] || too_large[node.right_index];
+        if(!too_large[node_idx])
+        {
+            // references duplicated by spatial splits below the node end up in the leaf once
+            const auto & left_primitives = subtree_primitives[node.left_index];
+            const auto & right_primitives = subtree_primitives[node.right_index];
+            std::set_union(
+                left_primitives.begin(), left_primitives.end(),
+                right_primitives.begin(), right_primitives.end(),
+                std::back_inserter(primitives));
+            too_large[node_idx] = primitives.size() > max_leaf_size;
+        }
+        const f32 leaf_cost = area * f32(primitives.size()) * ray_primitive_intersection_cost;
+        if(!too_large[node_idx] && leaf_cost <= inner_cost)
+        {
+            collapsed[node_idx] = true;
+            subtree_costs[node_idx] = leaf_cost;
+        }
+        // the primitives of the children are only needed when they are collapsed and their parent is not
+        for(const i32 child_idx : {node.left_index, node.right_index})
+        {
+            if(collapsed[node_idx] || !collapsed[child_idx]) { subtree_primitives[child_idx] = {}; }
+        }
+        if(too_large[node_idx]) { primitives = {}; }
+    }
+
+    // turn the topmost collapsed nodes into leaves, their descendants become unreachable
+    std::vector<bool> reachable(bvh_nodes.size(), false);
+    reachable[0] = true;
+    for(size_t node_idx = 0; node_idx < bvh_nodes.size(); node_idx++)
+    {
+        auto & node = bvh_nodes[node_idx];
+        if(!reachable[node_idx] || node.left_index == -1) { continue; }
+        if(!collapsed[node_idx])
+        {
+            reachable[node.left_index] = true;
+            reachable[node.right_index] = true;
+            continue;
+        }
+        const auto & primitives = subtree_primitives[node_idx];
+        bvh_leaves.push_back(BVHLeaf{
+            .first_primitive = u32(leaf_primitive_indices.size()),
+            .primitive_count = u32(primitives.size())
+        });
+        leaf_primitive_indices.insert(leaf_primitive_indices.end(), primitives.begin(), primitives.end());
+        node.left_index = -1;
+        node.right_index = i32(bvh_leaves.size() - 1);
+        std::erase_if(spatial_split_planes, [&](const SpatialSplitPlane & plane) { return plane.node_index == i32(node_idx); });
+    }
+    remove_unreachable_nodes();
+
+    std::vector<u32> depths(bvh_nodes.size(), 0u);
+    u64 leaf_depth_sum = 0ul;
+    stats.max_tree_depth = 0u;
+    for(size_t node_idx = 0; node_idx < bvh_nodes.size(); node_idx++)
+    {
+        const auto & node = bvh_nodes[node_idx];
+        stats.max_tree_depth = glm::max(stats.max_tree_depth, depths[node_idx]);
+        if(node.left_index == -1)
+        {
+            leaf_depth_sum += depths[node_idx];
+            continue;
+        }
+        depths[node.left_index] = depths[node_idx] + 1;
+        depths[node.right_index] = depths[node_idx] + 1;
+    }
+    stats.leaf_primitives_count = u32(leaf_primitive_indices.size());
+    return leaf_depth_sum;
+}
+
+auto BVH::update_view(const IndexedTriangles & triangles) -> void
+{
+    view = BVHView{
+        .nodes = bvh_nodes,
+        .leaves = bvh_leaves,
+        .leaf_primitive_indices = leaf_primitive_indices,
+        .stackless_links = stackless_links,
+        // a quantized tree reads its own copy of the exact leaf triangles
+        .triangles = quantized_leaves.empty() ? triangles : IndexedTriangles{exact_leaf_positions, exact_leaf_indices},
+        .quantized_leaves = quantized_leaves,
+        .quantized_vertices = quantized_vertices,
+        .quantized_corners = quantized_corners,
+        .quantization_grid = quantization_grid
+    };
+}
+
+BVH::BVH(const BVH & other)
+{
+    *this = other;
+}
+
+auto BVH::operator=(const BVH & other) -> BVH &
+{
+    if(this == &other) { return *this; }
+    primitive_aabbs_global = other.primitive_aabbs_global;
+    bvh_nodes = other.bvh_nodes;
+    bvh_leaves = other.bvh_leaves;
+    leaf_primitive_indices = other.leaf_primitive_indices;
+    stackless_links = other.stackless_links;
+    quantized_leaves = other.quantized_leaves;
+    quantized_vertices = other.quantized_vertices;
+    quantized_corners = other.quantized_corners;
+    quantization_grid = other.quantization_grid;
+    exact_leaf_positions = other.exact_leaf_positions;
+    exact_leaf_indices = other.exact_leaf_indices;
+    ray_primitive_intersection_cost = other.ray_primitive_intersection_cost;
+    ray_aabb_intersection_cost = other.ray_aabb_intersection_cost;
+    spatial_split_planes = other.spatial_split_planes;
+    built_info = other.built_info;
+    built_triangles = other.built_triangles;
+    refit_data = other.refit_data;
+    built_sah_cost = other.built_sah_cost;
+    build_decisions = other.build_decisions;
+    mapped_file = other.mapped_file;
+    // a mapped view points into the shared file and stays valid as is
+    if(mapped_file) { view = other.view; }
+    else            { update_view(other.view.triangles); }
+    return *this;
+}
+
+auto BVH::build_stackless_links() -> void
+{
+    stackless_links.assign(bvh_nodes.size(), StacklessNodeLinks{
+        .parent_index = -1,
+        .sibling_index = -1,
+        .split_axis = Axis::X,
+        .swap_children = false
+    });
+
+    for(i32 node_idx = 0; node_idx < i32(bvh_nodes.size()); node_idx++)
+    {
+        const auto & node = bvh_nodes[node_idx];
+        if(node.left_index <= 0) { continue; }
+
+        auto & links = stackless_links[node_idx];
+        const auto & left_aabb = bvh_nodes[node.left_index].bounding_box;
+        const auto & right_aabb = bvh_nodes[node.right_index].bounding_box;
+        f32 best_centroid_distance = -1.0f;
+        for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
+        {
+            const f32 centroid_distance = glm::abs(
+                right_aabb.get_axis_centroid(static_cast<Axis>(axis)) - left_aabb.get_axis_centroid(static_cast<Axis>(axis)));
+            if(centroid_distance > best_centroid_distance)
+            {
+                best_centroid_distance = centroid_distance;
+                links.split_axis = static_cast<Axis>(axis);
+            }
+        }
+        links.swap_children = right_aabb.get_axis_centroid(links.split_axis) < left_aabb.get_axis_centroid(links.split_axis);
+
+        stackless_links[node.left_index].parent_index = node_idx;
+        stackless_links[node.left_index].sibling_index = node.right_index;
+        stackless_links[node.right_index].parent_index = node_idx;
+        stackless_links[node.right_index].sibling_index = node.left_index;
+    }
 }
 
 auto BVH::create_leaf(const CreateLeafInfo & info) -> void
 {
-    auto & leaf = bvh_leaves.emplace_back();
-    info.stats.leaf_primitives_count += info.node_span.size;
+    const size_t first_primitive = leaf_primitive_indices.size();
     for(i64 i = info.node_span.start + info.node_span.size - 1; i >= i64(info.node_span.start); i--)
     {
-        const auto & primitive_aabb = primitive_aabbs_global.at(i);
-        leaf.primitives.push_back(primitive_aabb.primitive);
+        // pieces of a triangle split by the early split clipping may end up in the same leaf, it is stored once
+        const u32 primitive_index = primitive_aabbs_global.at(i).primitive_index;
+        if(std::find(leaf_primitive_indices.begin() + first_primitive, leaf_primitive_indices.end(), primitive_index) == leaf_primitive_indices.end())
+        {
+            leaf_primitive_indices.push_back(primitive_index);
+        }
         primitive_aabbs_global.pop_back();
     }
+    bvh_leaves.emplace_back(BVHLeaf{
+        .first_primitive = u32(first_primitive),
+        .primitive_count = u32(leaf_primitive_indices.size() - first_primitive)
+    });
+    info.stats.leaf_primitives_count += bvh_leaves.back().primitive_count;
     bvh_nodes.at(info.node_idx).left_index = -1;
     bvh_nodes.at(info.node_idx).right_index = i32(bvh_leaves.size() - 1);
 }
 
-auto BVH::get_bvh_visualization_data() const -> std::vector<AABBGeometryInfo>
+auto BVH::get_bvh_visualization_data() const -> std::vector<BVHVisualizationInfo>
 {
-    std::vector<AABBGeometryInfo> info;
-    info.reserve(bvh_nodes.size());
-    if(bvh_nodes.empty()) {return info;}
+    std::vector<BVHVisualizationInfo> info;
+    info.reserve(view.nodes.size());
+    if(view.nodes.empty()) {return info;}
 
-    const auto & root_node = bvh_nodes.at(0);
+    const auto & root_node = view.nodes[0];
     using Node = std::pair<u32, const BVHNode &>;  
 
     std::queue<Node> que;
@@ -958,10 +1405,10 @@ auto BVH::get_bvh_visualization_data() const -> std::vector<AABBGeometryInfo>
     {
         const auto & [depth, node] = que.front();
         const auto & aabb = node.bounding_box;
-        info.emplace_back(AABBGeometryInfo{
-            .position = daxa_vec3_from_glm(aabb.min_bounds),
-            .scale = daxa_vec3_from_glm(aabb.max_bounds - aabb.min_bounds),
-            .depth = static_cast<daxa::u32>(depth),
+        info.emplace_back(BVHVisualizationInfo{
+            .position = aabb.min_bounds,
+            .scale = aabb.max_bounds - aabb.min_bounds,
+            .depth = depth,
 #ifdef VISUALIZE_SPATIAL_SPLITS
             .spatial = node.spatial
 #endif
@@ -969,10 +1416,10 @@ auto BVH::get_bvh_visualization_data() const -> std::vector<AABBGeometryInfo>
         
         if(node.left_index > 0) 
         {
-            que.push({depth + 1u, bvh_nodes.at(node.left_index)});
+            que.push({depth + 1u, view.nodes[node.left_index]});
             if(node.right_index != 0)
             {
-                que.push({depth + 1u, bvh_nodes.at(node.right_index)});
+                que.push({depth + 1u, view.nodes[node.right_index]});
             }
             else 
             { 
@@ -993,26 +1440,45 @@ auto BVH::get_bvh_visualization_data() const -> std::vector<AABBGeometryInfo>
     return info;
 }
 
-auto BVH::get_nearest_intersection(const Ray & ray) const -> Hit
+auto BVH::get_bounds() const -> AABB
 {
-    const auto & root_node = bvh_nodes.at(0);
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-    i32 traversal_cnt = 1;
-#endif
+    return view.nodes.empty() ? AABB() : view.nodes[0].bounding_box;
+}
 
-    auto hit = root_node.bounding_box.ray_box_intersection(ray);
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-        hit.traversal_steps = traversal_cnt;
-#endif
-    // The ray missed the scene
-    if(!hit.hit) { return hit; }
+auto BVH::get_sah_cost() const -> f32
+{
+    if(view.nodes.empty()) { return 0.0f; }
+    const f64 root_area = view.nodes[0].bounding_box.get_area();
+    if(root_area <= 0.0) { return 0.0f; }
+    f64 cost = 0.0;
+    for(const auto & node : view.nodes)
+    {
+        const f64 relative_area = node.bounding_box.get_area() / root_area;
+        if(node.left_index == -1)
+        {
+            cost += relative_area * view.leaves[node.right_index].primitive_count * ray_primitive_intersection_cost;
+        } else {
+            cost += relative_area * 2.0 * ray_aabb_intersection_cost;
+        }
+    }
+    return f32(cost);
+}
 
-    Hit nearest_hit = Hit {
-        .hit = false,
-        .distance = INFINITY,
-        .normal = f32vec3(0.0f, 0.0f, 0.0f),
-        .internal_fac = 1.0f,
+auto BVH::get_memory_footprint() const -> BVHMemoryFootprint
+{
+    return BVHMemoryFootprint{
+        .nodes = view.nodes.size_bytes(),
+        .leaves = view.leaves.size_bytes() + view.leaf_primitive_indices.size_bytes(),
+        .stackless_links = view.stackless_links.size_bytes(),
+        .quantized_leaves = view.quantized_leaves.size_bytes() + view.quantized_vertices.size_bytes() + view.quantized_corners.size_bytes(),
+        .triangles = mapped_file || !view.quantized_leaves.empty() ?
+            view.triangles.positions.size_bytes() + view.triangles.indices.size_bytes() : 0
     };
+}
+
+template<typename StatsPolicy>
+auto BVH::traverse_subtree(const Ray & ray, i32 subtree_root_idx, Hit & nearest_hit, StatsPolicy & stats) const -> void
+{
     // Node consists of the bvh_node index and the intersection distance
     using Node = std::pair<i32, f32>;
     auto comparator = [](const Node & first, const Node & second) -> bool
@@ -1022,35 +1488,17 @@ auto BVH::get_nearest_intersection(const Ray & ray) const -> Hit
 
     std::priority_queue<Node, std::vector<Node>, decltype(comparator)> nodes_queue(comparator);
 
-    // NOTE(msakmary) Why would you have bvh with two leaves?? STOP
-    assert(root_node.left_index > 0 && root_node.right_index > 0);
-
-    hit = bvh_nodes.at(root_node.left_index).bounding_box.ray_box_intersection(ray);
-    if(hit.hit) { nodes_queue.emplace(root_node.left_index, hit.distance * hit.internal_fac); }
-    hit = bvh_nodes.at(root_node.right_index).bounding_box.ray_box_intersection(ray);
-    if(hit.hit) { nodes_queue.emplace(root_node.right_index, hit.distance * hit.internal_fac); }
-
-    while(!nodes_queue.empty())
+    auto process_node = [&](const BVHNode & curr_node)
     {
-        auto [node_idx, intersect_distance] = nodes_queue.top();
-        nodes_queue.pop();
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-        traversal_cnt++;
-#endif
-        // nearest AABB intersection is farther than nearest primitive hit, stop tracing
-        if(intersect_distance > nearest_hit.distance) { break; }
-
-        const auto curr_node = bvh_nodes.at(node_idx);
-
         // Nodes are not leaves so find the intersection and add it to the queue for processing
         if(curr_node.left_index > 0)
         {
-            hit = bvh_nodes.at(curr_node.left_index).bounding_box.ray_box_intersection(ray);
+            auto hit = view.nodes[curr_node.left_index].bounding_box.ray_box_intersection(ray);
             if(hit.hit) { nodes_queue.emplace(curr_node.left_index, hit.distance * hit.internal_fac); }
 
             if(curr_node.right_index > 0)
             {
-                hit = bvh_nodes.at(curr_node.right_index).bounding_box.ray_box_intersection(ray);
+                hit = view.nodes[curr_node.right_index].bounding_box.ray_box_intersection(ray);
                 if(hit.hit) { nodes_queue.emplace(curr_node.right_index, hit.distance * hit.internal_fac); }
             }
         }
@@ -1058,27 +1506,620 @@ auto BVH::get_nearest_intersection(const Ray & ray) const -> Hit
         // Node is a leaf intersect all primitives and compare the intersections with the best hit found so far
         if(curr_node.left_index == -1)
         {
-            const auto & leaf = bvh_leaves.at(curr_node.right_index);
+            const auto & leaf = view.leaves[curr_node.right_index];
 
-            for(const Triangle * leaf_primitive : leaf.primitives)
+            for(const LeafTriangle leaf_primitive : view.get_leaf_primitives(leaf))
             {
-                auto leaf_hit = leaf_primitive->intersect_ray(ray);
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-                traversal_cnt++;
-#endif
+                auto leaf_hit = leaf_primitive.intersect_ray(ray);
+                stats.count_primitive_step();
                 if(leaf_hit.hit && leaf_hit.distance < nearest_hit.distance)
                 {
                     nearest_hit = leaf_hit;
                 }
             }
         }
+    };
+
+    process_node(view.nodes[subtree_root_idx]);
+    while(!nodes_queue.empty())
+    {
+        auto [node_idx, intersect_distance] = nodes_queue.top();
+        nodes_queue.pop();
+        stats.count_node_step();
+        // nearest AABB intersection is farther than nearest primitive hit, stop tracing
+        if(intersect_distance > nearest_hit.distance) { break; }
+
+        process_node(view.nodes[node_idx]);
     }
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-    nearest_hit.traversal_steps = traversal_cnt;
-#endif
+}
+
+template<typename StatsPolicy>
+auto BVH::get_nearest_intersection_impl(const Ray & ray, StatsPolicy & stats) const -> Hit
+{
+    const auto & root_node = view.nodes[0];
+    stats.count_node_step();
+
+    auto hit = root_node.bounding_box.ray_box_intersection(ray);
+    // The ray missed the scene
+    if(!hit.hit) { return hit; }
+
+    Hit nearest_hit = Hit {
+        .hit = false,
+        .distance = INFINITY,
+        .normal = f32vec3(0.0f, 0.0f, 0.0f),
+        .internal_fac = 1.0f,
+    };
+
+    traverse_subtree(ray, 0, nearest_hit, stats);
     return nearest_hit;
 }
 
+auto BVH::get_nearest_intersection(const Ray & ray) const -> Hit
+{
+    NoTraversalStats stats;
+    return get_nearest_intersection_impl(ray, stats);
+}
+
+auto BVH::get_nearest_intersection(const Ray & ray, TraversalStats & stats) const -> Hit
+{
+    return get_nearest_intersection_impl(ray, stats);
+}
+
+auto BVH::update_nearest_intersection(const Ray & ray, Hit & nearest_hit) const -> void
+{
+    if(view.nodes.empty()) { return; }
+    NoTraversalStats stats;
+    auto hit = view.nodes[0].bounding_box.ray_box_intersection(ray);
+    if(!hit.hit || hit.distance * hit.internal_fac > nearest_hit.distance) { return; }
+    traverse_subtree(ray, 0, nearest_hit, stats);
+}
+
+// Conservative test of the whole packet against the AABB using interval arithmetic. Returns false only 
+// if it is guaranteed that no ray of the packet intersects the AABB
+static auto packet_intervals_hit_aabb(const RayPacket & packet, const AABB & aabb) -> bool
+{
+    f32 entry_lower = -INFINITY;
+    f32 exit_upper = INFINITY;
+    for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
+    {
+        // all of the rays have the same direction sign in this axis (checked by RayPacket::compute_intervals)
+        const bool positive = packet.inverted_direction_min[axis] > 0.0f;
+        const f32 near_plane = positive ? aabb.min_bounds[axis] : aabb.max_bounds[axis];
+        const f32 far_plane = positive ? aabb.max_bounds[axis] : aabb.min_bounds[axis];
+
+        // interval of (plane - start) * inverted_direction over all of the rays in the packet
+        auto get_plane_interval = [&](f32 plane) -> std::pair<f32, f32>
+        {
+            const f32 d0 = plane - packet.start_max[axis];
+            const f32 d1 = plane - packet.start_min[axis];
+            const f32 i0 = packet.inverted_direction_min[axis];
+            const f32 i1 = packet.inverted_direction_max[axis];
+            return {
+                glm::min(glm::min(d0 * i0, d0 * i1), glm::min(d1 * i0, d1 * i1)),
+                glm::max(glm::max(d0 * i0, d0 * i1), glm::max(d1 * i0, d1 * i1))
+            };
+        };
+        entry_lower = glm::max(entry_lower, get_plane_interval(near_plane).first);
+        exit_upper = glm::min(exit_upper, get_plane_interval(far_plane).second);
+    }
+    return entry_lower <= exit_upper && exit_upper > 0.0f;
+}
+
+// Returns the mask of the active lanes which intersect the AABB closer than their current nearest hit
+static auto packet_aabb_hit_mask(
+    const RayPacket & packet,
+    const AABB & aabb,
+    const std::array<Hit, PACKET_SIZE> & hits,
+    u32 active_mask) -> u32
+{
+    std::array<f32, PACKET_SIZE> tmin;
+    std::array<f32, PACKET_SIZE> tmax;
+    tmin.fill(-INFINITY);
+    tmax.fill(INFINITY);
+    for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
+    {
+        for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            const f32 t1 = (aabb.min_bounds[axis] - packet.start[axis][lane]) * packet.inverted_direction[axis][lane];
+            const f32 t2 = (aabb.max_bounds[axis] - packet.start[axis][lane]) * packet.inverted_direction[axis][lane];
+            tmin[lane] = glm::max(tmin[lane], glm::min(t1, t2));
+            tmax[lane] = glm::min(tmax[lane], glm::max(t1, t2));
+        }
+    }
+
+    u32 hit_mask = 0u;
+    for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        const bool lane_hit = tmax[lane] >= tmin[lane] && tmax[lane] > 0.0f && tmin[lane] <= hits[lane].distance;
+        hit_mask |= u32(lane_hit) << lane;
+    }
+    return hit_mask & active_mask;
+}
+
+auto BVH::get_nearest_intersections(const PacketTraversalInfo & info) const -> std::array<Hit, PACKET_SIZE>
+{
+    const auto & packet = info.packet;
+    std::array<Hit, PACKET_SIZE> hits;
+    hits.fill(Hit {
+        .hit = false,
+        .distance = INFINITY,
+        .normal = f32vec3(0.0f, 0.0f, 0.0f),
+        .internal_fac = 1.0f,
+    });
+    if(view.nodes.empty() || packet.active_mask == 0u) { return hits; }
+
+    const bool interval_culling = info.interval_culling && packet.intervals_valid;
+    NoTraversalStats stats;
+
+    // PacketNode consists of the bvh_node index and the mask of rays which are still active in it
+    using PacketNode = std::pair<i32, u32>;
+    std::stack<PacketNode, std::vector<PacketNode>> nodes;
+    nodes.push({0, packet.active_mask});
+
+    while(!nodes.empty())
+    {
+        auto [node_idx, active_mask] = nodes.top();
+        nodes.pop();
+        const auto & curr_node = view.nodes[node_idx];
+
+        if(interval_culling && !packet_intervals_hit_aabb(packet, curr_node.bounding_box)) { continue; }
+        active_mask = packet_aabb_hit_mask(packet, curr_node.bounding_box, hits, active_mask);
+        if(active_mask == 0u) { continue; }
+
+        // Node is a leaf intersect all primitives with all of the active rays
+        if(curr_node.left_index == -1)
+        {
+            const auto & leaf = view.leaves[curr_node.right_index];
+            for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                if((active_mask & (1u << lane)) == 0u) { continue; }
+                const Ray ray = packet.get_ray(lane);
+                for(const LeafTriangle leaf_primitive : view.get_leaf_primitives(leaf))
+                {
+                    auto leaf_hit = leaf_primitive.intersect_ray(ray);
+                    if(leaf_hit.hit && leaf_hit.distance < hits[lane].distance)
+                    {
+                        hits[lane] = leaf_hit;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // The packet lost its coherence - finish the subtree with single ray traversal
+        if(u32(std::popcount(active_mask)) < info.min_active_rays)
+        {
+            for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                if((active_mask & (1u << lane)) == 0u) { continue; }
+                traverse_subtree(packet.get_ray(lane), node_idx, hits[lane], stats);
+            }
+            continue;
+        }
+
+        // Push the far child first so that the near one is processed next. The near child is determined
+        // by the direction of the first active ray along the axis in which the child centroids differ the most
+        const auto & left_aabb = view.nodes[curr_node.left_index].bounding_box;
+        const auto & right_aabb = view.nodes[curr_node.right_index].bounding_box;
+        f32 best_centroid_distance = -1.0f;
+        Axis order_axis = Axis::X;
+        for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
+        {
+            const f32 centroid_distance = glm::abs(
+                right_aabb.get_axis_centroid(static_cast<Axis>(axis)) - left_aabb.get_axis_centroid(static_cast<Axis>(axis)));
+            if(centroid_distance > best_centroid_distance)
+            {
+                best_centroid_distance = centroid_distance;
+                order_axis = static_cast<Axis>(axis);
+            }
+        }
+        const u32 first_active_lane = u32(std::countr_zero(active_mask));
+        const f32 centroid_offset = 
+            right_aabb.get_axis_centroid(order_axis) - left_aabb.get_axis_centroid(order_axis);
+        const bool left_is_near = centroid_offset * packet.direction[order_axis][first_active_lane] >= 0.0f;
+
+        if(left_is_near)
+        {
+            nodes.push({curr_node.right_index, active_mask});
+            nodes.push({curr_node.left_index, active_mask});
+        } else {
+            nodes.push({curr_node.left_index, active_mask});
+            nodes.push({curr_node.right_index, active_mask});
+        }
+    }
+    return hits;
+}
+
+auto BVH::get_nearest_intersections(const StreamTraversalInfo & info) const -> void
+{
+    assert(info.rays.size() == info.hits.size());
+    assert(info.max_distances.empty() || info.max_distances.size() == info.rays.size());
+    for(size_t i = 0; i < info.hits.size(); i++)
+    {
+        info.hits[i] = Hit {
+            .hit = false,
+            .distance = info.max_distances.empty() ? INFINITY : info.max_distances[i],
+            .normal = f32vec3(0.0f, 0.0f, 0.0f),
+            .internal_fac = 1.0f,
+        };
+    }
+    if(view.nodes.empty() || info.rays.empty()) { return; }
+
+    std::vector<f32vec3> inverted_directions;
+    inverted_directions.reserve(info.rays.size());
+    for(const auto & ray : info.rays) { inverted_directions.push_back(1.0f / ray.direction); }
+
+    auto ray_hits_aabb = [&](u32 ray_idx, const AABB & aabb) -> bool
+    {
+        const auto & ray = info.rays[ray_idx];
+        const f32vec3 t1 = (aabb.min_bounds - ray.start) * inverted_directions[ray_idx];
+        const f32vec3 t2 = (aabb.max_bounds - ray.start) * inverted_directions[ray_idx];
+        const f32vec3 t_near = component_wise_min(t1, t2);
+        const f32vec3 t_far = component_wise_max(t1, t2);
+        const f32 tmin = glm::max(glm::max(t_near.x, t_near.y), t_near.z);
+        const f32 tmax = glm::min(glm::min(t_far.x, t_far.y), t_far.z);
+        if(info.any_hit && info.hits[ray_idx].hit) { return false; }
+        return tmax >= tmin && tmax > 0.0f && tmin <= info.hits[ray_idx].distance;
+    };
+
+    // The ray indices of all nodes on the stack are stored in a single buffer. Because the nodes are processed 
+    // depth first the buffer behaves like a stack as well - the rays of the node on the top of the stack are
+    // always the last segment of the buffer, everything after it belongs to already finished subtrees
+    std::vector<u32> ray_indices(info.rays.size());
+    std::iota(ray_indices.begin(), ray_indices.end(), 0u);
+    ray_indices.erase(
+        std::remove_if(ray_indices.begin(), ray_indices.end(),
+            [&](u32 ray_idx) { return !ray_hits_aabb(ray_idx, view.nodes[0].bounding_box); }),
+        ray_indices.end());
+
+    // StreamNode consists of the bvh_node index and the span of its rays in the ray_indices buffer
+    using StreamNode = std::pair<i32, NodeSpan>;
+    std::stack<StreamNode, std::vector<StreamNode>> nodes;
+    if(!ray_indices.empty()) { nodes.push({0, NodeSpan{0, ray_indices.size()}}); }
+
+    while(!nodes.empty())
+    {
+        auto [node_idx, ray_span] = nodes.top();
+        nodes.pop();
+        ray_indices.resize(ray_span.start + ray_span.size);
+        const auto & curr_node = view.nodes[node_idx];
+
+        // Node is a leaf - intersect each primitive with all of the rays which reached it
+        if(curr_node.left_index == -1)
+        {
+            const auto & leaf = view.leaves[curr_node.right_index];
+            for(const LeafTriangle leaf_primitive : view.get_leaf_primitives(leaf))
+            {
+                for(size_t i = ray_span.start; i < ray_span.start + ray_span.size; i++)
+                {
+                    const u32 ray_idx = ray_indices[i];
+                    if(info.any_hit && info.hits[ray_idx].hit) { continue; }
+                    auto leaf_hit = leaf_primitive.intersect_ray(info.rays[ray_idx]);
+                    if(leaf_hit.hit && leaf_hit.distance < info.hits[ray_idx].distance)
+                    {
+                        info.hits[ray_idx] = leaf_hit;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Process the child which is nearer for the average ray direction of the node first
+        const auto & left_aabb = view.nodes[curr_node.left_index].bounding_box;
+        const auto & right_aabb = view.nodes[curr_node.right_index].bounding_box;
+        f32vec3 direction_sum = f32vec3(0.0f);
+        for(size_t i = ray_span.start; i < ray_span.start + ray_span.size; i++)
+        {
+            direction_sum += info.rays[ray_indices[i]].direction;
+        }
+        const f32vec3 centroid_offset = 
+            (right_aabb.min_bounds + right_aabb.max_bounds - left_aabb.min_bounds - left_aabb.max_bounds) * 0.5f;
+        const bool left_is_near = glm::dot(centroid_offset, direction_sum) >= 0.0f;
+        const i32 near_idx = left_is_near ? curr_node.left_index : curr_node.right_index;
+        const i32 far_idx = left_is_near ? curr_node.right_index : curr_node.left_index;
+
+        // Partition the rays of the node into the rays intersecting each of the children. The child spans are
+        // appended behind the span of the current node - far child first so that the near child span is the
+        // last one in the buffer and its node is on the top of the stack
+        auto partition_child = [&](i32 child_idx)
+        {
+            const auto & child_aabb = view.nodes[child_idx].bounding_box;
+            NodeSpan child_span = {ray_indices.size(), 0};
+            for(size_t i = ray_span.start; i < ray_span.start + ray_span.size; i++)
+            {
+                const u32 ray_idx = ray_indices[i];
+                if(ray_hits_aabb(ray_idx, child_aabb)) { ray_indices.push_back(ray_idx); }
+            }
+            child_span.size = ray_indices.size() - child_span.start;
+            if(child_span.size > 0) { nodes.push({child_idx, child_span}); }
+        };
+        partition_child(far_idx);
+        partition_child(near_idx);
+    }
+}
+
+auto BVH::get_nearest_intersections(const InterleavedTraversalInfo & info) const -> void
+{
+    assert(info.rays.size() == info.hits.size());
+    std::fill(info.hits.begin(), info.hits.end(), Hit {
+        .hit = false,
+        .distance = INFINITY,
+        .normal = f32vec3(0.0f, 0.0f, 0.0f),
+        .internal_fac = 1.0f,
+    });
+    if(view.nodes.empty() || info.rays.empty()) { return; }
+
+    // Node consists of the bvh_node index and the intersection distance
+    using Node = std::pair<i32, f32>;
+    // The traversal of a single ray is a state machine which can be suspended after any visited node
+    struct RayState
+    {
+        size_t ray_idx;
+        Hit nearest_hit;
+        // nodes whose bounding box is known to be hit, ordered so that the nearest one is on the top
+        std::vector<Node> stack;
+        bool active;
+    };
+
+    // Prefetch the data the ray needs for visiting the node on the top of its stack. The node itself is
+    // already in cache since its bounding box was tested when it was pushed. For an inner node both children
+    // are prefetched, they are allocated next to each other but may straddle a cache line. For a leaf the
+    // record was prefetched when it was pushed so it is read here to prefetch its primitive indices - the
+    // triangles they point to are fetched without a prefetch
+    auto prefetch_next = [&](const RayState & state)
+    {
+        if(state.stack.empty()) { return; }
+        const auto & next_node = view.nodes[state.stack.back().first];
+        if(next_node.left_index != -1)
+        {
+            PREFETCH(&view.nodes[next_node.left_index]);
+            PREFETCH(&view.nodes[next_node.right_index]);
+        } else {
+            const auto & leaf = view.leaves[next_node.right_index];
+            PREFETCH(view.leaf_primitive_indices.data() + leaf.first_primitive);
+        }
+    };
+    auto push_child = [&](RayState & state, i32 child_idx, f32 distance)
+    {
+        const auto & child = view.nodes[child_idx];
+        if(child.left_index == -1) { PREFETCH(&view.leaves[child.right_index]); }
+        state.stack.emplace_back(child_idx, distance);
+    };
+
+    size_t next_ray_idx = 0;
+    // Assigns the next ray which hits the scene to the state, returns false when there are no rays left
+    auto start_next_ray = [&](RayState & state) -> bool
+    {
+        while(next_ray_idx < info.rays.size())
+        {
+            const size_t ray_idx = next_ray_idx++;
+            auto hit = view.nodes[0].bounding_box.ray_box_intersection(info.rays[ray_idx]);
+            if(!hit.hit) { continue; }
+
+            state.ray_idx = ray_idx;
+            state.nearest_hit = info.hits[ray_idx];
+            state.stack.clear();
+            state.stack.emplace_back(0, hit.distance * hit.internal_fac);
+            prefetch_next(state);
+            return true;
+        }
+        return false;
+    };
+
+    // Visits a single node of the traversal, returns false once the traversal of the ray is finished
+    auto step = [&](RayState & state) -> bool
+    {
+        const Ray & ray = info.rays[state.ray_idx];
+        // skip the nodes which are farther than the nearest primitive hit found so far
+        while(!state.stack.empty() && state.stack.back().second > state.nearest_hit.distance)
+        {
+            state.stack.pop_back();
+        }
+        if(state.stack.empty()) { return false; }
+
+        const auto & curr_node = view.nodes[state.stack.back().first];
+        state.stack.pop_back();
+
+        if(curr_node.left_index == -1)
+        {
+            const auto & leaf = view.leaves[curr_node.right_index];
+            for(const LeafTriangle leaf_primitive : view.get_leaf_primitives(leaf))
+            {
+                auto leaf_hit = leaf_primitive.intersect_ray(ray);
+                if(leaf_hit.hit && leaf_hit.distance < state.nearest_hit.distance)
+                {
+                    state.nearest_hit = leaf_hit;
+                }
+            }
+        }
+        else 
+        {
+            auto left_hit = view.nodes[curr_node.left_index].bounding_box.ray_box_intersection(ray);
+            auto right_hit = view.nodes[curr_node.right_index].bounding_box.ray_box_intersection(ray);
+            const f32 left_distance = left_hit.distance * left_hit.internal_fac;
+            const f32 right_distance = right_hit.distance * right_hit.internal_fac;
+            // push the farther child first so that the nearer one ends on the top of the stack
+            if(left_distance <= right_distance)
+            {
+                if(right_hit.hit) { push_child(state, curr_node.right_index, right_distance); }
+                if(left_hit.hit) { push_child(state, curr_node.left_index, left_distance); }
+            } else {
+                if(left_hit.hit) { push_child(state, curr_node.left_index, left_distance); }
+                if(right_hit.hit) { push_child(state, curr_node.right_index, right_distance); }
+            }
+        }
+        prefetch_next(state);
+        return true;
+    };
+
+    std::vector<RayState> states(glm::max(info.interleaved_ray_count, 1u));
+    u32 active_states = 0;
+    for(auto & state : states)
+    {
+        state.active = start_next_ray(state);
+        if(state.active) { active_states++; }
+    }
+
+    // Round robin over the in flight rays - each one visits a single node and yields to the next one
+    while(active_states > 0)
+    {
+        for(auto & state : states)
+        {
+            if(!state.active) { continue; }
+            if(step(state)) { continue; }
+
+            info.hits[state.ray_idx] = state.nearest_hit;
+            state.active = start_next_ray(state);
+            if(!state.active) { active_states--; }
+        }
+    }
+}
+
+// Adapted from:
+// Hapala et al. - Efficient Stack-less BVH Traversal for Ray Tracing (2011)
+auto BVH::get_nearest_intersection_stackless(const Ray & ray) const -> Hit
+{
+    Hit nearest_hit = Hit {
+        .hit = false,
+        .distance = INFINITY,
+        .normal = f32vec3(0.0f, 0.0f, 0.0f),
+        .internal_fac = 1.0f,
+    };
+    if(view.stackless_links.empty()) { return nearest_hit; }
+
+    auto node_hit = [&](const BVHNode & node) -> bool
+    {
+        auto hit = node.bounding_box.ray_box_intersection(ray);
+        return hit.hit && hit.distance * hit.internal_fac <= nearest_hit.distance;
+    };
+    auto intersect_leaf = [&](const BVHNode & node)
+    {
+        const auto & leaf = view.leaves[node.right_index];
+        for(const LeafTriangle leaf_primitive : view.get_leaf_primitives(leaf))
+        {
+            auto leaf_hit = leaf_primitive.intersect_ray(ray);
+            if(leaf_hit.hit && leaf_hit.distance < nearest_hit.distance)
+            {
+                nearest_hit = leaf_hit;
+            }
+        }
+    };
+    auto near_child = [&](i32 node_idx) -> i32
+    {
+        const auto & node = view.nodes[node_idx];
+        const auto & links = view.stackless_links[node_idx];
+        const bool left_is_near = (ray.direction[links.split_axis] >= 0.0f) != links.swap_children;
+        return left_is_near ? node.left_index : node.right_index;
+    };
+
+    const auto & root_node = view.nodes[0];
+    if(!node_hit(root_node)) { return nearest_hit; }
+    if(root_node.left_index == -1)
+    {
+        intersect_leaf(root_node);
+        return nearest_hit;
+    }
+
+    // The direction from which the current node was entered is the only traversal state apart from the node itself
+    enum EnteredFrom { PARENT, SIBLING, CHILD };
+    EnteredFrom state = EnteredFrom::PARENT;
+    i32 current_idx = near_child(0);
+
+    while(true)
+    {
+        const auto & curr_node = view.nodes[current_idx];
+        const auto & curr_links = view.stackless_links[current_idx];
+        switch(state)
+        {
+            case EnteredFrom::CHILD:
+            {
+                if(current_idx == 0) { return nearest_hit; }
+                // coming up from the near child continue with the far one, coming up from the far child go up further
+                if(current_idx == near_child(curr_links.parent_index))
+                {
+                    current_idx = curr_links.sibling_index;
+                    state = EnteredFrom::SIBLING;
+                } else {
+                    current_idx = curr_links.parent_index;
+                    state = EnteredFrom::CHILD;
+                }
+                break;
+            }
+            case EnteredFrom::SIBLING:
+            {
+                if(!node_hit(curr_node))
+                {
+                    current_idx = curr_links.parent_index;
+                    state = EnteredFrom::CHILD;
+                } 
+                else if(curr_node.left_index == -1)
+                {
+                    intersect_leaf(curr_node);
+                    current_idx = curr_links.parent_index;
+                    state = EnteredFrom::CHILD;
+                } 
+                else 
+                {
+                    current_idx = near_child(current_idx);
+                    state = EnteredFrom::PARENT;
+                }
+                break;
+            }
+            case EnteredFrom::PARENT:
+            {
+                if(!node_hit(curr_node))
+                {
+                    current_idx = curr_links.sibling_index;
+                    state = EnteredFrom::SIBLING;
+                } 
+                else if(curr_node.left_index == -1)
+                {
+                    intersect_leaf(curr_node);
+                    current_idx = curr_links.sibling_index;
+                    state = EnteredFrom::SIBLING;
+                } 
+                else 
+                {
+                    current_idx = near_child(current_idx);
+                    state = EnteredFrom::PARENT;
+                }
+                break;
+            }
+        }
+    }
+}
+
+auto BVH::is_occluded(const Ray & ray, f32 max_distance) const -> bool
+{
+    if(view.nodes.empty()) { return false; }
+
+    // any hit is enough so the nodes don't need to be ordered - a plain stack is sufficient
+    std::stack<i32, std::vector<i32>> nodes;
+    nodes.push(0);
+    while(!nodes.empty())
+    {
+        const auto & curr_node = view.nodes[nodes.top()];
+        nodes.pop();
+
+        auto hit = curr_node.bounding_box.ray_box_intersection(ray);
+        if(!hit.hit || hit.distance * hit.internal_fac > max_distance) { continue; }
+
+        if(curr_node.left_index == -1)
+        {
+            const auto & leaf = view.leaves[curr_node.right_index];
+            for(const LeafTriangle leaf_primitive : view.get_leaf_primitives(leaf))
+            {
+                auto leaf_hit = leaf_primitive.intersect_ray(ray);
+                if(leaf_hit.hit && leaf_hit.distance < max_distance) { return true; }
+            }
+            continue;
+        }
+        nodes.push(curr_node.right_index);
+        nodes.push(curr_node.left_index);
+    }
+    return false;
+}
+
 auto SAH(const SAHCalculateInfo & info) -> f32
 {
     // Cost = 2 * T_AABB +
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <span>
+#include <memory>
+#include <string>
+
 #include "triangle.hpp"
 #include "aabb.hpp"
+#include "ray_packet.hpp"
 #include "../types.hpp"
 #include "../utils.hpp"
-#include "../rendering_backend/shared/draw_aabb_shared.inl"
 
 struct SAHCalculateInfo
 {
@@ -41,7 +45,8 @@ struct NodeSpan
 struct PrimitiveAABB
 {
     AABB aabb;
-    const Triangle * primitive{};
+    // index of the triangle in the IndexedTriangles the BVH is built from
+    u32 primitive_index{};
 };
 
 struct BVHNode
@@ -56,9 +61,183 @@ struct BVHNode
 #endif
 };
 
+// Links used by the stackless traversal, one per BVHNode. The bounds and children are read from the node itself,
+// the parent and sibling links let the traversal walk the tree with only a few words of state per ray
+struct StacklessNodeLinks
+{
+    // both are -1 for the root node
+    i32 parent_index{};
+    i32 sibling_index{};
+    // the axis along which the children are separated the most - decides which child is near for a ray
+    Axis split_axis{};
+    // true when the right child of the node lies on the negative side of split_axis
+    bool swap_children{};
+};
+
+// Leaves don't own their primitives - they reference a range in the leaf primitive index array which in turn
+// holds indices of the scene triangles. The same primitive can be referenced by multiple leaves when it was split
+// by a spatial split. Keeping leaves free of pointers allows the whole BVH to be stored in a file and used in place
 struct BVHLeaf
 {
-    std::vector<const Triangle *> primitives;
+    u32 first_primitive;
+    u32 primitive_count;
+};
+
+// Scene wide grid the quantized leaf vertices are snapped to. All leaves share it so a vertex referenced by several
+// leaves decodes to the same position in each of them and the quantized geometry stays watertight
+struct QuantizationGrid
+{
+    f32vec3 origin;
+    f32vec3 step;
+};
+
+struct QuantizedVertex
+{
+    u16 x;
+    u16 y;
+    u16 z;
+};
+
+// Optional compressed encoding of a leaf. Vertices of the leaf triangles are stored once per leaf as 16 bit offsets
+// from the grid cell of the leaf and every triangle as three byte indices into them. Leaves which don't fit into
+// this encoding (too large or too many vertices) are marked exact and intersect the full precision triangles.
+// Quantized leaves keep no exact data - their range in the leaf primitive indices is empty
+struct QuantizedLeaf
+{
+    u32vec3 grid_origin;
+    u32 first_vertex;
+    // first of the three vertex indices per triangle in the corner array or QUANTIZED_LEAF_EXACT
+    u32 first_corner;
+};
+static constexpr u32 QUANTIZED_LEAF_EXACT = ~0u;
+
+struct QuantizedLeafDecoder
+{
+    QuantizationGrid grid;
+    u32vec3 grid_origin;
+    const QuantizedVertex * vertices;
+
+    [[nodiscard]] inline auto decode_vertex(u8 index) const -> f32vec3
+    {
+        const QuantizedVertex & vertex = vertices[index];
+        const u32vec3 grid_position = grid_origin + u32vec3(vertex.x, vertex.y, vertex.z);
+        return grid.origin + f32vec3(grid_position) * grid.step;
+    }
+
+    [[nodiscard]] inline auto decode(const u8 * corners) const -> Triangle
+    {
+        return Triangle{
+            .v0 = decode_vertex(corners[0]),
+            .v1 = decode_vertex(corners[1]),
+            .v2 = decode_vertex(corners[2])
+        };
+    }
+
+    // snapping moves a vertex by half a grid step at most, the other half covers the rounding of the decoding
+    [[nodiscard]] inline auto get_error() const -> f32vec3 { return grid.step; }
+};
+
+// Triangle of a leaf as the traversal sees it - decoded triangles are intersected conservatively so that
+// no ray hitting the exact triangle misses its decoded one
+struct LeafTriangle
+{
+    Triangle triangle;
+    // zero for exact triangles
+    f32vec3 error;
+
+    [[nodiscard]] inline auto intersect_ray(const Ray & ray) const -> Hit
+    {
+        if(error == f32vec3(0.0f)) { return triangle.intersect_ray(ray); }
+        return triangle.intersect_ray_conservative(ray, error);
+    }
+};
+
+// Iterates the primitives referenced by a single leaf - the triangles are gathered from the shared vertices
+// or decoded from the quantized leaf on access
+struct LeafPrimitives
+{
+    struct Iterator
+    {
+        const LeafPrimitives * leaf;
+        u32 primitive;
+
+        inline auto operator*() const -> LeafTriangle
+        {
+            if(leaf->first_corner != nullptr)
+            {
+                return {leaf->decoder.decode(leaf->first_corner + size_t(primitive) * 3), leaf->decoder.get_error()};
+            }
+            return {leaf->triangles->get_triangle(leaf->first_index[primitive]), f32vec3(0.0f)};
+        }
+        inline auto operator++() -> Iterator &
+        {
+            primitive++;
+            return *this;
+        }
+        inline auto operator!=(const Iterator & other) const -> bool { return primitive != other.primitive; }
+    };
+
+    // unused by quantized leaves
+    const u32 * first_index;
+    u32 count;
+    const IndexedTriangles * triangles;
+    // null for leaves which are not quantized
+    const u8 * first_corner = nullptr;
+    QuantizedLeafDecoder decoder = {};
+
+    [[nodiscard]] inline auto begin() const -> Iterator { return {this, 0}; }
+    [[nodiscard]] inline auto end() const -> Iterator { return {this, count}; }
+};
+
+// Non owning view of the finalised BVH data used by all of the traversal kernels. The spans either point into
+// the vectors filled by the builder or directly into a memory mapped BVH file
+struct BVHView
+{
+    std::span<const BVHNode> nodes;
+    std::span<const BVHLeaf> leaves;
+    std::span<const u32> leaf_primitive_indices;
+    std::span<const StacklessNodeLinks> stackless_links;
+    // with quantized leaves these are only the triangles of the exact leaves, compacted into data the BVH owns
+    IndexedTriangles triangles;
+    // empty unless the BVH was built with quantized leaves, quantized_leaves then has one entry per leaf
+    std::span<const QuantizedLeaf> quantized_leaves;
+    std::span<const QuantizedVertex> quantized_vertices;
+    std::span<const u8> quantized_corners;
+    QuantizationGrid quantization_grid;
+
+    [[nodiscard]] inline auto get_leaf_primitives(const BVHLeaf & leaf) const -> LeafPrimitives
+    {
+        LeafPrimitives primitives = {
+            .first_index = leaf_primitive_indices.data() + leaf.first_primitive,
+            .count = leaf.primitive_count,
+            .triangles = &triangles
+        };
+        if(!quantized_leaves.empty())
+        {
+            const QuantizedLeaf & quantized_leaf = quantized_leaves[&leaf - leaves.data()];
+            if(quantized_leaf.first_corner != QUANTIZED_LEAF_EXACT)
+            {
+                primitives.first_corner = quantized_corners.data() + quantized_leaf.first_corner;
+                primitives.decoder = QuantizedLeafDecoder{
+                    .grid = quantization_grid,
+                    .grid_origin = quantized_leaf.grid_origin,
+                    .vertices = quantized_vertices.data() + quantized_leaf.first_vertex
+                };
+            }
+        }
+        return primitives;
+    }
+};
+
+// Renderer independent description of a single BVH node AABB used for the visualization
+struct BVHVisualizationInfo
+{
+    f32vec3 position;
+    f32vec3 scale;
+    u32 depth;
+#ifdef VISUALIZE_SPATIAL_SPLITS
+    u32 spatial;
+#endif
 };
 
 struct BestSplitInfo
@@ -110,6 +289,15 @@ struct ProjectPrimitiveInfo
     AABB & right_aabb;
 };
 
+// SPATIAL_SPLITS searches for spatial splits during the build (SBVH). EARLY_SPLIT_CLIPPING subdivides the boxes
+// of large triangles before the build and runs only the object split search over the pieces - cheaper to build
+// and still close to SBVH quality on scenes with big triangles
+enum ReferenceSplitting : i32
+{
+    SPATIAL_SPLITS = 0,
+    EARLY_SPLIT_CLIPPING = 1,
+};
+
 struct ConstructBVHInfo
 {
     f32 ray_primitive_intersection_cost;
@@ -119,8 +307,23 @@ struct ConstructBVHInfo
     bool join_leaves;
     i32 max_triangles_in_leaves;
     i32 min_depth_for_join;
+    // store the leaf triangles quantized to 16 bits relative to the leaf - trades traversal speed for memory. Leaves
+    // whose encoding would not be smaller than their exact triangles stay exact, the whole tree when the encoded
+    // leaves do not save more than the per leaf entries cost
+    bool quantize_leaves;
+    // Instead of joining leaves during the build split down to single triangles and collapse subtrees bottom up
+    // wherever a leaf is cheaper by the SAH. The leaves hold at most max_triangles_in_leaves rounded up to a multiple
+    // of COLLAPSED_LEAF_WIDTH triangles and join_leaves and min_depth_for_join are ignored
+    bool collapse_leaves;
+    ReferenceSplitting reference_splitting;
+    // additional references the early split clipping may create relative to the triangle count
+    f32 early_split_budget;
 };
 
+// granularity of the collapsed leaf size cap - max_triangles_in_leaves is rounded up to a multiple of it
+// (and to one multiple at least), the leaves themselves may hold any number of triangles below the cap
+static constexpr u32 COLLAPSED_LEAF_WIDTH = 4;
+
 struct BVHStats
 {
     u32 triangle_count;
@@ -130,8 +333,122 @@ struct BVHStats
     f32 average_leaf_depth;
     f32 average_primitives_in_leaf;
     u32 max_tree_depth;
+    // sum of the costs of the chosen splits as estimated by the split search, not the SAH cost of the tree -
+    // use BVH::get_quality_metrics to compare trees
     f32 total_cost;
     f64 build_time;
+    // only filled when the leaves are quantized (1.0 if the tree stayed exact) - memory the traversal of the quantized tree reads (its own copy
+    // of the exact leaf triangles included) divided by the memory the exact tree and the scene triangles it reads
+    // take, and the time of tracing a fixed set of rays quantized divided by exact
+    f32 quantized_memory_ratio;
+    f32 quantized_traversal_slowdown;
+};
+
+// Quality of the finished tree computed over all of its nodes, comparable between builders
+struct BVHQualityMetrics
+{
+    // see BVH::get_sah_cost
+    f32 sah_cost;
+    // End-Point Overlap - area of the triangles inside the bounds of a node which its subtree does not reference,
+    // weighted by the intersection cost of the node (as in the SAH) and divided by the area of all triangles
+    f32 epo;
+    // area of the overlap of the children summed over the inner nodes and divided by the root area
+    f32 sibling_overlap;
+    // leaf references per triangle, above one only when spatial splits duplicated references
+    f32 duplication_factor;
+    // number of leaves indexed by their primitive count
+    std::vector<u32> leaf_size_histogram;
+    f64 compute_time;
+};
+
+// Plane of a spatial split recorded by the builder, node_index is the node which was split. The left child holds
+// the part of the duplicated references below the coordinate and the right child the part above it
+struct SpatialSplitPlane
+{
+    i32 node_index;
+    Axis axis;
+    f32 coordinate;
+};
+
+struct BVHRefitStats
+{
+    // SAH cost of the tree as it was built and after the refit - the degradation is their ratio and tells
+    // how much a full rebuild would win
+    f32 built_sah_cost;
+    f32 refitted_sah_cost;
+    f32 sah_degradation;
+    f64 refit_time;
+};
+
+struct UpdateBVHInfo
+{
+    // all of the triangles after the edit - same count and order as the triangles the BVH references
+    const IndexedTriangles & triangles;
+    // indices of the triangles which were changed by the edit, all of the other triangles must stay where they were
+    std::span<const u32> changed_primitives;
+    const ConstructBVHInfo & construct_info;
+    // a rebuilt subtree is escalated to a larger one while the SAH cost it adds makes the tree more expensive
+    // than before the edit by more than this factor
+    f32 max_sah_degradation = 1.1f;
+};
+
+struct BVHUpdateStats
+{
+    u32 rebuilt_primitive_count;
+    // number of disjoint subtrees the edit was rebuilt in
+    u32 rebuilt_subtree_count;
+    // number of times a rebuilt subtree was replaced by a larger one
+    u32 escalation_count;
+    bool full_rebuild;
+    f32 sah_degradation;
+    f64 update_time;
+};
+
+// Memory used by the BVH data traversal reads in bytes - the scene triangles and the build scratch are not included
+struct BVHMemoryFootprint
+{
+    size_t nodes;
+    size_t leaves;
+    size_t stackless_links;
+    size_t quantized_leaves;
+    // triangles the BVH holds itself instead of reading the scene ones - the exact leaf triangles of a quantized
+    // tree or the triangles of a mapped file
+    size_t triangles;
+
+    [[nodiscard]] inline auto get_total() const -> size_t
+    {
+        return nodes + leaves + stackless_links + quantized_leaves + triangles;
+    }
+};
+
+// Decision of the builder in a single node. Recorded for every node so that a build with different leaf joining
+// parameters can replay the decisions those parameters could not have changed instead of searching for them again
+struct BuildDecision
+{
+    // Axis::LAST when the node became a leaf
+    Axis axis;
+    SplitType type = SplitType::OBJECT;
+    std::variant<i32,f32> event;
+    f32 cost;
+    u32 primitive_count;
+    // whether ending the node in a joined leaf was an option
+    bool join_leaves;
+    // false when the split was the fallback after an ignored spatial split
+    bool replayable;
+};
+
+struct BuildSubtreeInfo
+{
+    const ConstructBVHInfo & construct_info;
+    BVHStats & stats;
+    u64 & leaf_depth_sum;
+    // the node must already have its bounding box, the span is at the end of the primitive AABBs
+    u32 node_idx;
+    NodeSpan node_span;
+    u32 depth;
+    // decisions of the previous build over the same triangles indexed by the previous node index, empty to search every node
+    std::span<const BVHNode> previous_nodes = {};
+    std::span<const BuildDecision> previous_decisions = {};
 };
 
 struct CreateLeafInfo
@@ -141,6 +458,73 @@ struct CreateLeafInfo
     NodeSpan node_span;
 };
 
+// Traversal statistics policies. The traversal kernel is templated on one of these so that both
+// the instrumented and the uninstrumented kernel live in the same binary and the choice between
+// them is made at runtime. NoTraversalStats compiles down to nothing in the uninstrumented kernel
+struct NoTraversalStats
+{
+    inline auto count_node_step() -> void {}
+    inline auto count_primitive_step() -> void {}
+};
+
+struct TraversalStats
+{
+    i32 node_steps = 0;
+    i32 primitive_steps = 0;
+
+    inline auto count_node_step() -> void { node_steps++; }
+    inline auto count_primitive_step() -> void { primitive_steps++; }
+    [[nodiscard]] inline auto get_traversal_steps() const -> i32 { return node_steps + primitive_steps; }
+};
+
+struct PacketTraversalInfo
+{
+    const RayPacket & packet;
+    // cull whole nodes using interval arithmetic on the packet bounds before testing individual rays
+    bool interval_culling;
+    // once fewer rays than this are active in a node the remaining rays finish the subtree one by one
+    u32 min_active_rays;
+};
+
+struct StreamTraversalInfo
+{
+    std::span<const Ray> rays;
+    // must be the same size as rays, receives the nearest hit for each ray
+    // rays which missed keep their maximum distance in Hit::distance
+    std::span<Hit> hits;
+    // optional maximum hit distance of each ray, rays are unbounded when this is empty
+    std::span<const f32> max_distances = {};
+    // stop traversing a ray as soon as it has any hit (used for occlusion queries)
+    bool any_hit = false;
+};
+
+struct InterleavedTraversalInfo
+{
+    std::span<const Ray> rays;
+    // must be the same size as rays, receives the nearest hit for each ray
+    std::span<Hit> hits;
+    // number of rays whose traversals are interleaved by a single thread
+    u32 interleaved_ray_count = 8;
+};
+
+enum struct BatchKernel
+{
+    // chosen per batch (or per thread chunk) based on its size and coherence
+    AUTO,
+    SINGLE_RAY,
+    PACKET,
+    STREAM,
+    INTERLEAVED,
+    STACKLESS,
+};
+
+struct BatchTraceInfo
+{
+    BatchKernel kernel = BatchKernel::AUTO;
+    // the batch is split into this many contiguous chunks each traced by its own thread
+    u32 thread_count = 1;
+};
+
 struct ClipAxisPlaneInfo
 {
     types::Polygon * curr_polygon;
@@ -150,17 +534,94 @@ struct ClipAxisPlaneInfo
     bool far;
 };
 
+struct MappedFile;
+
 struct BVH
 {
+    BVH() = default;
+    // the view of a copied BVH has to point to the vectors of the copy
+    BVH(const BVH & other);
+    auto operator=(const BVH & other) -> BVH &;
+    // moving the vectors keeps their storage so the view stays valid
+    BVH(BVH && other) noexcept = default;
+    auto operator=(BVH && other) noexcept -> BVH & = default;
+
     static auto project_primitive_into_bin_fast(const ProjectPrimitiveInfo & info) -> void;
     static auto clip_axis_plane(const ClipAxisPlaneInfo & info) -> void;
+    // area of the part of the triangle inside the box, the polygons are reused between the calls
+    static auto get_clipped_area(const Triangle & triangle, const AABB & box, std::array<types::Polygon, 2> & polygons) -> f64;
     static auto classify_point_axis_plane(const f32vec3 & point, Axis axis, bool far, f32 coord) -> PointClassification;
     // TODO(msakmary) this is non-static only for debugging purposes, make this static later
     /*static*/ auto project_primitive_into_bin_slow(const ProjectPrimitiveInfo & info) -> void;
-    [[nodiscard]] auto get_bvh_visualization_data() const -> std::vector<AABBGeometryInfo>;
+    [[nodiscard]] auto get_bvh_visualization_data() const -> std::vector<BVHVisualizationInfo>;
+    [[nodiscard]] auto get_memory_footprint() const -> BVHMemoryFootprint;
+    // bounds of the root node, empty bounds when nothing was built
+    [[nodiscard]] auto get_bounds() const -> AABB;
+    // SAH cost of the whole tree - areas of the nodes relative to the root weighted by the intersection costs
+    [[nodiscard]] auto get_sah_cost() const -> f32;
+    // traverses the tree once per triangle for the EPO, spread over the hardware threads
+    [[nodiscard]] auto get_quality_metrics() const -> BVHQualityMetrics;
 
-    auto construct_bvh_from_data(const std::vector<Triangle> & primitives, const ConstructBVHInfo & info) -> BVHStats;
+    // the BVH references the triangle positions and indices so they must outlive it and must not be reallocated.
+    // With quantized leaves the triangles are only read during the build, the tree keeps its own copy of the few
+    // the exact leaves need
+    auto construct_bvh_from_data(const IndexedTriangles & triangles, const ConstructBVHInfo & info) -> BVHStats;
+    // Same as construct_bvh_from_data but reuses the decisions recorded by the previous build when it was built from
+    // the same (unchanged) triangles and only the leaf joining parameters changed - the tree is only searched again
+    // below the nodes whose decision the new parameters could change, the result is identical to a full build
+    auto rebuild(const IndexedTriangles & triangles, const ConstructBVHInfo & info) -> BVHStats;
+    // Writes the finalised nodes, leaves and a copy of the referenced triangles into a versioned binary file
+    // laid out so that load_from_file can traverse it in place. Returns false if the file could not be written
+    auto save_to_file(const std::string & path, const BVHStats & stats) const -> bool;
+    // Memory maps a file written by save_to_file - no data is parsed or copied, the traversal runs directly on
+    // the mapping and uses the triangles stored in the file. Returns false if the file is missing, was written
+    // by a different version or with a different layout of the BVH structures. Every stored index is checked against
+    // the section it points into in one linear pass, so damaged files are rejected instead of traversed out of bounds.
+    // With verify_checksum the whole file is also hashed and rejected if it does not match the checksum stored at save time
+    auto load_from_file(const std::string & path, BVHStats & stats, bool verify_checksum = false) -> bool;
+    // Recomputes the bounds of all nodes bottom up after the triangles moved. The topology is kept so the triangle
+    // count and order must stay the same, the triangles replace the ones the BVH references and must outlive it.
+    // References duplicated by spatial splits are clipped to the split planes recorded by the builder - a BVH
+    // loaded from a file has no planes and bounds them conservatively by the whole triangle. A tree with quantized
+    // leaves keeps no exact data to refit and is rebuilt with the parameters it was built with instead
+    auto refit(const IndexedTriangles & triangles) -> BVHRefitStats;
+    // Partial rebuild after localized edits - the changed triangles are grouped by their subtree at a cut depth and
+    // each group rebuilds only the smallest subtree holding all of its references by the SBVH builder, the bounds
+    // of their ancestors are refitted. Once the escalated subtrees and the ones already rebuilt hold most of the
+    // references the whole tree is rebuilt instead. The triangles replace the ones the BVH references and must
+    // outlive it. A tree with quantized leaves is always rebuilt in full
+    auto update(const UpdateBVHInfo & info) -> BVHUpdateStats;
     [[nodiscard]] auto get_nearest_intersection(const Ray & ray) const -> Hit;
+    // instrumented version of the traversal - counts the traversal steps into the passed stats
+    [[nodiscard]] auto get_nearest_intersection(const Ray & ray, TraversalStats & stats) const -> Hit;
+    // replaces nearest_hit only by a hit nearer than nearest_hit.distance - lets the instanced BVH carry the
+    // nearest hit from one bottom level BVH to the next
+    auto update_nearest_intersection(const Ray & ray, Hit & nearest_hit) const -> void;
+    // traces all active rays of the packet together - hits of inactive lanes are left as misses
+    [[nodiscard]] auto get_nearest_intersections(const PacketTraversalInfo & info) const -> std::array<Hit, PACKET_SIZE>;
+    // depth first traversal of a whole batch of (possibly incoherent) rays at once - every node is visited once
+    // with all of the rays which reach it, amortizing node and primitive fetches over them
+    auto get_nearest_intersections(const StreamTraversalInfo & info) const -> void;
+    // Interleaves the traversals of several rays - after each visited node the ray prefetches the data of the
+    // next node it is going to visit and the next ray continues. This hides the memory latency of node
+    // fetches on scenes that don't fit into the cache
+    auto get_nearest_intersections(const InterleavedTraversalInfo & info) const -> void;
+    // Traversal over the StacklessNodeLinks of the nodes using parent and sibling links - produces the same hits as
+    // get_nearest_intersection while only keeping the current node and the direction it was entered from
+    [[nodiscard]] auto get_nearest_intersection_stackless(const Ray & ray) const -> Hit;
+    // returns true if the ray hits any primitive closer than max_distance
+    [[nodiscard]] auto is_occluded(const Ray & ray, f32 max_distance) const -> bool;
+
+    // Batch queries - entry points for tracing large amounts of rays from outside of the Raytracer.
+    // The kernel used is chosen by the BatchTraceInfo, spans must have the same size as rays
+    auto intersect(std::span<const Ray> rays, std::span<Hit> hits, const BatchTraceInfo & info = {}) const -> void;
+    // occlusion variant - occluded[i] is set to 1 if the ray i hits anything closer than max_distances[i]
+    // the packet, interleaved and stackless kernels have no occlusion variant, they are traced with the STREAM kernel instead
+    auto occluded(
+        std::span<const Ray> rays,
+        std::span<const f32> max_distances,
+        std::span<b32> occluded,
+        const BatchTraceInfo & info = {}) const -> void;
 
     private:
         using SplitPrimitives = std::pair<NodeSpan,NodeSpan>;
@@ -169,7 +630,84 @@ struct BVH
         auto spatial_best_split(const SpatialSplitInfo & info) -> BestSplitInfo;
         auto split_node(const SplitNodeInfo & info) -> SplitPrimitives;
         auto create_leaf(const CreateLeafInfo & info) -> void;
+        // splits the primitive AABBs with the largest area until the budget of additional references is spent
+        auto early_split_clipping(const IndexedTriangles & triangles, f32 budget) -> void;
+        auto construct_bvh(
+            const IndexedTriangles & triangles,
+            const ConstructBVHInfo & info,
+            std::span<const BVHNode> previous_nodes,
+            std::span<const BuildDecision> previous_decisions) -> BVHStats;
+        // runs the SBVH construction of the node and all of its descendants
+        auto build_subtree(const BuildSubtreeInfo & info) -> void;
+        auto build_stackless_links() -> void;
+        // collapses the subtrees whose triangles are cheaper to intersect in a single leaf, updates the leaf counts
+        // and depths in the stats and returns the new sum of the leaf depths
+        auto collapse_leaves(u32 max_leaf_size, BVHStats & stats) -> u64;
+        // encodes the leaves into the quantized leaf arrays, drops the exact data of the quantized leaves and fills
+        // the quantization stats
+        auto quantize_leaves(BVHStats & stats) -> void;
+        // compacts the triangles the leaf primitive indices reference into exact_leaf_positions and
+        // exact_leaf_indices and remaps the leaf primitive indices to them
+        auto compact_exact_leaf_triangles(const IndexedTriangles & triangles) -> void;
+        // ratio of the time tracing a fixed set of rays takes with the quantized and with the exact leaves
+        auto measure_quantized_traversal_slowdown() -> f32;
+        template<typename StatsPolicy>
+        auto get_nearest_intersection_impl(const Ray & ray, StatsPolicy & stats) const -> Hit;
+        // traverses the subtree rooted in the node whose bounding box is already known to be hit by the ray
+        template<typename StatsPolicy>
+        auto traverse_subtree(const Ray & ray, i32 subtree_root_idx, Hit & nearest_hit, StatsPolicy & stats) const -> void;
+        // points the view to the vectors filled by the builder
+        auto update_view(const IndexedTriangles & triangles) -> void;
+
+        // node order and reference clip regions shared by all refits of the same build
+        struct RefitData
+        {
+            // nodes sorted by depth, level_starts[d] is the first node of depth d in node_order
+            std::vector<i32> node_order;
+            std::vector<size_t> level_starts;
+            // one region per leaf primitive index, empty when the tree has no recorded spatial splits
+            std::vector<AABB> clip_regions;
+        };
+        auto prepare_refit() -> void;
+        // copies the data of a mapped BVH into the vectors so that it can be modified
+        auto copy_mapped_data(const IndexedTriangles & triangles) -> void;
+        // SAH cost of the tree when it was built or loaded, computed on the first use
+        auto get_built_sah_cost() -> f32;
+        // replaces the subtree of the node by a new SBVH build over the triangles it references
+        auto rebuild_subtree(u32 node_idx, u32 depth, const UpdateBVHInfo & info) -> u32;
+        // drops the nodes and leaves no longer reachable from the root - keeps the order of the remaining ones
+        // so parents still precede their children, returns the new index of every old node or -1
+        auto remove_unreachable_nodes() -> std::vector<i32>;
+
+        // only used during the construction
         std::vector<PrimitiveAABB> primitive_aabbs_global;
+        // finalised data of a BVH built in memory, empty when the BVH was loaded from a file
         std::vector<BVHNode> bvh_nodes;
         std::vector<BVHLeaf> bvh_leaves;
+        std::vector<u32> leaf_primitive_indices;
+        std::vector<StacklessNodeLinks> stackless_links;
+        std::vector<QuantizedLeaf> quantized_leaves;
+        std::vector<QuantizedVertex> quantized_vertices;
+        std::vector<u8> quantized_corners;
+        QuantizationGrid quantization_grid;
+        // triangles of the exact leaves of a quantized tree, the view reads these instead of the scene triangles
+        std::vector<f32vec3> exact_leaf_positions;
+        std::vector<u32> exact_leaf_indices;
+        // costs the tree was built with, BVH files store them with the rest of the build parameters
+        f32 ray_primitive_intersection_cost = 2.0f;
+        f32 ray_aabb_intersection_cost = 3.0f;
+        std::vector<SpatialSplitPlane> spatial_split_planes;
+        // one per node, cleared once the triangles change since the build
+        std::vector<BuildDecision> build_decisions;
+        // parameters of the last build - the ones the decisions were made with and a quantized tree is rebuilt with
+        // instead of being refitted
+        ConstructBVHInfo built_info = {};
+        // the triangles of the last build - the view of a quantized tree no longer points to them
+        IndexedTriangles built_triangles = {};
+        RefitData refit_data;
+        // negative until computed
+        f32 built_sah_cost = -1.0f;
+        // keeps the file alive while the view points into it, null when the BVH was built in memory
+        std::shared_ptr<const MappedFile> mapped_file;
+        BVHView view;
 };
\ No newline at end of file
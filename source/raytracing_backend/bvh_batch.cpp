@@ -0,0 +1,154 @@
+#include "bvh.hpp"
+#include "parallel_for.hpp"
+
+#include <algorithm>
+
+// Batches (or thread chunks) smaller than this are traced ray by ray, the setup cost
+// of the stream traversal is not worth it for them
+static constexpr size_t MIN_STREAM_BATCH_SIZE = 64;
+// Number of packets sampled from the start of a batch when estimating its coherence
+static constexpr size_t COHERENCE_SAMPLE_PACKETS = 64;
+
+static auto make_packet(std::span<const Ray> rays) -> RayPacket
+{
+    assert(rays.size() <= PACKET_SIZE);
+    RayPacket packet = {};
+    for(u32 lane = 0; lane < rays.size(); lane++)
+    {
+        packet.set_ray(lane, rays[lane]);
+    }
+    packet.compute_intervals();
+    return packet;
+}
+
+// A batch is considered coherent when the sampled groups of PACKET_SIZE consecutive rays share 
+// their origin and the signs of their directions - this is the case for primary and shadow rays 
+// generated in pixel order. Such packets can be culled by interval arithmetic and rarely diverge
+static auto is_batch_coherent(std::span<const Ray> rays) -> bool
+{
+    const size_t sampled_packets = glm::min(COHERENCE_SAMPLE_PACKETS, rays.size() / PACKET_SIZE);
+    if(sampled_packets == 0) { return false; }
+
+    size_t coherent_packets = 0;
+    for(size_t i = 0; i < sampled_packets; i++)
+    {
+        const auto packet = make_packet(rays.subspan(i * PACKET_SIZE, PACKET_SIZE));
+        const f32vec3 origin_extent = packet.start_max - packet.start_min;
+        if(packet.intervals_valid && glm::all(glm::lessThan(origin_extent, f32vec3(1e-4f))))
+        {
+            coherent_packets++;
+        }
+    }
+    return f32(coherent_packets) >= 0.9f * f32(sampled_packets);
+}
+
+static auto select_nearest_kernel(std::span<const Ray> rays) -> BatchKernel
+{
+    if(rays.size() < MIN_STREAM_BATCH_SIZE) { return BatchKernel::SINGLE_RAY; }
+    if(is_batch_coherent(rays)) { return BatchKernel::PACKET; }
+    return BatchKernel::STREAM;
+}
+
+auto BVH::intersect(std::span<const Ray> rays, std::span<Hit> hits, const BatchTraceInfo & info) const -> void
+{
+    assert(rays.size() == hits.size());
+    run_in_chunks(rays.size(), info.thread_count, PACKET_SIZE, [&](size_t start, size_t size)
+    {
+        const auto chunk_rays = rays.subspan(start, size);
+        const auto chunk_hits = hits.subspan(start, size);
+        const BatchKernel kernel = info.kernel == BatchKernel::AUTO ? select_nearest_kernel(chunk_rays) : info.kernel;
+
+        switch(kernel)
+        {
+            case BatchKernel::PACKET:
+            {
+                for(size_t offset = 0; offset < size; offset += PACKET_SIZE)
+                {
+                    const size_t packet_size = glm::min(size_t(PACKET_SIZE), size - offset);
+                    const auto packet = make_packet(chunk_rays.subspan(offset, packet_size));
+                    const auto packet_hits = get_nearest_intersections({
+                        .packet = packet,
+                        .interval_culling = true,
+                        .min_active_rays = PACKET_SIZE / 4
+                    });
+                    std::copy_n(packet_hits.begin(), packet_size, chunk_hits.begin() + offset);
+                }
+                break;
+            }
+            case BatchKernel::STREAM:
+            {
+                get_nearest_intersections(StreamTraversalInfo{
+                    .rays = chunk_rays,
+                    .hits = chunk_hits
+                });
+                break;
+            }
+            case BatchKernel::INTERLEAVED:
+            {
+                get_nearest_intersections(InterleavedTraversalInfo{
+                    .rays = chunk_rays,
+                    .hits = chunk_hits
+                });
+                break;
+            }
+            case BatchKernel::STACKLESS:
+            {
+                for(size_t i = 0; i < size; i++)
+                {
+                    chunk_hits[i] = get_nearest_intersection_stackless(chunk_rays[i]);
+                }
+                break;
+            }
+            case BatchKernel::AUTO:
+            case BatchKernel::SINGLE_RAY:
+            {
+                for(size_t i = 0; i < size; i++)
+                {
+                    chunk_hits[i] = get_nearest_intersection(chunk_rays[i]);
+                }
+                break;
+            }
+        }
+    });
+}
+
+auto BVH::occluded(
+    std::span<const Ray> rays,
+    std::span<const f32> max_distances,
+    std::span<b32> occluded,
+    const BatchTraceInfo & info) const -> void
+{
+    assert(rays.size() == max_distances.size() && rays.size() == occluded.size());
+    run_in_chunks(rays.size(), info.thread_count, PACKET_SIZE, [&](size_t start, size_t size)
+    {
+        const auto chunk_rays = rays.subspan(start, size);
+        const auto chunk_max_distances = max_distances.subspan(start, size);
+        const auto chunk_occluded = occluded.subspan(start, size);
+        BatchKernel kernel = info.kernel;
+        if(kernel == BatchKernel::AUTO)
+        {
+            kernel = size < MIN_STREAM_BATCH_SIZE ? BatchKernel::SINGLE_RAY : BatchKernel::STREAM;
+        }
+
+        if(kernel == BatchKernel::SINGLE_RAY)
+        {
+            for(size_t i = 0; i < size; i++)
+            {
+                chunk_occluded[i] = static_cast<b32>(is_occluded(chunk_rays[i], chunk_max_distances[i]));
+            }
+            return;
+        }
+
+        std::vector<Hit> hits(size);
+        get_nearest_intersections(StreamTraversalInfo{
+            .rays = chunk_rays,
+            .hits = hits,
+            .max_distances = chunk_max_distances,
+            .any_hit = true
+        });
+        for(size_t i = 0; i < size; i++)
+        {
+            chunk_occluded[i] = static_cast<b32>(hits.at(i).hit);
+        }
+    });
+}
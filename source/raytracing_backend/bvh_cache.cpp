@@ -0,0 +1,126 @@
+#include "bvh_cache.hpp"
+#include "hash.hpp"
+
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+// bump whenever the builder changes the trees it produces so that stale entries are no longer hit
+static constexpr u32 BVH_CACHE_KEY_VERSION = 3;
+
+struct BVHCacheEntry
+{
+    std::filesystem::path path;
+    u64 size;
+    std::filesystem::file_time_type last_use;
+};
+
+BVHCache::BVHCache(const BVHCacheInfo & info) : info{info} {}
+
+auto BVHCache::get_key(const IndexedTriangles & triangles, const ConstructBVHInfo & info) const -> std::string
+{
+    // two independently seeded hashes make accidental collisions of the 128 bit key practically impossible
+    Hasher hashers[2] = {Hasher(0), Hasher(0x5BD1E995ull)};
+    for(auto & hasher : hashers)
+    {
+        hasher.add(BVH_CACHE_KEY_VERSION);
+        hasher.add(u64(triangles.positions.size()));
+        hasher.add(triangles.positions);
+        hasher.add(u64(triangles.indices.size()));
+        hasher.add(triangles.indices);
+        // the fields are hashed one by one so that the struct padding never leaks into the key
+        hasher.add(info.ray_primitive_intersection_cost);
+        hasher.add(info.ray_aabb_intersection_cost);
+        hasher.add(info.spatial_bin_count);
+        hasher.add(info.spatial_alpha);
+        hasher.add(info.join_leaves);
+        hasher.add(info.max_triangles_in_leaves);
+        hasher.add(info.min_depth_for_join);
+        hasher.add(info.quantize_leaves);
+        hasher.add(info.collapse_leaves);
+        hasher.add(info.reference_splitting);
+        hasher.add(info.early_split_budget);
+    }
+
+    char key[33];
+    std::snprintf(key, sizeof(key), "%016llx%016llx",
+        static_cast<unsigned long long>(hashers[0].get()),
+        static_cast<unsigned long long>(hashers[1].get()));
+    return std::string(key);
+}
+
+auto BVHCache::get_entry_path(const std::string & key) const -> std::filesystem::path
+{
+    return std::filesystem::path(info.directory) / (key + ".bvh");
+}
+
+auto BVHCache::load(const std::string & key, BVH & bvh, BVHStats & stats) -> bool
+{
+    const auto path = get_entry_path(key);
+    std::error_code error;
+    if(!std::filesystem::is_regular_file(path, error)) { return false; }
+
+    if(!bvh.load_from_file(path.string(), stats, true))
+    {
+        DEBUG_OUT("[BVHCache::load()] removing invalid cache entry " + path.string());
+        std::filesystem::remove(path, error);
+        return false;
+    }
+    // the modification time doubles as the last use time for the eviction
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+auto BVHCache::store(const std::string & key, const BVH & bvh, const BVHStats & stats) -> void
+{
+    std::error_code error;
+    std::filesystem::create_directories(info.directory, error);
+
+    // write into a temporary file first so that an interrupted write never leaves a truncated entry behind
+    const auto path = get_entry_path(key);
+    auto temporary_path = path;
+    temporary_path += ".tmp";
+    if(!bvh.save_to_file(temporary_path.string(), stats))
+    {
+        DEBUG_OUT("[BVHCache::store()] could not write cache entry " + temporary_path.string());
+        std::filesystem::remove(temporary_path, error);
+        return;
+    }
+    std::filesystem::rename(temporary_path, path, error);
+    if(error)
+    {
+        DEBUG_OUT("[BVHCache::store()] could not move cache entry to " + path.string());
+        std::filesystem::remove(temporary_path, error);
+        return;
+    }
+    evict(path);
+}
+
+auto BVHCache::evict(const std::filesystem::path & keep) -> void
+{
+    std::error_code error;
+    std::vector<BVHCacheEntry> entries;
+    u64 total_size = 0;
+    for(const auto & directory_entry : std::filesystem::directory_iterator(info.directory, error))
+    {
+        if(!directory_entry.is_regular_file(error) || directory_entry.path().extension() != ".bvh") { continue; }
+        const BVHCacheEntry entry = {
+            .path = directory_entry.path(),
+            .size = directory_entry.file_size(error),
+            .last_use = directory_entry.last_write_time(error)
+        };
+        total_size += entry.size;
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](const BVHCacheEntry & first, const BVHCacheEntry & second) { return first.last_use < second.last_use; });
+    for(const auto & entry : entries)
+    {
+        if(total_size <= info.max_size_bytes) { break; }
+        // the entry that was just written is kept even if it alone exceeds the limit
+        if(entry.path == keep) { continue; }
+        // NOTE(msakmary) entries mapped by another BVH can not be removed on windows, they are retried next time
+        if(std::filesystem::remove(entry.path, error)) { total_size -= entry.size; }
+    }
+}
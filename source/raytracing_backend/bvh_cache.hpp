@@ -0,0 +1,37 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <filesystem>
+
+#include "../types.hpp"
+#include "triangle.hpp"
+#include "bvh.hpp"
+
+struct BVHCacheInfo
+{
+    // created on first use if it does not exist
+    std::string directory;
+    // least recently used entries are evicted once the .bvh files in the directory exceed this size
+    u64 max_size_bytes;
+};
+
+// On disk cache of built BVHs. Entries are BVH files named by a hash of the triangle positions and indices and of all
+// ConstructBVHInfo fields so any change of the geometry or of the build parameters misses the cache
+struct BVHCache
+{
+    explicit BVHCache(const BVHCacheInfo & info);
+
+    [[nodiscard]] auto get_key(const IndexedTriangles & triangles, const ConstructBVHInfo & info) const -> std::string;
+    // Maps the cached BVH into bvh and marks the entry as recently used. Entries that fail the checksum
+    // are removed. Returns false on a miss
+    auto load(const std::string & key, BVH & bvh, BVHStats & stats) -> bool;
+    // Writes the BVH into the cache and evicts the least recently used entries over the size limit
+    auto store(const std::string & key, const BVH & bvh, const BVHStats & stats) -> void;
+
+    private:
+        BVHCacheInfo info;
+
+        [[nodiscard]] auto get_entry_path(const std::string & key) const -> std::filesystem::path;
+        auto evict(const std::filesystem::path & keep) -> void;
+};
@@ -0,0 +1,123 @@
+#include "bvh_calibration.hpp"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+// NOTE(msakmary) results of the timed kernels are accumulated into this so that the compiler can't remove the loops
+static volatile u64 calibration_sink = 0;
+// offsets of the tried cost ratios from the microbenchmarked one in powers of two, the second round refines the best one
+static constexpr f32 FIT_COARSE_STEPS[] = {-1.0f, -0.5f, 0.5f, 1.0f};
+static constexpr f32 FIT_FINE_STEPS[] = {-0.25f, 0.25f};
+static constexpr u32 FIT_TRACE_REPETITIONS = 3;
+
+template<typename Function>
+static auto median_time_per_element(u32 element_count, u32 repetitions, Function && function) -> f64
+{
+    std::vector<f64> samples;
+    // the first pass warms up the caches and is not measured
+    for(u32 repetition = 0; repetition <= repetitions; repetition++)
+    {
+        u64 accumulated = 0;
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for(u32 element = 0; element < element_count; element++) { accumulated += function(element); }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        calibration_sink = calibration_sink + accumulated;
+        std::chrono::duration<double, std::nano> ns_double = end_time - start_time;
+        if(repetition > 0) { samples.push_back(ns_double.count() / f64(element_count)); }
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples.at(samples.size() / 2);
+}
+
+auto calibrate_sah_costs(const CalibrateSAHCostsInfo & info) -> SAHCostCalibration
+{
+    // synthetic data laid out the way the traversal reads it - triangles are gathered through the index buffer
+    // and every ray is aimed close to the centroid of its triangle so that roughly half of the tests hit
+    const u32 sample_count = glm::max(info.sample_count, 1u);
+    std::mt19937 generator(info.seed);
+    std::uniform_real_distribution<f32> coord(-1.0f, 1.0f);
+    auto random_point = [&]() -> f32vec3 { return {coord(generator), coord(generator), coord(generator)}; };
+    std::vector<f32vec3> positions;
+    std::vector<u32> indices;
+    std::vector<AABB> boxes;
+    std::vector<Ray> rays;
+    positions.reserve(sample_count * 3);
+    indices.reserve(sample_count * 3);
+    boxes.reserve(sample_count);
+    rays.reserve(sample_count);
+    for(u32 i = 0; i < sample_count; i++)
+    {
+        const f32vec3 center = random_point();
+        for(u32 vertex = 0; vertex < 3; vertex++)
+        {
+            indices.push_back(u32(positions.size()));
+            positions.push_back(center + random_point() * 0.1f);
+        }
+        const Triangle triangle = Triangle{.v0 = positions.at(i * 3), .v1 = positions.at(i * 3 + 1), .v2 = positions.at(i * 3 + 2)};
+        boxes.emplace_back(triangle);
+        const f32vec3 start = glm::normalize(random_point()) * 3.0f;
+        rays.emplace_back(start, center + random_point() * 0.05f - start);
+    }
+    const IndexedTriangles triangles = {.positions = positions, .indices = indices};
+
+    SAHCostCalibration calibration = {.info = info.base_info};
+    calibration.ray_aabb_test_ns = median_time_per_element(sample_count, info.repetitions, [&](u32 element) -> u64
+    {
+        return u64(boxes[element].ray_box_intersection(rays[element]).hit);
+    });
+    calibration.ray_triangle_test_ns = median_time_per_element(sample_count, info.repetitions, [&](u32 element) -> u64
+    {
+        return u64(triangles.get_triangle(element).intersect_ray(rays[element]).hit);
+    });
+    const f32 measured_ratio = f32(calibration.ray_triangle_test_ns / glm::max(calibration.ray_aabb_test_ns, 1e-3));
+    calibration.info.ray_primitive_intersection_cost = info.base_info.ray_aabb_intersection_cost * measured_ratio;
+    if(info.triangles.empty() || info.rays.empty()) { return calibration; }
+
+    // the fit needs only the traversal speed, the leaves are quantized after it if the base info asks for it
+    ConstructBVHInfo candidate_info = info.base_info;
+    candidate_info.quantize_leaves = false;
+    std::vector<Hit> hits(info.rays.size());
+    auto measure_ratio = [&](f32 ratio) -> f64
+    {
+        candidate_info.ray_primitive_intersection_cost = info.base_info.ray_aabb_intersection_cost * ratio;
+        BVH bvh;
+        bvh.construct_bvh_from_data(info.triangles, candidate_info);
+        calibration.fit_build_count++;
+        std::vector<f64> samples;
+        for(u32 repetition = 0; repetition < FIT_TRACE_REPETITIONS; repetition++)
+        {
+            auto start_time = std::chrono::high_resolution_clock::now();
+            bvh.intersect(info.rays, hits, info.trace_info);
+            auto end_time = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+            samples.push_back(ms_double.count());
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples.at(samples.size() / 2);
+    };
+
+    calibration.microbenchmarked_trace_time = measure_ratio(measured_ratio);
+    f32 best_ratio = measured_ratio;
+    f64 best_time = calibration.microbenchmarked_trace_time;
+    auto try_steps = [&](std::span<const f32> steps, f32 center_ratio)
+    {
+        for(const f32 step : steps)
+        {
+            const f32 ratio = center_ratio * std::exp2(step);
+            const f64 time = measure_ratio(ratio);
+            if(time < best_time)
+            {
+                best_time = time;
+                best_ratio = ratio;
+            }
+        }
+    };
+    try_steps(FIT_COARSE_STEPS, measured_ratio);
+    try_steps(FIT_FINE_STEPS, best_ratio);
+
+    calibration.fitted_trace_time = best_time;
+    calibration.info.ray_primitive_intersection_cost = info.base_info.ray_aabb_intersection_cost * best_ratio;
+    return calibration;
+}
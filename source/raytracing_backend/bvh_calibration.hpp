@@ -0,0 +1,39 @@
+#pragma once
+
+#include <span>
+
+#include "../types.hpp"
+#include "triangle.hpp"
+#include "bvh.hpp"
+
+struct CalibrateSAHCostsInfo
+{
+    // every build parameter besides the two intersection costs is kept from the base info
+    const ConstructBVHInfo & base_info;
+    // the kernels are timed on this many seeded synthetic triangles and boxes
+    u32 sample_count = 1u << 16u;
+    u32 repetitions = 9;
+    u32 seed = 1337;
+    // Optional fit - when both are set cost ratios around the microbenchmarked one are tried by building the BVH
+    // over the triangles and timing the rays traced through it, the ratio with the fastest trace wins
+    IndexedTriangles triangles = {};
+    std::span<const Ray> rays = {};
+    BatchTraceInfo trace_info = {};
+};
+
+struct SAHCostCalibration
+{
+    ConstructBVHInfo info;
+    f64 ray_aabb_test_ns;
+    f64 ray_triangle_test_ns;
+    // median trace time of the rays through the BVH built with the microbenchmarked and with the fitted costs,
+    // both are zero when no fit was requested
+    f64 microbenchmarked_trace_time;
+    f64 fitted_trace_time;
+    u32 fit_build_count;
+};
+
+// Derives the SAH intersection costs from the speed of the ray-box and ray-triangle kernels on this machine. The SAH
+// decisions only depend on the ratio of the two costs so the ray-AABB cost of the base info is kept and the
+// ray-triangle cost is set to it scaled by the measured ratio
+auto calibrate_sah_costs(const CalibrateSAHCostsInfo & info) -> SAHCostCalibration;
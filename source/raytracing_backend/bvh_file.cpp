@@ -0,0 +1,303 @@
+#include "bvh.hpp"
+#include "mapped_file.hpp"
+#include "hash.hpp"
+
+#include <fstream>
+#include <cstring>
+
+// BVH file layout:
+//      BVHFileHeader
+//      sections - nodes, leaves, leaf primitive indices, stackless links, triangle positions, triangle indices
+//                 and the quantized leaves, vertices and corners (empty unless the leaves were quantized)
+// With quantized leaves only the triangles the exact leaves reference are stored, compacted into their own
+// positions and indices
+// Every section starts at an offset aligned to BVH_FILE_SECTION_ALIGNMENT so that the mapped file can be
+// accessed directly through typed spans. The structures are stored in the native layout of the machine,
+// the header stores their sizes and the loader rejects files written with a different layout
+static constexpr char BVH_FILE_MAGIC[8] = {'S', 'B', 'V', 'H', 'T', 'R', 'E', 'E'};
+static constexpr u32 BVH_FILE_VERSION = 6;
+static constexpr u64 BVH_FILE_SECTION_ALIGNMENT = 64;
+// BVHNode contains the spatial split flag only when compiled with VISUALIZE_SPATIAL_SPLITS
+static constexpr u32 BVH_FILE_FLAG_SPATIAL_VISUALIZATION = 1u << 0u;
+
+struct BVHFileSection
+{
+    u64 offset;
+    u64 count;
+};
+
+struct BVHFileHeader
+{
+    char magic[8];
+    u32 version;
+    u32 flags;
+    u32 node_size;
+    u32 leaf_size;
+    u32 stackless_links_size;
+    u32 stats_size;
+    u32 construct_info_size;
+    u64 file_size;
+    // hash of the contents of all sections
+    u64 checksum;
+    BVHStats stats;
+    // lets a quantized BVH, which keeps no exact data to refit, rebuild itself with the same parameters
+    ConstructBVHInfo construct_info;
+    QuantizationGrid quantization_grid;
+    BVHFileSection nodes;
+    BVHFileSection leaves;
+    BVHFileSection leaf_primitive_indices;
+    BVHFileSection stackless_links;
+    BVHFileSection positions;
+    BVHFileSection indices;
+    BVHFileSection quantized_leaves;
+    BVHFileSection quantized_vertices;
+    BVHFileSection quantized_corners;
+};
+
+static auto get_bvh_file_flags() -> u32
+{
+#ifdef VISUALIZE_SPATIAL_SPLITS
+    return BVH_FILE_FLAG_SPATIAL_VISUALIZATION;
+#else
+    return 0u;
+#endif
+}
+
+static auto compute_checksum(const BVHView & view) -> u64
+{
+    Hasher hasher;
+    hasher.add(view.nodes);
+    hasher.add(view.leaves);
+    hasher.add(view.leaf_primitive_indices);
+    hasher.add(view.stackless_links);
+    hasher.add(view.triangles.positions);
+    hasher.add(view.triangles.indices);
+    hasher.add(view.quantized_leaves);
+    hasher.add(view.quantized_vertices);
+    hasher.add(view.quantized_corners);
+    hasher.add(view.quantization_grid);
+    return hasher.get();
+}
+
+// The traversal follows the indices stored in the file without any bounds checks so every one of them is checked
+// once on load - children must lie behind their parent which also rules out cycles, leaves must reference ranges
+// inside of the index arrays and the stackless links must agree with the children of the parent
+static auto validate_indices(const BVHView & view) -> bool
+{
+    const auto is_valid_child = [&](i32 node_idx, i32 child_idx, size_t node_count)
+    {
+        return child_idx > node_idx && static_cast<size_t>(child_idx) < node_count;
+    };
+    const auto is_valid_node = [&](i32 node_idx, i32 left_index, i32 right_index, size_t node_count)
+    {
+        if(left_index == -1) { return right_index >= 0 && static_cast<size_t>(right_index) < view.leaves.size(); }
+        return is_valid_child(node_idx, left_index, node_count) && is_valid_child(node_idx, right_index, node_count);
+    };
+
+    for(size_t node_idx = 0; node_idx < view.nodes.size(); node_idx++)
+    {
+        const auto & node = view.nodes[node_idx];
+        if(!is_valid_node(i32(node_idx), node.left_index, node.right_index, view.nodes.size())) { return false; }
+    }
+
+    if(!view.stackless_links.empty() && view.stackless_links.size() != view.nodes.size()) { return false; }
+    for(size_t node_idx = 0; node_idx < view.stackless_links.size(); node_idx++)
+    {
+        const auto & links = view.stackless_links[node_idx];
+        if(links.split_axis < Axis::X || links.split_axis >= Axis::LAST) { return false; }
+        if(node_idx == 0)
+        {
+            if(links.parent_index != -1 || links.sibling_index != -1) { return false; }
+            continue;
+        }
+        if(links.parent_index < 0 || links.parent_index >= i32(node_idx)) { return false; }
+        const auto & parent = view.nodes[links.parent_index];
+        const bool is_left = parent.left_index == i32(node_idx) && parent.right_index == links.sibling_index;
+        const bool is_right = parent.right_index == i32(node_idx) && parent.left_index == links.sibling_index;
+        if(!is_left && !is_right) { return false; }
+    }
+
+    const size_t triangle_count = view.triangles.size();
+    if(view.triangles.indices.size() % 3 != 0) { return false; }
+    for(const u32 index : view.triangles.indices)
+    {
+        if(index >= view.triangles.positions.size()) { return false; }
+    }
+    for(const u32 primitive_index : view.leaf_primitive_indices)
+    {
+        if(primitive_index >= triangle_count) { return false; }
+    }
+
+    for(size_t leaf_idx = 0; leaf_idx < view.leaves.size(); leaf_idx++)
+    {
+        const auto & leaf = view.leaves[leaf_idx];
+        const bool quantized = !view.quantized_leaves.empty() && view.quantized_leaves[leaf_idx].first_corner != QUANTIZED_LEAF_EXACT;
+        // quantized leaves keep no primitive indices
+        if(!quantized && u64(leaf.first_primitive) + leaf.primitive_count > view.leaf_primitive_indices.size()) { return false; }
+        if(!quantized) { continue; }
+
+        const auto & quantized_leaf = view.quantized_leaves[leaf_idx];
+        const u64 corner_count = u64(leaf.primitive_count) * 3;
+        if(u64(quantized_leaf.first_corner) + corner_count > view.quantized_corners.size()) { return false; }
+        for(u64 corner = 0; corner < corner_count; corner++)
+        {
+            const u64 vertex_index = u64(quantized_leaf.first_vertex) + view.quantized_corners[quantized_leaf.first_corner + corner];
+            if(vertex_index >= view.quantized_vertices.size()) { return false; }
+        }
+    }
+    return true;
+}
+
+static auto align_offset(u64 offset) -> u64
+{
+    return (offset + BVH_FILE_SECTION_ALIGNMENT - 1) / BVH_FILE_SECTION_ALIGNMENT * BVH_FILE_SECTION_ALIGNMENT;
+}
+
+template<typename T>
+static auto get_section_span(const MappedFile & file, const BVHFileSection & section, bool & valid) -> std::span<const T>
+{
+    return file.get_span<T>(section.offset, section.count, valid);
+}
+
+auto BVH::save_to_file(const std::string & path, const BVHStats & stats) const -> bool
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file.is_open()) { return false; }
+
+    BVHFileHeader header = {};
+    std::memcpy(header.magic, BVH_FILE_MAGIC, sizeof(BVH_FILE_MAGIC));
+    header.version = BVH_FILE_VERSION;
+    header.flags = get_bvh_file_flags();
+    header.node_size = sizeof(BVHNode);
+    header.leaf_size = sizeof(BVHLeaf);
+    header.stackless_links_size = sizeof(StacklessNodeLinks);
+    header.stats_size = sizeof(BVHStats);
+    header.construct_info_size = sizeof(ConstructBVHInfo);
+    header.stats = stats;
+    header.construct_info = built_info;
+    header.quantization_grid = view.quantization_grid;
+    header.checksum = compute_checksum(view);
+
+    // lay out the sections behind the header
+    u64 offset = align_offset(sizeof(BVHFileHeader));
+    auto place_section = [&](BVHFileSection & section, size_t count, size_t element_size)
+    {
+        section = BVHFileSection{.offset = offset, .count = count};
+        offset = align_offset(offset + count * element_size);
+    };
+    place_section(header.nodes, view.nodes.size(), sizeof(BVHNode));
+    place_section(header.leaves, view.leaves.size(), sizeof(BVHLeaf));
+    place_section(header.leaf_primitive_indices, view.leaf_primitive_indices.size(), sizeof(u32));
+    place_section(header.stackless_links, view.stackless_links.size(), sizeof(StacklessNodeLinks));
+    place_section(header.positions, view.triangles.positions.size(), sizeof(f32vec3));
+    place_section(header.indices, view.triangles.indices.size(), sizeof(u32));
+    place_section(header.quantized_leaves, view.quantized_leaves.size(), sizeof(QuantizedLeaf));
+    place_section(header.quantized_vertices, view.quantized_vertices.size(), sizeof(QuantizedVertex));
+    place_section(header.quantized_corners, view.quantized_corners.size(), sizeof(u8));
+    header.file_size = offset;
+
+    u64 written = 0;
+    auto write_section = [&](const BVHFileSection & section, const void * data, size_t size_bytes)
+    {
+        const std::vector<char> padding(section.offset - written, 0);
+        file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size_bytes));
+        written = section.offset + size_bytes;
+    };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(BVHFileHeader));
+    written = sizeof(BVHFileHeader);
+    write_section(header.nodes, view.nodes.data(), view.nodes.size_bytes());
+    write_section(header.leaves, view.leaves.data(), view.leaves.size_bytes());
+    write_section(header.leaf_primitive_indices, view.leaf_primitive_indices.data(), view.leaf_primitive_indices.size_bytes());
+    write_section(header.stackless_links, view.stackless_links.data(), view.stackless_links.size_bytes());
+    write_section(header.positions, view.triangles.positions.data(), view.triangles.positions.size_bytes());
+    write_section(header.indices, view.triangles.indices.data(), view.triangles.indices.size_bytes());
+    write_section(header.quantized_leaves, view.quantized_leaves.data(), view.quantized_leaves.size_bytes());
+    write_section(header.quantized_vertices, view.quantized_vertices.data(), view.quantized_vertices.size_bytes());
+    write_section(header.quantized_corners, view.quantized_corners.data(), view.quantized_corners.size_bytes());
+    // pad the file to its full size so that the last section can be validated against it
+    const std::vector<char> padding(header.file_size - written, 0);
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    return file.good();
+}
+
+auto BVH::load_from_file(const std::string & path, BVHStats & stats, bool verify_checksum) -> bool
+{
+    auto file = std::make_shared<const MappedFile>(path);
+    if(!file->is_valid() || file->get_size() < sizeof(BVHFileHeader))
+    {
+        DEBUG_OUT("[BVH::load_from_file()] could not map " + path);
+        return false;
+    }
+
+    BVHFileHeader header;
+    std::memcpy(&header, file->get_data(), sizeof(BVHFileHeader));
+    const bool compatible =
+        std::memcmp(header.magic, BVH_FILE_MAGIC, sizeof(BVH_FILE_MAGIC)) == 0 &&
+        header.version == BVH_FILE_VERSION &&
+        header.flags == get_bvh_file_flags() &&
+        header.node_size == sizeof(BVHNode) &&
+        header.leaf_size == sizeof(BVHLeaf) &&
+        header.stackless_links_size == sizeof(StacklessNodeLinks) &&
+        header.stats_size == sizeof(BVHStats) &&
+        header.construct_info_size == sizeof(ConstructBVHInfo) &&
+        header.file_size == file->get_size();
+    if(!compatible)
+    {
+        DEBUG_OUT("[BVH::load_from_file()] " + path + " is not a BVH file compatible with this build");
+        return false;
+    }
+
+    bool valid = true;
+    BVHView file_view = {
+        .nodes = get_section_span<BVHNode>(*file, header.nodes, valid),
+        .leaves = get_section_span<BVHLeaf>(*file, header.leaves, valid),
+        .leaf_primitive_indices = get_section_span<u32>(*file, header.leaf_primitive_indices, valid),
+        .stackless_links = get_section_span<StacklessNodeLinks>(*file, header.stackless_links, valid),
+        .triangles = IndexedTriangles{
+            .positions = get_section_span<f32vec3>(*file, header.positions, valid),
+            .indices = get_section_span<u32>(*file, header.indices, valid)
+        },
+        .quantized_leaves = get_section_span<QuantizedLeaf>(*file, header.quantized_leaves, valid),
+        .quantized_vertices = get_section_span<QuantizedVertex>(*file, header.quantized_vertices, valid),
+        .quantized_corners = get_section_span<u8>(*file, header.quantized_corners, valid),
+        .quantization_grid = header.quantization_grid
+    };
+    // every leaf needs its quantized entry, otherwise the leaves are exact
+    valid = valid && (file_view.quantized_leaves.empty() || file_view.quantized_leaves.size() == file_view.leaves.size());
+    if(!valid)
+    {
+        DEBUG_OUT("[BVH::load_from_file()] " + path + " has sections outside of the file");
+        return false;
+    }
+    if(!validate_indices(file_view))
+    {
+        DEBUG_OUT("[BVH::load_from_file()] " + path + " is corrupted - index out of range");
+        return false;
+    }
+    if(verify_checksum && compute_checksum(file_view) != header.checksum)
+    {
+        DEBUG_OUT("[BVH::load_from_file()] " + path + " is corrupted - checksum mismatch");
+        return false;
+    }
+
+    primitive_aabbs_global.clear();
+    bvh_nodes.clear();
+    bvh_leaves.clear();
+    leaf_primitive_indices.clear();
+    stackless_links.clear();
+    quantized_leaves.clear();
+    quantized_vertices.clear();
+    quantized_corners.clear();
+    spatial_split_planes.clear();
+    build_decisions.clear();
+    built_info = header.construct_info;
+    refit_data = RefitData{};
+    built_sah_cost = -1.0f;
+    ray_primitive_intersection_cost = header.construct_info.ray_primitive_intersection_cost;
+    ray_aabb_intersection_cost = header.construct_info.ray_aabb_intersection_cost;
+    mapped_file = std::move(file);
+    view = file_view;
+    stats = header.stats;
+    return true;
+}
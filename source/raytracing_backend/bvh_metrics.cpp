@@ -0,0 +1,215 @@
+#include "bvh.hpp"
+#include "parallel_for.hpp"
+
+#include <map>
+#include <array>
+#include <chrono>
+#include <algorithm>
+
+// the EPO of fewer triangles than this is computed on the calling thread
+static constexpr size_t METRICS_PARALLEL_MIN_TRIANGLES = 1024;
+
+auto BVH::get_quality_metrics() const -> BVHQualityMetrics
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+    BVHQualityMetrics metrics = BVHQualityMetrics{
+        .sah_cost = get_sah_cost(),
+        .epo = 0.0f,
+        .sibling_overlap = 0.0f,
+        .duplication_factor = 0.0f,
+        .leaf_size_histogram = {},
+        .compute_time = 0.0
+    };
+    if(view.nodes.empty()) { return metrics; }
+    const f64 root_area = view.nodes[0].bounding_box.get_area();
+
+    // Triangle of every leaf reference - the exact triangles keep their index and the decoded triangles of quantized
+    // leaves follow them. All leaves referencing the same triangle decode it to the same grid cells which tell the
+    // decoded triangles apart, the metrics of a quantized tree describe the geometry it traces
+    const bool quantized = !view.quantized_leaves.empty();
+    std::vector<u32> leaf_first_reference(view.leaves.size() + 1, 0);
+    for(size_t leaf_idx = 0; leaf_idx < view.leaves.size(); leaf_idx++)
+    {
+        leaf_first_reference[leaf_idx + 1] = leaf_first_reference[leaf_idx] + view.leaves[leaf_idx].primitive_count;
+    }
+    std::vector<u32> reference_triangles(leaf_first_reference.back());
+    std::vector<Triangle> decoded_triangles;
+    std::map<std::array<u32, 9>, u32> decoded_triangle_indices;
+    for(size_t leaf_idx = 0; leaf_idx < view.leaves.size(); leaf_idx++)
+    {
+        const auto & leaf = view.leaves[leaf_idx];
+        const bool quantized_leaf = quantized && view.quantized_leaves[leaf_idx].first_corner != QUANTIZED_LEAF_EXACT;
+        for(u32 i = 0; i < leaf.primitive_count; i++)
+        {
+            u32 & reference_triangle = reference_triangles[leaf_first_reference[leaf_idx] + i];
+            if(!quantized_leaf)
+            {
+                reference_triangle = view.leaf_primitive_indices[leaf.first_primitive + i];
+                continue;
+            }
+            const auto & quantized_leaf_data = view.quantized_leaves[leaf_idx];
+            const u8 * corners = view.quantized_corners.data() + quantized_leaf_data.first_corner + size_t(i) * 3;
+            std::array<u32, 9> grid_cells;
+            for(u32 corner = 0; corner < 3; corner++)
+            {
+                const QuantizedVertex & vertex = view.quantized_vertices[quantized_leaf_data.first_vertex + corners[corner]];
+                const u32vec3 cell = quantized_leaf_data.grid_origin + u32vec3(vertex.x, vertex.y, vertex.z);
+                for(u32 axis = 0; axis < 3; axis++) { grid_cells[corner * 3 + axis] = cell[axis]; }
+            }
+            const auto [decoded_it, inserted] = decoded_triangle_indices.try_emplace(
+                grid_cells, u32(view.triangles.size() + decoded_triangles.size()));
+            if(inserted)
+            {
+                const QuantizedLeafDecoder decoder = {
+                    .grid = view.quantization_grid,
+                    .grid_origin = quantized_leaf_data.grid_origin,
+                    .vertices = view.quantized_vertices.data() + quantized_leaf_data.first_vertex
+                };
+                decoded_triangles.push_back(decoder.decode(corners));
+            }
+            reference_triangle = decoded_it->second;
+        }
+    }
+    const size_t triangle_count = view.triangles.size() + decoded_triangles.size();
+    auto get_triangle = [&](size_t triangle_idx) -> Triangle
+    {
+        if(triangle_idx < view.triangles.size()) { return view.triangles.get_triangle(triangle_idx); }
+        return decoded_triangles[triangle_idx - view.triangles.size()];
+    };
+
+    // Pre-order numbers of the nodes - the subtree of a node holds the numbers from its own up to its subtree end
+    std::vector<u32> node_order(view.nodes.size());
+    std::vector<u32> subtree_end(view.nodes.size());
+    std::vector<std::pair<i32, bool>> order_stack = {{0, false}};
+    u32 order_counter = 0;
+    while(!order_stack.empty())
+    {
+        const auto [node_idx, visited] = order_stack.back();
+        order_stack.pop_back();
+        if(visited)
+        {
+            subtree_end[node_idx] = order_counter;
+            continue;
+        }
+        node_order[node_idx] = order_counter++;
+        order_stack.push_back({node_idx, true});
+        const auto & node = view.nodes[node_idx];
+        if(node.left_index != -1)
+        {
+            order_stack.push_back({node.right_index, false});
+            order_stack.push_back({node.left_index, false});
+        }
+    }
+
+    // Per triangle pre-order numbers of the leaves referencing it
+    std::vector<u32> reference_offsets(triangle_count + 1, 0);
+    u64 reference_count = 0;
+    f64 overlap_area = 0.0;
+    for(const auto & node : view.nodes)
+    {
+        if(node.left_index == -1)
+        {
+            const auto & leaf = view.leaves[node.right_index];
+            for(u32 i = 0; i < leaf.primitive_count; i++)
+            {
+                reference_offsets[reference_triangles[leaf_first_reference[node.right_index] + i] + 1]++;
+            }
+            reference_count += leaf.primitive_count;
+            if(leaf.primitive_count >= metrics.leaf_size_histogram.size()) { metrics.leaf_size_histogram.resize(leaf.primitive_count + 1, 0); }
+            metrics.leaf_size_histogram[leaf.primitive_count]++;
+            continue;
+        }
+        const AABB & left_box = view.nodes[node.left_index].bounding_box;
+        const AABB & right_box = view.nodes[node.right_index].bounding_box;
+        // NOTE(msakmary) the intersection of disjoint boxes is inverted and its area would not be zero
+        if(do_aabbs_intersect(left_box, right_box))
+        {
+            overlap_area += get_intersection_aabb(left_box, right_box).get_area();
+        }
+    }
+    for(size_t i = 0; i < triangle_count; i++) { reference_offsets[i + 1] += reference_offsets[i]; }
+    std::vector<u32> reference_orders(reference_offsets.back());
+    {
+        std::vector<u32> reference_fill(reference_offsets.begin(), reference_offsets.end() - 1);
+        for(u32 node_idx = 0; node_idx < view.nodes.size(); node_idx++)
+        {
+            const auto & node = view.nodes[node_idx];
+            if(node.left_index != -1) { continue; }
+            const auto & leaf = view.leaves[node.right_index];
+            for(u32 i = 0; i < leaf.primitive_count; i++)
+            {
+                reference_orders[reference_fill[reference_triangles[leaf_first_reference[node.right_index] + i]]++] = node_order[node_idx];
+            }
+        }
+    }
+
+    // Every triangle walks the nodes its bounds overlap and adds its area inside the nodes whose subtree does not
+    // reference it - a node not referencing the triangle has no descendant referencing it either
+    std::vector<f64> triangle_areas(triangle_count);
+    std::vector<f64> triangle_overlaps(triangle_count);
+    parallel_for(triangle_count, METRICS_PARALLEL_MIN_TRIANGLES, [&](size_t triangle_idx)
+    {
+        thread_local std::array<types::Polygon, 2> polygons;
+        thread_local std::vector<i32> node_stack;
+        const auto references = std::span(reference_orders).subspan(
+            reference_offsets[triangle_idx], reference_offsets[triangle_idx + 1] - reference_offsets[triangle_idx]);
+        // exact triangles of quantized leaves are replaced by their decoded ones
+        if(quantized && references.empty())
+        {
+            triangle_areas[triangle_idx] = 0.0;
+            triangle_overlaps[triangle_idx] = 0.0;
+            return;
+        }
+        const Triangle triangle = get_triangle(triangle_idx);
+        const AABB triangle_aabb = AABB(triangle);
+        triangle_areas[triangle_idx] = 0.5 * glm::length(glm::cross(
+            f64vec3(triangle[1] - triangle[0]), f64vec3(triangle[2] - triangle[0])));
+
+        f64 weighted_overlap = 0.0;
+        node_stack.assign(1, 0);
+        while(!node_stack.empty())
+        {
+            const i32 node_idx = node_stack.back();
+            node_stack.pop_back();
+            const auto & node = view.nodes[node_idx];
+            if(!do_aabbs_intersect(node.bounding_box, triangle_aabb)) { continue; }
+
+            const bool referenced = std::any_of(references.begin(), references.end(), [&](u32 order)
+                { return order >= node_order[node_idx] && order < subtree_end[node_idx]; });
+            if(!referenced)
+            {
+                const f64 node_cost = node.left_index == -1 ?
+                    view.leaves[node.right_index].primitive_count * ray_primitive_intersection_cost :
+                    2.0 * ray_aabb_intersection_cost;
+                // most triangles lie wholly inside the deep nodes they overlap, those need no clipping
+                const bool inside = node.bounding_box.contains(triangle);
+                weighted_overlap += node_cost * (inside ? triangle_areas[triangle_idx] : BVH::get_clipped_area(triangle, node.bounding_box, polygons));
+            }
+            if(node.left_index != -1)
+            {
+                node_stack.push_back(node.right_index);
+                node_stack.push_back(node.left_index);
+            }
+        }
+        triangle_overlaps[triangle_idx] = weighted_overlap;
+    });
+
+    f64 total_area = 0.0;
+    f64 total_overlap = 0.0;
+    size_t traced_triangle_count = 0;
+    for(size_t i = 0; i < triangle_count; i++)
+    {
+        if(quantized && reference_offsets[i + 1] == reference_offsets[i]) { continue; }
+        traced_triangle_count++;
+        total_area += triangle_areas[i];
+        total_overlap += triangle_overlaps[i];
+    }
+    metrics.epo = total_area > 0.0 ? f32(total_overlap / total_area) : 0.0f;
+    metrics.sibling_overlap = root_area > 0.0 ? f32(overlap_area / root_area) : 0.0f;
+    metrics.duplication_factor = traced_triangle_count > 0 ?
+        f32(f64(reference_count) / f64(traced_triangle_count)) : 0.0f;
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+    metrics.compute_time = ms_double.count();
+    return metrics;
+}
@@ -0,0 +1,256 @@
+#include "bvh.hpp"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+// Vertices are snapped to a grid with this many cells along every axis of the scene bounds
+static constexpr u32 QUANTIZATION_GRID_MAX = (1u << 20u) - 1u;
+// offsets of the vertices from the leaf origin are stored in 16 bits
+static constexpr u32 QUANTIZED_LEAF_MAX_OFFSET = 0xFFFFu;
+// corners index the leaf vertices with a single byte
+static constexpr size_t QUANTIZED_LEAF_MAX_VERTICES = 256;
+static constexpr u32 SLOWDOWN_RAY_COUNT = 1u << 14u;
+static constexpr u32 SLOWDOWN_ROUNDS = 3;
+
+auto BVH::quantize_leaves(BVHStats & stats) -> void
+{
+    const IndexedTriangles triangles = view.triangles;
+    // the root bounds are the union of all of the triangle bounds
+    const AABB & scene_aabb = bvh_nodes.at(0).bounding_box;
+    const f32vec3 scene_extent = scene_aabb.max_bounds - scene_aabb.min_bounds;
+    quantization_grid = QuantizationGrid{
+        .origin = scene_aabb.min_bounds,
+        .step = glm::max(scene_extent / f32(QUANTIZATION_GRID_MAX), f32vec3(std::numeric_limits<f32>::min()))
+    };
+    auto get_grid_position = [&](const f32vec3 & position) -> u32vec3
+    {
+        const f32vec3 cell = glm::round((position - quantization_grid.origin) / quantization_grid.step);
+        return u32vec3(glm::clamp(cell, f32vec3(0.0f), f32vec3(f32(QUANTIZATION_GRID_MAX))));
+    };
+
+    // Exact leaves share the positions of their vertices with the other leaves and the indices of their triangles
+    // with the other references of a split triangle, so an exact leaf only pays its share of them
+    std::vector<u32> vertex_leaf_counts(triangles.positions.size(), 0u);
+    std::vector<u32> triangle_reference_counts(triangles.size(), 0u);
+    std::vector<u32> leaf_vertex_indices;
+    auto collect_leaf_vertices = [&](const BVHLeaf & leaf, std::vector<u8> * corners) -> bool
+    {
+        leaf_vertex_indices.clear();
+        for(u32 primitive = 0; primitive < leaf.primitive_count; primitive++)
+        {
+            const u32 triangle_index = leaf_primitive_indices.at(leaf.first_primitive + primitive);
+            for(u32 corner = 0; corner < 3; corner++)
+            {
+                const u32 vertex_index = triangles.indices[size_t(triangle_index) * 3 + corner];
+                auto vertex_it = std::find(leaf_vertex_indices.begin(), leaf_vertex_indices.end(), vertex_index);
+                if(vertex_it == leaf_vertex_indices.end())
+                {
+                    if(leaf_vertex_indices.size() == QUANTIZED_LEAF_MAX_VERTICES) { return false; }
+                    leaf_vertex_indices.push_back(vertex_index);
+                    vertex_it = leaf_vertex_indices.end() - 1;
+                }
+                if(corners != nullptr) { corners->push_back(u8(vertex_it - leaf_vertex_indices.begin())); }
+            }
+        }
+        return true;
+    };
+    for(const auto & leaf : bvh_leaves)
+    {
+        // leaves over the vertex limit stay exact and the counts are only needed to compare the encodings
+        if(!collect_leaf_vertices(leaf, nullptr)) { continue; }
+        for(const u32 vertex_index : leaf_vertex_indices) { vertex_leaf_counts.at(vertex_index)++; }
+        for(u32 primitive = 0; primitive < leaf.primitive_count; primitive++)
+        {
+            triangle_reference_counts.at(leaf_primitive_indices.at(leaf.first_primitive + primitive))++;
+        }
+    }
+
+    quantized_leaves.reserve(bvh_leaves.size());
+    std::vector<u32vec3> leaf_grid_positions;
+    std::vector<u8> leaf_corners;
+    f64 saved_bytes = 0.0;
+    for(const auto & leaf : bvh_leaves)
+    {
+        leaf_grid_positions.clear();
+        leaf_corners.clear();
+
+        bool fits = collect_leaf_vertices(leaf, &leaf_corners);
+        u32vec3 grid_min = u32vec3(QUANTIZATION_GRID_MAX);
+        u32vec3 grid_max = u32vec3(0u);
+        f64 exact_bytes = f64(leaf.primitive_count) * sizeof(u32);
+        for(u32 vertex_index : leaf_vertex_indices)
+        {
+            const u32vec3 grid_position = get_grid_position(triangles.positions[vertex_index]);
+            leaf_grid_positions.push_back(grid_position);
+            grid_min = glm::min(grid_min, grid_position);
+            grid_max = glm::max(grid_max, grid_position);
+            exact_bytes += f64(sizeof(f32vec3)) / f64(glm::max(vertex_leaf_counts.at(vertex_index), 1u));
+        }
+        for(u32 primitive = 0; primitive < leaf.primitive_count && fits; primitive++)
+        {
+            const u32 triangle_index = leaf_primitive_indices.at(leaf.first_primitive + primitive);
+            exact_bytes += f64(3 * sizeof(u32)) / f64(glm::max(triangle_reference_counts.at(triangle_index), 1u));
+        }
+        fits = fits && glm::all(glm::lessThanEqual(grid_max - grid_min, u32vec3(QUANTIZED_LEAF_MAX_OFFSET)));
+        // the QuantizedLeaf entries are paid by the whole tree and checked once all of the leaves are encoded
+        const f64 quantized_bytes = f64(leaf_vertex_indices.size() * sizeof(QuantizedVertex) + leaf_corners.size());
+
+        if(!fits || quantized_bytes >= exact_bytes)
+        {
+            quantized_leaves.push_back(QuantizedLeaf{
+                .grid_origin = u32vec3(0u),
+                .first_vertex = 0,
+                .first_corner = QUANTIZED_LEAF_EXACT
+            });
+            continue;
+        }
+
+        saved_bytes += exact_bytes - quantized_bytes;
+        quantized_leaves.push_back(QuantizedLeaf{
+            .grid_origin = grid_min,
+            .first_vertex = u32(quantized_vertices.size()),
+            .first_corner = u32(quantized_corners.size())
+        });
+        for(const auto & grid_position : leaf_grid_positions)
+        {
+            const u32vec3 offset = grid_position - grid_min;
+            quantized_vertices.push_back(QuantizedVertex{.x = u16(offset.x), .y = u16(offset.y), .z = u16(offset.z)});
+        }
+        quantized_corners.insert(quantized_corners.end(), leaf_corners.begin(), leaf_corners.end());
+    }
+
+    // the quantized leaves do not save enough to pay for an entry per leaf - the tree stays exact and keeps
+    // reading the scene triangles
+    if(saved_bytes <= f64(quantized_leaves.size() * sizeof(QuantizedLeaf)))
+    {
+        quantized_leaves.clear();
+        quantized_vertices.clear();
+        quantized_corners.clear();
+        stats.quantized_memory_ratio = 1.0f;
+        stats.quantized_traversal_slowdown = 1.0f;
+        return;
+    }
+
+    // Decoded vertices are up to half of a grid step away from the exact ones (the triangles are not clipped
+    // to the node bounds so this holds for spatially split references too). The leaf loop grows the decoded
+    // triangles by a step and inflating all of the node bounds by a step as well keeps the rays hitting the
+    // grown triangles inside of the nodes
+    for(auto & node : bvh_nodes)
+    {
+        node.bounding_box.min_bounds -= quantization_grid.step;
+        node.bounding_box.max_bounds += quantization_grid.step;
+    }
+
+    // the exact traversal the slowdown is measured against still needs all of the leaf primitive indices and
+    // the scene triangles they point into
+    update_view(triangles);
+    view.triangles = triangles;
+    const BVHMemoryFootprint exact_footprint = get_memory_footprint();
+    const size_t exact_bytes = exact_footprint.get_total() - exact_footprint.quantized_leaves;
+    stats.quantized_traversal_slowdown = measure_quantized_traversal_slowdown();
+
+    // Quantized leaves intersect only their decoded triangles - their primitive indices are dropped and the exact
+    // leaves read a compacted copy of their triangles, so the traversal no longer touches the scene triangles
+    compact_exact_leaf_triangles(triangles);
+    // the tree is only ever rebuilt from now on, the builder scratch is not needed anymore
+    primitive_aabbs_global = {};
+    update_view(triangles);
+    stats.quantized_memory_ratio = exact_bytes > 0 ? f32(f64(get_memory_footprint().get_total()) / f64(exact_bytes)) : 1.0f;
+}
+
+auto BVH::compact_exact_leaf_triangles(const IndexedTriangles & triangles) -> void
+{
+    exact_leaf_positions.clear();
+    exact_leaf_indices.clear();
+    std::vector<u32> exact_leaf_primitive_indices;
+    std::vector<u32> triangle_remap(triangles.size(), ~0u);
+    std::vector<u32> vertex_remap(triangles.positions.size(), ~0u);
+    for(size_t leaf_idx = 0; leaf_idx < bvh_leaves.size(); leaf_idx++)
+    {
+        auto & leaf = bvh_leaves.at(leaf_idx);
+        const u32 first_primitive = u32(exact_leaf_primitive_indices.size());
+        if(quantized_leaves.at(leaf_idx).first_corner != QUANTIZED_LEAF_EXACT)
+        {
+            leaf.first_primitive = first_primitive;
+            continue;
+        }
+        for(u32 primitive = 0; primitive < leaf.primitive_count; primitive++)
+        {
+            const u32 triangle_index = leaf_primitive_indices.at(leaf.first_primitive + primitive);
+            if(triangle_remap.at(triangle_index) == ~0u)
+            {
+                triangle_remap.at(triangle_index) = u32(exact_leaf_indices.size() / 3);
+                for(u32 corner = 0; corner < 3; corner++)
+                {
+                    const u32 vertex_index = triangles.indices[size_t(triangle_index) * 3 + corner];
+                    if(vertex_remap.at(vertex_index) == ~0u)
+                    {
+                        vertex_remap.at(vertex_index) = u32(exact_leaf_positions.size());
+                        exact_leaf_positions.push_back(triangles.positions[vertex_index]);
+                    }
+                    exact_leaf_indices.push_back(vertex_remap.at(vertex_index));
+                }
+            }
+            exact_leaf_primitive_indices.push_back(triangle_remap.at(triangle_index));
+        }
+        leaf.first_primitive = first_primitive;
+    }
+    leaf_primitive_indices = std::move(exact_leaf_primitive_indices);
+}
+
+auto BVH::measure_quantized_traversal_slowdown() -> f32
+{
+    // incoherent rays from inside of the scene bounds - the same rays are traced with both leaf encodings
+    const AABB & scene_aabb = view.nodes[0].bounding_box;
+    std::mt19937 generator(SLOWDOWN_RAY_COUNT);
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+    std::vector<Ray> rays;
+    rays.reserve(SLOWDOWN_RAY_COUNT);
+    for(u32 i = 0; i < SLOWDOWN_RAY_COUNT; i++)
+    {
+        const f32vec3 origin_factor = f32vec3(unit(generator), unit(generator), unit(generator));
+        const f32vec3 direction = f32vec3(unit(generator), unit(generator), unit(generator)) * 2.0f - 1.0f;
+        rays.emplace_back(
+            scene_aabb.min_bounds + origin_factor * (scene_aabb.max_bounds - scene_aabb.min_bounds),
+            glm::length(direction) > 0.0f ? direction : f32vec3(0.0f, 0.0f, 1.0f));
+    }
+
+    const BVHView quantized_view = view;
+    BVHView exact_view = view;
+    exact_view.quantized_leaves = {};
+
+    u32 exact_hit_count = 0;
+    u32 quantized_hit_count = 0;
+    auto time_traversal = [&](const BVHView & traversal_view, u32 & hit_count) -> f64
+    {
+        view = traversal_view;
+        hit_count = 0;
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for(const auto & ray : rays)
+        {
+            hit_count += get_nearest_intersection(ray).hit ? 1u : 0u;
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+        return ms_double.count();
+    };
+
+    // best of a few alternating rounds so that a single hiccup does not skew the ratio
+    f64 exact_time = INFINITY;
+    f64 quantized_time = INFINITY;
+    for(u32 round = 0; round < SLOWDOWN_ROUNDS; round++)
+    {
+        exact_time = glm::min(exact_time, time_traversal(exact_view, exact_hit_count));
+        quantized_time = glm::min(quantized_time, time_traversal(quantized_view, quantized_hit_count));
+    }
+    view = quantized_view;
+
+    // the grown decoded triangles may pick up a few grazing rays but must never lose one
+    if(quantized_hit_count < exact_hit_count)
+    {
+        DEBUG_OUT("[BVH::measure_quantized_traversal_slowdown()] quantized leaves lost hits - the hit count fell from " +
+            std::to_string(exact_hit_count) + " to " + std::to_string(quantized_hit_count));
+    }
+    return exact_time > 0.0 ? f32(quantized_time / exact_time) : 1.0f;
+}
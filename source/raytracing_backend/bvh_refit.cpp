@@ -0,0 +1,583 @@
+#include "bvh.hpp"
+#include "parallel_for.hpp"
+
+#include <map>
+#include <chrono>
+#include <stack>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+// levels with fewer nodes than this are refitted on the calling thread
+static constexpr size_t REFIT_PARALLEL_MIN_NODES = 4096;
+// edits below this depth are grouped by their ancestor at it and rebuilt separately
+static constexpr u32 UPDATE_GROUP_CUT_DEPTH = 6;
+// Escalations mostly end at the root once their subtrees hold a sizable part of the tree. Once the escalated rebuilds
+// together touch more than this fraction of the references the whole tree is built right away, which bounds the work
+// an update ending in a full build wastes to about a quarter of a build
+static constexpr f64 UPDATE_FULL_REBUILD_FRACTION = 0.25;
+
+static auto is_unbounded(const AABB & region) -> bool
+{
+    return region.min_bounds == f32vec3(-INFINITY) && region.max_bounds == f32vec3(INFINITY);
+}
+
+auto BVH::copy_mapped_data(const IndexedTriangles & triangles) -> void
+{
+    if(!mapped_file) { return; }
+    bvh_nodes.assign(view.nodes.begin(), view.nodes.end());
+    bvh_leaves.assign(view.leaves.begin(), view.leaves.end());
+    leaf_primitive_indices.assign(view.leaf_primitive_indices.begin(), view.leaf_primitive_indices.end());
+    stackless_links.assign(view.stackless_links.begin(), view.stackless_links.end());
+    quantized_leaves.assign(view.quantized_leaves.begin(), view.quantized_leaves.end());
+    quantized_vertices.assign(view.quantized_vertices.begin(), view.quantized_vertices.end());
+    quantized_corners.assign(view.quantized_corners.begin(), view.quantized_corners.end());
+    quantization_grid = view.quantization_grid;
+    if(!view.quantized_leaves.empty())
+    {
+        exact_leaf_positions.assign(view.triangles.positions.begin(), view.triangles.positions.end());
+        exact_leaf_indices.assign(view.triangles.indices.begin(), view.triangles.indices.end());
+    }
+    update_view(triangles);
+    mapped_file.reset();
+}
+
+auto BVH::get_built_sah_cost() -> f32
+{
+    if(built_sah_cost < 0.0f) { built_sah_cost = get_sah_cost(); }
+    return built_sah_cost;
+}
+
+auto BVH::prepare_refit() -> void
+{
+    refit_data = RefitData{};
+
+    // parents are always created before their children so a single forward sweep finds the depth of every node
+    std::vector<i32> parents(bvh_nodes.size(), -1);
+    std::vector<u32> depths(bvh_nodes.size(), 0u);
+    std::vector<i32> leaf_nodes(bvh_leaves.size(), -1);
+    u32 max_depth = 0;
+    for(i32 node_idx = 0; node_idx < i32(bvh_nodes.size()); node_idx++)
+    {
+        const auto & node = bvh_nodes[node_idx];
+        max_depth = glm::max(max_depth, depths[node_idx]);
+        if(node.left_index == -1)
+        {
+            leaf_nodes[node.right_index] = node_idx;
+            continue;
+        }
+        for(const i32 child_idx : {node.left_index, node.right_index})
+        {
+            parents[child_idx] = node_idx;
+            depths[child_idx] = depths[node_idx] + 1;
+        }
+    }
+
+    refit_data.level_starts.assign(max_depth + 2, 0);
+    for(const u32 depth : depths) { refit_data.level_starts[depth + 1]++; }
+    for(u32 depth = 1; depth < refit_data.level_starts.size(); depth++)
+    {
+        refit_data.level_starts[depth] += refit_data.level_starts[depth - 1];
+    }
+    refit_data.node_order.resize(bvh_nodes.size());
+    std::vector<size_t> level_offsets(refit_data.level_starts.begin(), refit_data.level_starts.end() - 1);
+    for(i32 node_idx = 0; node_idx < i32(bvh_nodes.size()); node_idx++)
+    {
+        refit_data.node_order[level_offsets[depths[node_idx]]++] = node_idx;
+    }
+
+    if(spatial_split_planes.empty()) { return; }
+
+    // A reference has to be clipped by a spatial split plane only if its primitive is referenced on both sides of
+    // the split - otherwise the split did not duplicate it and the whole primitive belongs to the one side it is on
+    std::unordered_map<i32, const SpatialSplitPlane *> node_planes;
+    for(const auto & plane : spatial_split_planes) { node_planes.emplace(plane.node_index, &plane); }
+
+    std::vector<i32> reference_nodes(leaf_primitive_indices.size(), -1);
+    for(u32 leaf_idx = 0; leaf_idx < bvh_leaves.size(); leaf_idx++)
+    {
+        const auto & leaf = bvh_leaves[leaf_idx];
+        for(u32 reference = leaf.first_primitive; reference < leaf.first_primitive + leaf.primitive_count; reference++)
+        {
+            reference_nodes[reference] = leaf_nodes[leaf_idx];
+        }
+    }
+    // references grouped by their primitive, only primitives referenced more than once were split
+    std::vector<u32> references(leaf_primitive_indices.size());
+    for(u32 reference = 0; reference < references.size(); reference++) { references[reference] = reference; }
+    std::sort(references.begin(), references.end(), [&](u32 first, u32 second)
+    {
+        return leaf_primitive_indices[first] < leaf_primitive_indices[second];
+    });
+
+    refit_data.clip_regions.assign(leaf_primitive_indices.size(), AABB(f32vec3(-INFINITY), f32vec3(INFINITY)));
+    std::unordered_set<i32> path_nodes;
+    for(size_t group_start = 0; group_start < references.size(); )
+    {
+        size_t group_end = group_start + 1;
+        const u32 primitive_index = leaf_primitive_indices[references[group_start]];
+        while(group_end < references.size() && leaf_primitive_indices[references[group_end]] == primitive_index) { group_end++; }
+        const std::span<const u32> group(references.data() + group_start, group_end - group_start);
+        group_start = group_end;
+        if(group.size() == 1) { continue; }
+
+        path_nodes.clear();
+        for(const u32 reference : group)
+        {
+            for(i32 node_idx = reference_nodes[reference]; node_idx != -1; node_idx = parents[node_idx]) { path_nodes.insert(node_idx); }
+        }
+        for(const u32 reference : group)
+        {
+            AABB & region = refit_data.clip_regions[reference];
+            for(i32 child_idx = reference_nodes[reference], node_idx = parents[child_idx]; node_idx != -1; child_idx = node_idx, node_idx = parents[node_idx])
+            {
+                const auto & node = bvh_nodes[node_idx];
+                const bool is_left_child = node.left_index == child_idx;
+                const i32 sibling_idx = is_left_child ? node.right_index : node.left_index;
+                const auto plane = node_planes.find(node_idx);
+                if(plane == node_planes.end() || !path_nodes.contains(sibling_idx)) { continue; }
+
+                const Axis axis = plane->second->axis;
+                if(is_left_child) { region.max_bounds[axis] = glm::min(region.max_bounds[axis], plane->second->coordinate); }
+                else              { region.min_bounds[axis] = glm::max(region.min_bounds[axis], plane->second->coordinate); }
+            }
+        }
+    }
+}
+
+auto BVH::refit(const IndexedTriangles & triangles) -> BVHRefitStats
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+    if(view.nodes.empty()) { return BVHRefitStats{}; }
+
+    const f32 built_cost = get_built_sah_cost();
+    // NOTE(msakmary) quantized leaves dropped their exact data and are relative to the leaf grid cells of the built
+    // tree, so a quantized tree is rebuilt and requantized with the parameters it was built with instead
+    if(!view.quantized_leaves.empty())
+    {
+        construct_bvh_from_data(triangles, built_info);
+        const f32 rebuilt_sah_cost = get_sah_cost();
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+        return BVHRefitStats{
+            .built_sah_cost = built_cost,
+            .refitted_sah_cost = rebuilt_sah_cost,
+            .sah_degradation = built_cost > 0.0f ? rebuilt_sah_cost / built_cost : 1.0f,
+            .refit_time = ms_double.count()
+        };
+    }
+
+    assert(triangles.size() == view.triangles.size());
+    copy_mapped_data(triangles);
+    build_decisions.clear();
+    if(refit_data.node_order.empty()) { prepare_refit(); }
+
+    // deepest level first - the children of every node are already refitted when its level is reached
+    for(size_t level = refit_data.level_starts.size() - 1; level-- > 0; )
+    {
+        const size_t level_start = refit_data.level_starts[level];
+        parallel_for(refit_data.level_starts[level + 1] - level_start, REFIT_PARALLEL_MIN_NODES, [&](size_t i)
+        {
+            auto & node = bvh_nodes[refit_data.node_order[level_start + i]];
+            if(node.left_index != -1)
+            {
+                node.bounding_box = bvh_nodes[node.left_index].bounding_box;
+                node.bounding_box.expand_bounds(bvh_nodes[node.right_index].bounding_box);
+                return;
+            }
+
+            const auto & leaf = bvh_leaves[node.right_index];
+            AABB leaf_aabb;
+            for(u32 reference = leaf.first_primitive; reference < leaf.first_primitive + leaf.primitive_count; reference++)
+            {
+                const Triangle triangle = triangles.get_triangle(leaf_primitive_indices[reference]);
+                if(refit_data.clip_regions.empty() || is_unbounded(refit_data.clip_regions[reference]))
+                {
+                    leaf_aabb.expand_bounds(AABB(triangle));
+                    continue;
+                }
+                const AABB & region = refit_data.clip_regions[reference];
+                project_primitive_into_bin_slow({
+                    .triangle = triangle,
+                    .splitting_axis = Axis::X,
+                    .left_plane_axis_coord = region.min_bounds.x,
+                    .right_plane_axis_coord = region.max_bounds.x,
+                    .parent_aabb = region,
+                    .left_aabb = leaf_aabb,
+                    .right_aabb = leaf_aabb
+                });
+            }
+            node.bounding_box = leaf_aabb;
+        });
+    }
+
+    // the stackless links only depend on the topology, the near child order derived from the built bounds stays valid
+    update_view(triangles);
+
+    const f32 refitted_sah_cost = get_sah_cost();
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+    return BVHRefitStats{
+        .built_sah_cost = built_cost,
+        .refitted_sah_cost = refitted_sah_cost,
+        .sah_degradation = built_cost > 0.0f ? refitted_sah_cost / built_cost : 1.0f,
+        .refit_time = ms_double.count()
+    };
+}
+
+auto BVH::remove_unreachable_nodes() -> std::vector<i32>
+{
+    // parents precede their children so a forward sweep reaches every node of the tree
+    std::vector<bool> reachable(bvh_nodes.size(), false);
+    reachable[0] = true;
+    std::vector<i32> node_remap(bvh_nodes.size(), -1);
+    i32 reachable_count = 0;
+    for(size_t node_idx = 0; node_idx < bvh_nodes.size(); node_idx++)
+    {
+        if(!reachable[node_idx]) { continue; }
+        node_remap[node_idx] = reachable_count++;
+        const auto & node = bvh_nodes[node_idx];
+        if(node.left_index != -1)
+        {
+            reachable[node.left_index] = true;
+            reachable[node.right_index] = true;
+        }
+    }
+
+    std::vector<BVHNode> reachable_nodes;
+    std::vector<BVHLeaf> reachable_leaves;
+    std::vector<u32> reachable_primitive_indices;
+    reachable_nodes.reserve(reachable_count);
+    for(size_t node_idx = 0; node_idx < bvh_nodes.size(); node_idx++)
+    {
+        if(!reachable[node_idx]) { continue; }
+        BVHNode node = bvh_nodes[node_idx];
+        if(node.left_index != -1)
+        {
+            node.left_index = node_remap[node.left_index];
+            node.right_index = node_remap[node.right_index];
+        } else {
+            const auto & leaf = bvh_leaves[node.right_index];
+            reachable_leaves.push_back(BVHLeaf{
+                .first_primitive = u32(reachable_primitive_indices.size()),
+                .primitive_count = leaf.primitive_count
+            });
+            reachable_primitive_indices.insert(
+                reachable_primitive_indices.end(),
+                leaf_primitive_indices.begin() + leaf.first_primitive,
+                leaf_primitive_indices.begin() + leaf.first_primitive + leaf.primitive_count);
+            node.right_index = i32(reachable_leaves.size() - 1);
+        }
+        reachable_nodes.push_back(node);
+    }
+    bvh_nodes = std::move(reachable_nodes);
+    bvh_leaves = std::move(reachable_leaves);
+    leaf_primitive_indices = std::move(reachable_primitive_indices);
+
+    std::erase_if(spatial_split_planes, [&](const SpatialSplitPlane & plane) { return node_remap[plane.node_index] == -1; });
+    for(auto & plane : spatial_split_planes) { plane.node_index = node_remap[plane.node_index]; }
+    return node_remap;
+}
+
+auto BVH::rebuild_subtree(u32 node_idx, u32 depth, const UpdateBVHInfo & info) -> u32
+{
+    // the node bounds every reference in the subtree - unchanged triangles which are also referenced outside
+    // of the subtree are clipped to it so the rebuild does not grow into the space covered by their other references
+    const AABB subtree_aabb = bvh_nodes.at(node_idx).bounding_box;
+    std::vector<u32> primitives;
+    std::stack<i32> subtree_nodes;
+    subtree_nodes.push(i32(node_idx));
+    while(!subtree_nodes.empty())
+    {
+        const auto & node = bvh_nodes[subtree_nodes.top()];
+        subtree_nodes.pop();
+        if(node.left_index != -1)
+        {
+            subtree_nodes.push(node.left_index);
+            subtree_nodes.push(node.right_index);
+            continue;
+        }
+        const auto & leaf = bvh_leaves[node.right_index];
+        primitives.insert(
+            primitives.end(),
+            leaf_primitive_indices.begin() + leaf.first_primitive,
+            leaf_primitive_indices.begin() + leaf.first_primitive + leaf.primitive_count);
+    }
+    std::sort(primitives.begin(), primitives.end());
+    primitives.erase(std::unique(primitives.begin(), primitives.end()), primitives.end());
+
+    primitive_aabbs_global.clear();
+    primitive_aabbs_global.reserve(primitives.size());
+    AABB rebuilt_aabb;
+    for(const u32 primitive_index : primitives)
+    {
+        const Triangle triangle = info.triangles.get_triangle(primitive_index);
+        AABB primitive_aabb;
+        const bool changed = std::binary_search(info.changed_primitives.begin(), info.changed_primitives.end(), primitive_index);
+        if(changed || !subtree_aabb.check_if_valid() || subtree_aabb.contains(triangle))
+        {
+            primitive_aabb = AABB(triangle);
+        } else {
+            project_primitive_into_bin_slow({
+                .triangle = triangle,
+                .splitting_axis = Axis::X,
+                .left_plane_axis_coord = subtree_aabb.min_bounds.x,
+                .right_plane_axis_coord = subtree_aabb.max_bounds.x,
+                .parent_aabb = subtree_aabb,
+                .left_aabb = primitive_aabb,
+                .right_aabb = primitive_aabb
+            });
+        }
+        rebuilt_aabb.expand_bounds(primitive_aabb);
+        primitive_aabbs_global.push_back(PrimitiveAABB{.aabb = primitive_aabb, .primitive_index = primitive_index});
+    }
+
+    // the old descendants stay in the vectors unreachable until remove_unreachable_nodes
+    std::erase_if(spatial_split_planes, [&](const SpatialSplitPlane & plane) { return plane.node_index == i32(node_idx); });
+    bvh_nodes.at(node_idx).bounding_box = rebuilt_aabb;
+    BVHStats subtree_stats = {};
+    u64 leaf_depth_sum = 0ul;
+    build_subtree({
+        .construct_info = info.construct_info,
+        .stats = subtree_stats,
+        .leaf_depth_sum = leaf_depth_sum,
+        .node_idx = node_idx,
+        .node_span = NodeSpan{0, primitive_aabbs_global.size()},
+        .depth = depth
+    });
+    return u32(primitives.size());
+}
+
+auto BVH::update(const UpdateBVHInfo & info) -> BVHUpdateStats
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+    assert(std::is_sorted(info.changed_primitives.begin(), info.changed_primitives.end()));
+    BVHUpdateStats stats = {};
+    if(view.nodes.empty() || info.changed_primitives.empty()) { return stats; }
+
+    // quantized leaves keep no exact data to find the references of the changed triangles in
+    if(!view.quantized_leaves.empty())
+    {
+        construct_bvh_from_data(info.triangles, info.construct_info);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+        return BVHUpdateStats{
+            .rebuilt_primitive_count = u32(info.triangles.size()),
+            .rebuilt_subtree_count = 1,
+            .escalation_count = 0,
+            .full_rebuild = true,
+            .sah_degradation = 1.0f,
+            .update_time = ms_double.count()
+        };
+    }
+
+    assert(info.triangles.size() == view.triangles.size());
+    copy_mapped_data(info.triangles);
+    const f32 built_cost = get_built_sah_cost();
+    refit_data = RefitData{};
+
+    std::vector<i32> parents;
+    std::vector<u32> depths;
+    auto find_parents = [&]()
+    {
+        parents.assign(bvh_nodes.size(), -1);
+        depths.assign(bvh_nodes.size(), 0u);
+        for(i32 node_idx = 0; node_idx < i32(bvh_nodes.size()); node_idx++)
+        {
+            const auto & node = bvh_nodes[node_idx];
+            if(node.left_index == -1) { continue; }
+            for(const i32 child_idx : {node.left_index, node.right_index})
+            {
+                parents[child_idx] = node_idx;
+                depths[child_idx] = depths[node_idx] + 1;
+            }
+        }
+    };
+    find_parents();
+
+    auto find_common_ancestor = [&](i32 first_idx, i32 second_idx) -> i32
+    {
+        while(depths[first_idx] > depths[second_idx]) { first_idx = parents[first_idx]; }
+        while(depths[second_idx] > depths[first_idx]) { second_idx = parents[second_idx]; }
+        while(first_idx != second_idx)
+        {
+            first_idx = parents[first_idx];
+            second_idx = parents[second_idx];
+        }
+        return first_idx;
+    };
+    // unnormalized SAH cost of every subtree, parents precede their children so a backward sweep sums them up
+    auto get_subtree_costs = [&]() -> std::vector<f64>
+    {
+        std::vector<f64> costs(bvh_nodes.size(), 0.0);
+        for(i32 node_idx = i32(bvh_nodes.size()) - 1; node_idx >= 0; node_idx--)
+        {
+            const auto & node = bvh_nodes[node_idx];
+            const f64 area = node.bounding_box.get_area();
+            if(node.left_index == -1)
+            {
+                costs[node_idx] = area * bvh_leaves[node.right_index].primitive_count * ray_primitive_intersection_cost;
+            } else {
+                costs[node_idx] = area * 2.0 * ray_aabb_intersection_cost + costs[node.left_index] + costs[node.right_index];
+            }
+        }
+        return costs;
+    };
+
+    // Edits are grouped by their ancestor at the cut depth and each group rebuilds only the smallest subtree holding
+    // all of its affected leaves - scattered edits rebuild several small subtrees instead of their common ancestor
+    std::map<i32, i32> group_roots;
+    bool all_referenced = true;
+    std::vector<bool> referenced(info.changed_primitives.size(), false);
+    for(i32 node_idx = 0; node_idx < i32(bvh_nodes.size()); node_idx++)
+    {
+        const auto & node = bvh_nodes[node_idx];
+        if(node.left_index != -1) { continue; }
+        const auto & leaf = bvh_leaves[node.right_index];
+        bool affected = false;
+        for(u32 reference = leaf.first_primitive; reference < leaf.first_primitive + leaf.primitive_count; reference++)
+        {
+            const auto changed = std::lower_bound(info.changed_primitives.begin(), info.changed_primitives.end(), leaf_primitive_indices[reference]);
+            if(changed == info.changed_primitives.end() || *changed != leaf_primitive_indices[reference]) { continue; }
+            referenced[changed - info.changed_primitives.begin()] = true;
+            affected = true;
+        }
+        if(!affected) { continue; }
+        i32 cut_idx = node_idx;
+        while(depths[cut_idx] > UPDATE_GROUP_CUT_DEPTH) { cut_idx = parents[cut_idx]; }
+        const auto [group_it, inserted] = group_roots.try_emplace(cut_idx, node_idx);
+        if(!inserted) { group_it->second = find_common_ancestor(group_it->second, node_idx); }
+    }
+    // changed triangles the build discarded as degenerate are not in the tree, only a full build can add them
+    for(const bool primitive_referenced : referenced) { all_referenced = all_referenced && primitive_referenced; }
+
+    struct UpdateGroup
+    {
+        i32 root;
+        u32 escalation_count;
+        u32 rebuilt_primitive_count;
+    };
+    std::vector<UpdateGroup> pending_groups;
+    std::vector<UpdateGroup> finished_groups;
+    for(const auto & [cut_idx, root_idx] : group_roots)
+    {
+        pending_groups.push_back(UpdateGroup{.root = root_idx, .escalation_count = 0, .rebuilt_primitive_count = 0});
+    }
+    if(!all_referenced) { pending_groups.assign(1, UpdateGroup{.root = 0, .escalation_count = 0, .rebuilt_primitive_count = 0}); }
+    // the groups are measured against the cost of the tree and of their subtree before the edit
+    std::vector<f64> edit_costs = get_subtree_costs();
+    // references of every subtree, summed up the same way as the costs
+    auto get_subtree_reference_counts = [&]() -> std::vector<u32>
+    {
+        std::vector<u32> reference_counts(bvh_nodes.size(), 0u);
+        for(i32 node_idx = i32(bvh_nodes.size()) - 1; node_idx >= 0; node_idx--)
+        {
+            const auto & node = bvh_nodes[node_idx];
+            reference_counts[node_idx] = node.left_index == -1 ?
+                bvh_leaves[node.right_index].primitive_count :
+                reference_counts[node.left_index] + reference_counts[node.right_index];
+        }
+        return reference_counts;
+    };
+    // references rebuilt by all of the passes so far, escalated groups rebuild theirs again
+    u64 rebuilt_reference_count = 0;
+
+    while(!pending_groups.empty())
+    {
+        // The first pass rebuilds many small subtrees which is cheaper than a full build even when they hold most of
+        // the tree. Escalations rebuild ever larger subtrees on top of the work already done - once that adds up to
+        // most of the tree the whole tree is rebuilt instead of escalating further towards the root
+        bool full_rebuild = std::any_of(pending_groups.begin(), pending_groups.end(), [](const UpdateGroup & group) { return group.root == 0; });
+        if(rebuilt_reference_count > 0)
+        {
+            const std::vector<u32> subtree_reference_counts = get_subtree_reference_counts();
+            u64 pending_reference_count = 0;
+            for(const auto & group : pending_groups) { pending_reference_count += subtree_reference_counts[group.root]; }
+            full_rebuild = full_rebuild ||
+                f64(rebuilt_reference_count + pending_reference_count) > UPDATE_FULL_REBUILD_FRACTION * f64(subtree_reference_counts[0]);
+        }
+        if(full_rebuild)
+        {
+            construct_bvh_from_data(info.triangles, info.construct_info);
+            stats.rebuilt_primitive_count = info.triangles.size();
+            stats.rebuilt_subtree_count = 1;
+            stats.full_rebuild = true;
+            stats.sah_degradation = 1.0f;
+            break;
+        }
+
+        for(auto & group : pending_groups)
+        {
+            group.rebuilt_primitive_count = rebuild_subtree(u32(group.root), depths[group.root], info);
+            rebuilt_reference_count += group.rebuilt_primitive_count;
+            for(i32 node_idx = parents[group.root]; node_idx != -1; node_idx = parents[node_idx])
+            {
+                auto & node = bvh_nodes[node_idx];
+                node.bounding_box = bvh_nodes[node.left_index].bounding_box;
+                node.bounding_box.expand_bounds(bvh_nodes[node.right_index].bounding_box);
+            }
+        }
+        const std::vector<i32> node_remap = remove_unreachable_nodes();
+        std::vector<f64> remapped_edit_costs(bvh_nodes.size(), 0.0);
+        for(size_t node_idx = 0; node_idx < node_remap.size(); node_idx++)
+        {
+            if(node_remap[node_idx] != -1) { remapped_edit_costs[node_remap[node_idx]] = edit_costs[node_idx]; }
+        }
+        edit_costs = std::move(remapped_edit_costs);
+        for(auto & group : pending_groups) { group.root = node_remap[group.root]; }
+        for(auto & group : finished_groups) { group.root = node_remap[group.root]; }
+        find_parents();
+
+        // a group whose rebuilt subtree alone degrades the tree more than allowed escalates to its ancestors - twice
+        // as many levels up each time so a badly placed edit reaches the root quickly
+        const std::vector<f64> subtree_costs = get_subtree_costs();
+        std::vector<UpdateGroup> escalated_groups;
+        for(auto & group : pending_groups)
+        {
+            const f64 group_degradation = edit_costs[0] > 0.0 ?
+                (edit_costs[0] + subtree_costs[group.root] - edit_costs[group.root]) / edit_costs[0] : 1.0;
+            if(group_degradation <= info.max_sah_degradation)
+            {
+                finished_groups.push_back(group);
+                continue;
+            }
+            for(u32 level = 0; level < (1u << group.escalation_count) && group.root != 0; level++) { group.root = parents[group.root]; }
+            group.escalation_count++;
+            stats.escalation_count++;
+            escalated_groups.push_back(group);
+        }
+        // groups the escalated subtrees now contain are rebuilt with them
+        auto is_contained = [&](const UpdateGroup & group, const UpdateGroup & other) -> bool
+        {
+            return group.root != other.root && depths[group.root] > depths[other.root] &&
+                find_common_ancestor(group.root, other.root) == other.root;
+        };
+        for(auto * groups : {&finished_groups, &escalated_groups})
+        {
+            std::erase_if(*groups, [&](const UpdateGroup & group)
+            {
+                return std::any_of(escalated_groups.begin(), escalated_groups.end(),
+                    [&](const UpdateGroup & other) { return is_contained(group, other); });
+            });
+        }
+        std::sort(escalated_groups.begin(), escalated_groups.end(),
+            [](const UpdateGroup & first, const UpdateGroup & second) { return first.root < second.root; });
+        escalated_groups.erase(std::unique(escalated_groups.begin(), escalated_groups.end(),
+            [](const UpdateGroup & first, const UpdateGroup & second) { return first.root == second.root; }), escalated_groups.end());
+        pending_groups = std::move(escalated_groups);
+    }
+
+    if(!stats.full_rebuild)
+    {
+        build_decisions.clear();
+        build_stackless_links();
+        update_view(info.triangles);
+        for(const auto & group : finished_groups) { stats.rebuilt_primitive_count += group.rebuilt_primitive_count; }
+        stats.rebuilt_subtree_count = u32(finished_groups.size());
+        stats.sah_degradation = built_cost > 0.0f ? get_sah_cost() / built_cost : 1.0f;
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+    stats.update_time = ms_double.count();
+    return stats;
+}
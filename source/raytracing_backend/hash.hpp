@@ -0,0 +1,92 @@
+#pragma once
+
+#include <span>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+
+#include "../types.hpp"
+
+// Non-cryptographic 64 bit hash used for cache keys and file checksums. The input is consumed in 32 byte
+// blocks by four independent lanes so that hashing the scene geometry runs close to memory bandwidth
+struct Hasher
+{
+    explicit Hasher(u64 seed = 0) : lanes{
+        seed + PRIME_0 + PRIME_1,
+        seed + PRIME_1,
+        seed,
+        seed - PRIME_0} {}
+
+    auto add_bytes(const void * data, size_t size) -> void
+    {
+        const auto * bytes = static_cast<const std::byte *>(data);
+        total_size += size;
+        // finish the block started by a previous call
+        if(buffered_size > 0)
+        {
+            const size_t copied = glm::min(size, BLOCK_SIZE - buffered_size);
+            std::memcpy(buffer + buffered_size, bytes, copied);
+            buffered_size += copied;
+            bytes += copied;
+            size -= copied;
+            if(buffered_size < BLOCK_SIZE) { return; }
+            consume_block(buffer);
+            buffered_size = 0;
+        }
+        for(; size >= BLOCK_SIZE; size -= BLOCK_SIZE, bytes += BLOCK_SIZE) { consume_block(bytes); }
+        std::memcpy(buffer, bytes, size);
+        buffered_size = size;
+    }
+
+    template<typename T>
+    auto add(const T & value) -> void
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add_bytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    auto add(std::span<const T> values) -> void
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add_bytes(values.data(), values.size_bytes());
+    }
+
+    [[nodiscard]] auto get() const -> u64
+    {
+        u64 hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+        hash += total_size;
+        for(size_t i = 0; i < buffered_size; i++)
+        {
+            hash = std::rotl(hash ^ (u64(buffer[i]) * PRIME_2), 11) * PRIME_0;
+        }
+        // final avalanche so that every input bit affects every output bit
+        hash ^= hash >> 33;
+        hash *= PRIME_1;
+        hash ^= hash >> 29;
+        hash *= PRIME_2;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    private:
+        static constexpr size_t BLOCK_SIZE = 32;
+        static constexpr u64 PRIME_0 = 0x9E3779B185EBCA87ull;
+        static constexpr u64 PRIME_1 = 0xC2B2AE3D27D4EB4Full;
+        static constexpr u64 PRIME_2 = 0x165667B19E3779F9ull;
+
+        u64 lanes[4];
+        u64 total_size = 0;
+        std::byte buffer[BLOCK_SIZE] = {};
+        size_t buffered_size = 0;
+
+        auto consume_block(const std::byte * block) -> void
+        {
+            for(u32 lane = 0; lane < 4; lane++)
+            {
+                u64 word;
+                std::memcpy(&word, block + lane * sizeof(u64), sizeof(u64));
+                lanes[lane] = std::rotl(lanes[lane] + word * PRIME_1, 31) * PRIME_0;
+            }
+        }
+};
@@ -0,0 +1,387 @@
+#include "instanced_bvh.hpp"
+#include "parallel_for.hpp"
+
+#include <array>
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+static constexpr u32 TOP_LEVEL_BIN_COUNT = 16;
+
+auto InstancedBVH::construct(const ConstructInstancedBVHInfo & info) -> BVHStats
+{
+    BVHStats stats = BVHStats {
+        .triangle_count = 0,
+        .inner_node_count = 0,
+        .leaf_primitives_count = 0,
+        .leaf_count = 0,
+        .average_leaf_depth = 0.0f,
+        .average_primitives_in_leaf = 0.0f,
+        .max_tree_depth = 0u,
+        .total_cost = 0.0f,
+        .build_time = 0.0,
+        .quantized_memory_ratio = 0.0f,
+        .quantized_traversal_slowdown = 0.0f
+    };
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // meshes differ wildly in size so the threads pick the next mesh from a shared counter
+    bottom_levels.clear();
+    bottom_levels.resize(info.meshes.size());
+    std::vector<BVHStats> bottom_level_stats(info.meshes.size(), stats);
+    std::atomic<size_t> next_mesh = 0;
+    auto task = [&]()
+    {
+        for(size_t mesh_idx = next_mesh++; mesh_idx < info.meshes.size(); mesh_idx = next_mesh++)
+        {
+            if(info.meshes[mesh_idx].empty()) { continue; }
+            bottom_level_stats.at(mesh_idx) = bottom_levels.at(mesh_idx).construct_bvh_from_data(info.meshes[mesh_idx], info.bvh_info);
+        }
+    };
+    const size_t thread_count = glm::clamp(size_t(std::thread::hardware_concurrency()), size_t(1), glm::max(info.meshes.size(), size_t(1)));
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for(size_t i = 0; i < thread_count; i++)
+    {
+        threads.push_back(std::thread(task));
+    }
+    for(auto & thread : threads)
+    {
+        thread.join();
+    }
+
+    instances.clear();
+    instances.reserve(info.instances.size());
+    for(const auto & instance : info.instances)
+    {
+        auto & new_instance = instances.emplace_back(Instance{.mesh_index = instance.mesh_index});
+        update_instance(new_instance, instance.transform);
+    }
+    rebuild_top_level();
+
+    // The stats describe the bottom levels - every mesh is counted once no matter how many instances it has
+    // and the depths are measured from the roots of the bottom levels
+    f64 leaf_depth_sum = 0.0;
+    f64 memory_ratio_sum = 0.0;
+    f64 slowdown_sum = 0.0;
+    for(const auto & mesh_stats : bottom_level_stats)
+    {
+        stats.triangle_count += mesh_stats.triangle_count;
+        stats.inner_node_count += mesh_stats.inner_node_count;
+        stats.leaf_primitives_count += mesh_stats.leaf_primitives_count;
+        stats.leaf_count += mesh_stats.leaf_count;
+        stats.max_tree_depth = glm::max(stats.max_tree_depth, mesh_stats.max_tree_depth);
+        stats.total_cost += mesh_stats.total_cost;
+        leaf_depth_sum += f64(mesh_stats.average_leaf_depth) * f64(mesh_stats.leaf_count);
+        memory_ratio_sum += f64(mesh_stats.quantized_memory_ratio) * f64(mesh_stats.leaf_primitives_count);
+        slowdown_sum += f64(mesh_stats.quantized_traversal_slowdown) * f64(mesh_stats.leaf_primitives_count);
+    }
+    if(stats.leaf_count > 0)
+    {
+        stats.average_leaf_depth = f32(leaf_depth_sum / f64(stats.leaf_count));
+        stats.average_primitives_in_leaf = f32(stats.leaf_primitives_count) / f32(stats.leaf_count);
+        stats.quantized_memory_ratio = f32(memory_ratio_sum / f64(stats.leaf_primitives_count));
+        stats.quantized_traversal_slowdown = f32(slowdown_sum / f64(stats.leaf_primitives_count));
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+    stats.build_time = ms_double.count();
+    DEBUG_OUT("[InstancedBVH::construct()] " + std::to_string(info.meshes.size()) + " bottom levels, " +
+        std::to_string(instances.size()) + " instances, top level depth " + std::to_string(top_level_depth));
+    return stats;
+}
+
+auto InstancedBVH::update_instance(Instance & instance, const f32mat4x4 & transform) -> void
+{
+    instance.object_to_world = transform;
+    instance.world_to_object = glm::inverse(transform);
+    // normals transform with the inverse transpose
+    instance.normal_transform = glm::transpose(instance.world_to_object);
+
+    // world space bounds of the transformed corners of the object space bounds, empty meshes keep empty bounds
+    instance.world_bounds = AABB();
+    const AABB object_bounds = bottom_levels.at(instance.mesh_index).get_bounds();
+    if(object_bounds.min_bounds.x > object_bounds.max_bounds.x) { return; }
+    for(u32 corner = 0; corner < 8; corner++)
+    {
+        const f32vec3 object_corner = f32vec3(
+            (corner & 1u) != 0u ? object_bounds.max_bounds.x : object_bounds.min_bounds.x,
+            (corner & 2u) != 0u ? object_bounds.max_bounds.y : object_bounds.min_bounds.y,
+            (corner & 4u) != 0u ? object_bounds.max_bounds.z : object_bounds.min_bounds.z);
+        instance.world_bounds.expand_bounds(f32vec3(transform * f32vec4(object_corner, 1.0f)));
+    }
+}
+
+auto InstancedBVH::set_instance_transform(u32 instance_index, const f32mat4x4 & transform) -> void
+{
+    update_instance(instances.at(instance_index), transform);
+    // children are always stored after their parent so a reverse sweep refits every node after its children
+    for(size_t node_idx = top_level_nodes.size(); node_idx-- > 0;)
+    {
+        auto & node = top_level_nodes.at(node_idx);
+        if(node.left_index == -1)
+        {
+            node.bounding_box = instances.at(node.right_index).world_bounds;
+            continue;
+        }
+        node.bounding_box = top_level_nodes.at(node.left_index).bounding_box;
+        node.bounding_box.expand_bounds(top_level_nodes.at(node.right_index).bounding_box);
+    }
+}
+
+auto InstancedBVH::rebuild_top_level() -> void
+{
+    top_level_nodes.clear();
+    top_level_depth = 0;
+    // instances of empty meshes have nothing to hit
+    std::vector<u32> instance_indices;
+    instance_indices.reserve(instances.size());
+    for(u32 instance_idx = 0; instance_idx < instances.size(); instance_idx++)
+    {
+        const AABB & bounds = instances.at(instance_idx).world_bounds;
+        if(bounds.min_bounds.x <= bounds.max_bounds.x) { instance_indices.push_back(instance_idx); }
+    }
+    if(instance_indices.empty()) { return; }
+
+    top_level_nodes.reserve(instance_indices.size() * 2 - 1);
+    top_level_nodes.emplace_back();
+    top_level_depth = build_top_level_node(0, instance_indices, 0);
+}
+
+auto InstancedBVH::build_top_level_node(u32 node_idx, std::span<u32> instance_indices, u32 depth) -> u32
+{
+    AABB node_bounds;
+    AABB centroid_bounds;
+    for(u32 instance_idx : instance_indices)
+    {
+        const AABB & bounds = instances.at(instance_idx).world_bounds;
+        node_bounds.expand_bounds(bounds);
+        centroid_bounds.expand_bounds((bounds.min_bounds + bounds.max_bounds) * 0.5f);
+    }
+    top_level_nodes.at(node_idx).bounding_box = node_bounds;
+    if(instance_indices.size() == 1)
+    {
+        top_level_nodes.at(node_idx).left_index = -1;
+        top_level_nodes.at(node_idx).right_index = i32(instance_indices.front());
+        return depth;
+    }
+
+    auto get_bin = [&](u32 instance_idx, i32 axis) -> u32
+    {
+        const f32 centroid = instances.at(instance_idx).world_bounds.get_axis_centroid(static_cast<Axis>(axis));
+        const f32 extent = centroid_bounds.max_bounds[axis] - centroid_bounds.min_bounds[axis];
+        const f32 bin = (centroid - centroid_bounds.min_bounds[axis]) / extent * f32(TOP_LEVEL_BIN_COUNT);
+        return glm::min(u32(bin), TOP_LEVEL_BIN_COUNT - 1);
+    };
+
+    // binned SAH over the instance centroids - the best split separates the bins below best_bin from the rest
+    f32 best_cost = INFINITY;
+    i32 best_axis = -1;
+    u32 best_bin = 0;
+    for(i32 axis = Axis::X; axis < Axis::LAST; axis++)
+    {
+        if(centroid_bounds.max_bounds[axis] <= centroid_bounds.min_bounds[axis]) { continue; }
+
+        std::array<AABB, TOP_LEVEL_BIN_COUNT> bin_bounds = {};
+        std::array<u32, TOP_LEVEL_BIN_COUNT> bin_counts = {};
+        for(u32 instance_idx : instance_indices)
+        {
+            const u32 bin = get_bin(instance_idx, axis);
+            bin_bounds.at(bin).expand_bounds(instances.at(instance_idx).world_bounds);
+            bin_counts.at(bin)++;
+        }
+
+        std::array<f32, TOP_LEVEL_BIN_COUNT> right_areas = {};
+        std::array<u32, TOP_LEVEL_BIN_COUNT> right_counts = {};
+        AABB right_bounds;
+        u32 right_count = 0;
+        for(u32 bin = TOP_LEVEL_BIN_COUNT - 1; bin > 0; bin--)
+        {
+            right_bounds.expand_bounds(bin_bounds.at(bin));
+            right_count += bin_counts.at(bin);
+            right_areas.at(bin) = right_bounds.get_area();
+            right_counts.at(bin) = right_count;
+        }
+
+        AABB left_bounds;
+        u32 left_count = 0;
+        for(u32 bin = 1; bin < TOP_LEVEL_BIN_COUNT; bin++)
+        {
+            left_bounds.expand_bounds(bin_bounds.at(bin - 1));
+            left_count += bin_counts.at(bin - 1);
+            if(left_count == 0 || right_counts.at(bin) == 0) { continue; }
+            const f32 cost = left_bounds.get_area() * f32(left_count) + right_areas.at(bin) * f32(right_counts.at(bin));
+            if(cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = bin;
+            }
+        }
+    }
+
+    // when all of the centroids coincide the instances are split in half
+    size_t split = instance_indices.size() / 2;
+    if(best_axis != -1)
+    {
+        auto middle = std::partition(instance_indices.begin(), instance_indices.end(),
+            [&](u32 instance_idx) -> bool { return get_bin(instance_idx, best_axis) < best_bin; });
+        split = static_cast<size_t>(middle - instance_indices.begin());
+    }
+
+    // siblings are stored next to each other as in the bottom levels
+    const i32 left_idx = i32(top_level_nodes.size());
+    top_level_nodes.emplace_back();
+    top_level_nodes.emplace_back();
+    top_level_nodes.at(node_idx).left_index = left_idx;
+    top_level_nodes.at(node_idx).right_index = left_idx + 1;
+    return glm::max(
+        build_top_level_node(u32(left_idx), instance_indices.first(split), depth + 1),
+        build_top_level_node(u32(left_idx + 1), instance_indices.subspan(split), depth + 1));
+}
+
+auto InstancedBVH::intersect_instance(const Ray & ray, const Instance & instance, Hit & nearest_hit) const -> void
+{
+    // Ray normalizes its direction so the object space distances are scaled by the length of the
+    // transformed world space direction
+    const f32vec3 object_direction = f32vec3(instance.world_to_object * f32vec4(ray.direction, 0.0f));
+    const f32 object_scale = glm::length(object_direction);
+    if(object_scale == 0.0f) { return; }
+    const Ray object_ray = Ray(f32vec3(instance.world_to_object * f32vec4(ray.start, 1.0f)), object_direction);
+
+    Hit object_hit = Hit {
+        .hit = false,
+        .distance = nearest_hit.distance * object_scale,
+        .normal = f32vec3(0.0f, 0.0f, 0.0f),
+        .internal_fac = 1.0f,
+    };
+    bottom_levels.at(instance.mesh_index).update_nearest_intersection(object_ray, object_hit);
+    if(!object_hit.hit) { return; }
+
+    nearest_hit = Hit {
+        .hit = true,
+        .distance = object_hit.distance / object_scale,
+        .normal = glm::normalize(f32vec3(instance.normal_transform * f32vec4(object_hit.normal, 0.0f))),
+        .internal_fac = object_hit.internal_fac,
+    };
+}
+
+auto InstancedBVH::get_nearest_intersection(const Ray & ray) const -> Hit
+{
+    Hit nearest_hit = Hit {
+        .hit = false,
+        .distance = INFINITY,
+        .normal = f32vec3(0.0f, 0.0f, 0.0f),
+        .internal_fac = 1.0f,
+    };
+    if(top_level_nodes.empty()) { return nearest_hit; }
+
+    // Node consists of the top level node index and the intersection distance
+    using Node = std::pair<i32, f32>;
+    std::vector<Node> nodes_stack;
+    nodes_stack.reserve(top_level_depth + 1);
+
+    const auto root_hit = top_level_nodes.front().bounding_box.ray_box_intersection(ray);
+    if(!root_hit.hit) { return nearest_hit; }
+    nodes_stack.emplace_back(0, root_hit.distance * root_hit.internal_fac);
+    while(!nodes_stack.empty())
+    {
+        const auto [node_idx, intersect_distance] = nodes_stack.back();
+        nodes_stack.pop_back();
+        // the instance bounds are farther than the nearest hit found so far
+        if(intersect_distance > nearest_hit.distance) { continue; }
+
+        const auto & node = top_level_nodes[node_idx];
+        if(node.left_index == -1)
+        {
+            intersect_instance(ray, instances[node.right_index], nearest_hit);
+            continue;
+        }
+
+        const auto left_hit = top_level_nodes[node.left_index].bounding_box.ray_box_intersection(ray);
+        const auto right_hit = top_level_nodes[node.right_index].bounding_box.ray_box_intersection(ray);
+        const f32 left_distance = left_hit.distance * left_hit.internal_fac;
+        const f32 right_distance = right_hit.distance * right_hit.internal_fac;
+        // the farther child is pushed first so that the nearer one is traversed first
+        const bool left_first = !right_hit.hit || (left_hit.hit && left_distance < right_distance);
+        if(left_first)
+        {
+            if(right_hit.hit) { nodes_stack.emplace_back(node.right_index, right_distance); }
+            if(left_hit.hit) { nodes_stack.emplace_back(node.left_index, left_distance); }
+        }
+        else
+        {
+            if(left_hit.hit) { nodes_stack.emplace_back(node.left_index, left_distance); }
+            nodes_stack.emplace_back(node.right_index, right_distance);
+        }
+    }
+    return nearest_hit;
+}
+
+auto InstancedBVH::intersect(std::span<const Ray> rays, std::span<Hit> hits, const BatchTraceInfo & info) const -> void
+{
+    assert(rays.size() == hits.size());
+    run_in_chunks(rays.size(), info.thread_count, 1, [&](size_t start, size_t size)
+    {
+        for(size_t ray_idx = start; ray_idx < start + size; ray_idx++)
+        {
+            hits[ray_idx] = get_nearest_intersection(rays[ray_idx]);
+        }
+    });
+}
+
+auto InstancedBVH::get_bvh_visualization_data() const -> std::vector<BVHVisualizationInfo>
+{
+    std::vector<BVHVisualizationInfo> info;
+    info.reserve(top_level_nodes.size());
+    if(top_level_nodes.empty()) { return info; }
+
+    // Node consists of the top level node index and its depth
+    using Node = std::pair<i32, u32>;
+    std::queue<Node> que;
+    que.push({0, 0u});
+    while(!que.empty())
+    {
+        const auto [node_idx, depth] = que.front();
+        que.pop();
+        const auto & node = top_level_nodes.at(node_idx);
+        info.emplace_back(BVHVisualizationInfo{
+            .position = node.bounding_box.min_bounds,
+            .scale = node.bounding_box.max_bounds - node.bounding_box.min_bounds,
+            .depth = depth,
+#ifdef VISUALIZE_SPATIAL_SPLITS
+            .spatial = 0u
+#endif
+        });
+        if(node.left_index != -1)
+        {
+            que.push({node.left_index, depth + 1u});
+            que.push({node.right_index, depth + 1u});
+        }
+    }
+    return info;
+}
+
+auto InstancedBVH::get_memory_footprint() const -> BVHMemoryFootprint
+{
+    BVHMemoryFootprint footprint = BVHMemoryFootprint{
+        .nodes = top_level_nodes.size() * sizeof(InstanceBVHNode),
+        .leaves = instances.size() * sizeof(Instance),
+        .stackless_links = 0,
+        .quantized_leaves = 0,
+        .triangles = 0
+    };
+    for(const auto & bottom_level : bottom_levels)
+    {
+        const auto bottom_level_footprint = bottom_level.get_memory_footprint();
+        footprint.nodes += bottom_level_footprint.nodes;
+        footprint.leaves += bottom_level_footprint.leaves;
+        footprint.stackless_links += bottom_level_footprint.stackless_links;
+        footprint.quantized_leaves += bottom_level_footprint.quantized_leaves;
+        footprint.triangles += bottom_level_footprint.triangles;
+    }
+    return footprint;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "../types.hpp"
+#include "triangle.hpp"
+#include "bvh.hpp"
+
+// Placement of a mesh in the scene - the mesh triangles are in object space and transform maps them into world space
+struct BVHInstance
+{
+    f32mat4x4 transform;
+    u32 mesh_index;
+};
+
+struct ConstructInstancedBVHInfo
+{
+    // object space triangles of every mesh - a single bottom level BVH is built per mesh no matter how often it is instanced
+    std::span<const IndexedTriangles> meshes;
+    std::span<const BVHInstance> instances;
+    // build parameters of the bottom level BVHs, the top level is always a binned object split BVH
+    const ConstructBVHInfo & bvh_info;
+};
+
+// Node of the top level BVH over the world space instance bounds. Encoded the same way as BVHNode except that
+// every leaf holds exactly one instance - right_index of a leaf is the index of the instance
+struct InstanceBVHNode
+{
+    AABB bounding_box;
+    i32 left_index{};
+    i32 right_index{};
+};
+
+// Two level acceleration structure - bottom level BVHs built once per mesh in object space and a top level BVH
+// over the world space bounds of the instances. Rays are transformed into the object space of every instance
+// the top level traversal reaches, so a mesh instanced many times is stored and built only once and moving
+// an instance only touches the top level
+struct InstancedBVH
+{
+    // the bottom level BVHs reference the mesh triangles so they must outlive the instanced BVH
+    auto construct(const ConstructInstancedBVHInfo & info) -> BVHStats;
+    // Moves the instance and refits the top level bounds - cheap but the top level quality degrades when
+    // instances move far, rebuild_top_level rebuilds it from the current instance bounds
+    auto set_instance_transform(u32 instance_index, const f32mat4x4 & transform) -> void;
+    auto rebuild_top_level() -> void;
+
+    [[nodiscard]] auto get_nearest_intersection(const Ray & ray) const -> Hit;
+    // Every ray walks the top level on its own - the batch kernels of the bottom levels are not used so
+    // the kernel of the BatchTraceInfo is ignored and only its thread count is used
+    auto intersect(std::span<const Ray> rays, std::span<Hit> hits, const BatchTraceInfo & info = {}) const -> void;
+    // world space bounds of the top level nodes
+    [[nodiscard]] auto get_bvh_visualization_data() const -> std::vector<BVHVisualizationInfo>;
+    // the instances are counted as top level leaves
+    [[nodiscard]] auto get_memory_footprint() const -> BVHMemoryFootprint;
+
+    private:
+        struct Instance
+        {
+            f32mat4x4 object_to_world;
+            f32mat4x4 world_to_object;
+            f32mat4x4 normal_transform;
+            AABB world_bounds;
+            u32 mesh_index;
+        };
+
+        std::vector<BVH> bottom_levels;
+        std::vector<Instance> instances;
+        std::vector<InstanceBVHNode> top_level_nodes;
+        u32 top_level_depth = 0;
+
+        auto update_instance(Instance & instance, const f32mat4x4 & transform) -> void;
+        // builds the subtree of the node over the passed instances and returns its maximum depth
+        auto build_top_level_node(u32 node_idx, std::span<u32> instance_indices, u32 depth) -> u32;
+        auto intersect_instance(const Ray & ray, const Instance & instance, Hit & nearest_hit) const -> void;
+};
@@ -0,0 +1,89 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "../utils.hpp"
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string & path)
+{
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        DEBUG_OUT("[MappedFile::MappedFile()] could not open " + path);
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) { return; }
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping_handle == nullptr) { return; }
+
+    const void * view = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if(view == nullptr) { return; }
+
+    data = static_cast<const std::byte *>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    if(data != nullptr) { UnmapViewOfFile(data); }
+    if(mapping_handle != nullptr) { CloseHandle(mapping_handle); }
+    if(file_handle != nullptr) { CloseHandle(file_handle); }
+}
+#else
+MappedFile::MappedFile(const std::string & path)
+{
+    const int file_descriptor = open(path.c_str(), O_RDONLY);
+    if(file_descriptor == -1)
+    {
+        DEBUG_OUT("[MappedFile::MappedFile()] could not open " + path);
+        return;
+    }
+
+    struct stat file_stat = {};
+    if(fstat(file_descriptor, &file_stat) == 0 && file_stat.st_size > 0)
+    {
+        void * mapping = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        if(mapping != MAP_FAILED)
+        {
+            data = static_cast<const std::byte *>(mapping);
+            size = static_cast<size_t>(file_stat.st_size);
+        }
+    }
+    // NOTE(msakmary) the mapping stays valid after the descriptor is closed
+    close(file_descriptor);
+}
+
+MappedFile::~MappedFile()
+{
+    if(data != nullptr) { munmap(const_cast<std::byte *>(data), size); }
+}
+#endif
+
+auto MappedFile::is_valid() const -> bool
+{
+    return data != nullptr;
+}
+
+auto MappedFile::get_data() const -> const std::byte *
+{
+    return data;
+}
+
+auto MappedFile::get_size() const -> size_t
+{
+    return size;
+}
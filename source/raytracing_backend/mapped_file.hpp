@@ -0,0 +1,45 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Read only memory mapping of a whole file. The mapping is released when the object is destroyed
+struct MappedFile
+{
+    explicit MappedFile(const std::string & path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+    // false if the file could not be opened or mapped
+    [[nodiscard]] auto is_valid() const -> bool;
+    [[nodiscard]] auto get_data() const -> const std::byte *;
+    [[nodiscard]] auto get_size() const -> size_t;
+
+    // Typed view of count elements stored at offset. Sets valid to false and returns an empty span
+    // if the elements do not fit into the file or the offset is not aligned for T
+    template<typename T>
+    [[nodiscard]] auto get_span(uint64_t offset, uint64_t count, bool & valid) const -> std::span<const T>
+    {
+        const bool fits =
+            offset % alignof(T) == 0 &&
+            offset <= size &&
+            count <= (size - offset) / sizeof(T);
+        if(!fits)
+        {
+            valid = false;
+            return {};
+        }
+        return std::span<const T>(reinterpret_cast<const T *>(data + offset), count);
+    }
+
+    private:
+        const std::byte * data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        void * file_handle = nullptr;
+        void * mapping_handle = nullptr;
+#endif
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#include "../types.hpp"
+
+// Calls the function for every index in [0, count) split into contiguous chunks over the hardware threads. Counts
+// below min_parallel_count run on the calling thread, spawning threads costs more than they save there
+template<typename Function>
+auto parallel_for(size_t count, size_t min_parallel_count, const Function & function) -> void
+{
+    const size_t thread_count = glm::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+    if(count < min_parallel_count || thread_count == 1)
+    {
+        for(size_t i = 0; i < count; i++) { function(i); }
+        return;
+    }
+
+    const size_t chunk = (count + thread_count - 1) / thread_count;
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for(size_t start = 0; start < count; start += chunk)
+    {
+        threads.push_back(std::thread([&function, start, end = glm::min(start + chunk, count)]()
+        {
+            for(size_t i = start; i < end; i++) { function(i); }
+        }));
+    }
+    for(auto & thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Splits [0, count) into thread_count contiguous chunks aligned to chunk_alignment and runs the kernel on each of them
+// in a separate thread. The kernel receives the start and size of its chunk
+template<typename Kernel>
+auto run_in_chunks(size_t count, u32 thread_count, size_t chunk_alignment, const Kernel & kernel) -> void
+{
+    const size_t aligned_count = (count + chunk_alignment - 1) / chunk_alignment;
+    thread_count = static_cast<u32>(glm::clamp(size_t(thread_count), size_t(1), glm::max(aligned_count, size_t(1))));
+    if(thread_count == 1)
+    {
+        kernel(size_t(0), count);
+        return;
+    }
+
+    const size_t chunk = ((aligned_count + thread_count - 1) / thread_count) * chunk_alignment;
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for(size_t start = 0; start < count; start += chunk)
+    {
+        threads.push_back(std::thread(kernel, start, glm::min(chunk, count - start)));
+    }
+    for(auto & thread : threads)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,52 @@
+#include "ray_capture.hpp"
+
+#include <fstream>
+#include <cstring>
+
+#include "../utils.hpp"
+
+struct RayCaptureHeader
+{
+    char magic[8];
+    u32 version;
+    u32 ray_size;
+    u64 ray_count;
+};
+
+auto save_ray_capture(const std::string & path, std::span<const CapturedRay> rays) -> bool
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file.is_open()) { return false; }
+
+    RayCaptureHeader header = {
+        .magic = {},
+        .version = RAY_CAPTURE_VERSION,
+        .ray_size = sizeof(CapturedRay),
+        .ray_count = rays.size()
+    };
+    std::memcpy(header.magic, RAY_CAPTURE_MAGIC, sizeof(RAY_CAPTURE_MAGIC));
+    file.write(reinterpret_cast<const char *>(&header), sizeof(RayCaptureHeader));
+    file.write(reinterpret_cast<const char *>(rays.data()), static_cast<std::streamsize>(rays.size_bytes()));
+    return file.good();
+}
+
+auto load_ray_capture(const std::string & path, std::vector<CapturedRay> & rays) -> bool
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()) { return false; }
+
+    RayCaptureHeader header = {};
+    file.read(reinterpret_cast<char *>(&header), sizeof(RayCaptureHeader));
+    if(!file.good() ||
+       std::memcmp(header.magic, RAY_CAPTURE_MAGIC, sizeof(RAY_CAPTURE_MAGIC)) != 0 ||
+       header.version != RAY_CAPTURE_VERSION ||
+       header.ray_size != sizeof(CapturedRay))
+    {
+        DEBUG_OUT("[load_ray_capture()] " + path + " is not a valid ray capture file");
+        return false;
+    }
+
+    rays.resize(header.ray_count);
+    file.read(reinterpret_cast<char *>(rays.data()), static_cast<std::streamsize>(rays.size() * sizeof(CapturedRay)));
+    return file.good();
+}
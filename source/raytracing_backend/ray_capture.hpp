@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+
+#include "../types.hpp"
+
+enum RayKind : u32
+{
+    PRIMARY = 0,
+    // shadow rays only care whether anything is hit inside of the ray interval
+    SHADOW = 1,
+};
+
+// Single captured ray together with the reference hit the render got for it. The struct is written
+// into the capture file as is so it is made out of 4 byte fields only and must not contain any padding
+struct CapturedRay
+{
+    f32vec3 start;
+    // stored exactly as traced - the direction is not renormalized when the ray is replayed
+    f32vec3 direction;
+    f32 t_min;
+    f32 t_max;
+    u32 kind;
+    // reference result
+    u32 hit;
+    f32 distance;
+    f32vec3 normal;
+
+    // reconstructs the ray bit for bit, Ray constructor would otherwise normalize the direction again
+    [[nodiscard]] inline auto get_ray() const -> Ray
+    {
+        Ray ray = Ray(start, direction);
+        ray.direction = direction;
+        return ray;
+    }
+};
+static_assert(sizeof(CapturedRay) == 14 * sizeof(f32), "CapturedRay must be tightly packed");
+
+// Ray capture file layout:
+//      header - magic "SBVHRAYS", u32 version, u32 size of CapturedRay, u64 ray count
+//      ray count x CapturedRay
+static constexpr char RAY_CAPTURE_MAGIC[8] = {'S', 'B', 'V', 'H', 'R', 'A', 'Y', 'S'};
+static constexpr u32 RAY_CAPTURE_VERSION = 1;
+
+// returns false if the file could not be written
+auto save_ray_capture(const std::string & path, std::span<const CapturedRay> rays) -> bool;
+// returns false if the file could not be read or is not a ray capture of the current version
+auto load_ray_capture(const std::string & path, std::vector<CapturedRay> & rays) -> bool;
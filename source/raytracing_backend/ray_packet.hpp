@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+#include "../types.hpp"
+
+static constexpr u32 PACKET_WIDTH = 4;
+static constexpr u32 PACKET_SIZE = PACKET_WIDTH * PACKET_WIDTH;
+
+// Packet of up to PACKET_SIZE coherent rays (one PACKET_WIDTH x PACKET_WIDTH pixel block) which are traced
+// through the BVH together. Ray data is stored as a structure of arrays indexed by [axis][lane] so that
+// the per lane loops in the packet traversal kernel can be vectorized by the compiler
+struct RayPacket
+{
+    using Lanes = std::array<f32, PACKET_SIZE>;
+
+    std::array<Lanes, 3> start;
+    std::array<Lanes, 3> direction;
+    std::array<Lanes, 3> inverted_direction;
+    // bit i is set when lane i holds a valid ray
+    u32 active_mask = 0u;
+
+    // Interval bounds of the ray origins and inverted directions over all active lanes. These are used
+    // for conservative interval arithmetic culling of whole nodes. The intervals are only valid when the
+    // inverted directions of all active rays are finite and have the same sign in every axis
+    f32vec3 start_min;
+    f32vec3 start_max;
+    f32vec3 inverted_direction_min;
+    f32vec3 inverted_direction_max;
+    bool intervals_valid = false;
+
+    inline auto set_ray(u32 lane, const Ray & ray) -> void
+    {
+        for(i32 axis = 0; axis < 3; axis++)
+        {
+            start[axis][lane] = ray.start[axis];
+            direction[axis][lane] = ray.direction[axis];
+            inverted_direction[axis][lane] = 1.0f / ray.direction[axis];
+        }
+        active_mask |= 1u << lane;
+    }
+
+    [[nodiscard]] inline auto get_ray(u32 lane) const -> Ray
+    {
+        const f32vec3 ray_direction = {direction[0][lane], direction[1][lane], direction[2][lane]};
+        Ray ray = Ray({start[0][lane], start[1][lane], start[2][lane]}, ray_direction);
+        // the stored direction is already normalized, don't let the renormalization change it
+        ray.direction = ray_direction;
+        return ray;
+    }
+
+    // Must be called after all rays were set and before the packet is traced
+    inline auto compute_intervals() -> void
+    {
+        start_min = f32vec3(INFINITY);
+        start_max = f32vec3(-INFINITY);
+        inverted_direction_min = f32vec3(INFINITY);
+        inverted_direction_max = f32vec3(-INFINITY);
+        intervals_valid = active_mask != 0u;
+
+        for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            if((active_mask & (1u << lane)) == 0u) { continue; }
+            for(i32 axis = 0; axis < 3; axis++)
+            {
+                start_min[axis] = glm::min(start_min[axis], start[axis][lane]);
+                start_max[axis] = glm::max(start_max[axis], start[axis][lane]);
+                inverted_direction_min[axis] = glm::min(inverted_direction_min[axis], inverted_direction[axis][lane]);
+                inverted_direction_max[axis] = glm::max(inverted_direction_max[axis], inverted_direction[axis][lane]);
+            }
+        }
+
+        for(i32 axis = 0; axis < 3; axis++)
+        {
+            const bool finite = std::isfinite(inverted_direction_min[axis]) && std::isfinite(inverted_direction_max[axis]);
+            const bool same_sign = inverted_direction_min[axis] > 0.0f || inverted_direction_max[axis] < 0.0f;
+            if(!finite || !same_sign) { intervals_valid = false; }
+        }
+    }
+};
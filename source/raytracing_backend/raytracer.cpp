@@ -48,21 +48,88 @@ auto Raytracer::update_resolution(u32vec2 new_resolution) -> void
     color_buffer.resize(new_resolution.x * new_resolution.y * 3);
 }
 
+auto Raytracer::set_track_traversal_steps(bool track) -> void
+{
+    track_traversal_steps = track;
+}
+
+auto Raytracer::set_traversal_mode(TraversalMode mode) -> void
+{
+    traversal_mode = mode;
+}
+
+auto Raytracer::set_packet_interval_culling(bool enable) -> void
+{
+    packet_interval_culling = enable;
+}
+
+auto Raytracer::set_capture_rays(bool capture) -> void
+{
+    capture_rays = capture;
+}
+
+auto Raytracer::get_captured_rays() const -> const std::vector<CapturedRay> &
+{
+    return captured_rays;
+}
+
+auto Raytracer::get_traversal_step_stats() const -> const TraversalStepStats &
+{
+    return traversal_step_stats;
+}
+
+auto Raytracer::set_export_path(const std::string & path) -> void
+{
+    export_path = path;
+}
+
+auto Raytracer::set_thread_count(u32 count) -> void
+{
+    thread_count = glm::max(count, 1u);
+}
+
 auto Raytracer::export_image() -> void
 {
-    stbi_write_hdr("out.hdr", resolution.x, resolution.y, 3, reinterpret_cast<float*>(color_buffer.data()));
+    stbi_write_hdr(export_path.c_str(), resolution.x, resolution.y, 3, reinterpret_cast<float*>(color_buffer.data()));
 }
 
 auto Raytracer::raytrace_scene(const Scene & scene, const Camera & camera) -> f64
 {
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-    avg_traversal_steps = 0.0f;
-#endif
+    traversal_step_stats = TraversalStepStats{};
     // const int num_threads = std::thread::hardware_concurrency() * 2;
-    const int num_threads = 1;
+    captured_rays.clear();
+    // NOTE(msakmary) the traversal step counters and the ray capture are shared so instrumented
+    // and capturing renders are single threaded - this also keeps the captured ray order deterministic
+    const int num_threads = (track_traversal_steps || capture_rays) ? 1 : i32(thread_count);
     std::vector<std::thread> threads;
 
     auto task = [&](int start, int end){
+        // NOTE(msakmary) instanced scenes walk the top level BVH ray by ray so every mode traces single rays
+        if(scene.raytracing_scene.is_instanced() && traversal_mode != TraversalMode::SINGLE_RAY)
+        {
+            batch_ray_gen(scene, camera, start, end, BatchKernel::SINGLE_RAY);
+            return;
+        }
+        if(traversal_mode == TraversalMode::PACKET)
+        {
+            packet_ray_gen(scene, camera, start, end);
+            return;
+        }
+        if(traversal_mode == TraversalMode::STREAM)
+        {
+            batch_ray_gen(scene, camera, start, end, BatchKernel::STREAM);
+            return;
+        }
+        if(traversal_mode == TraversalMode::INTERLEAVED)
+        {
+            batch_ray_gen(scene, camera, start, end, BatchKernel::INTERLEAVED);
+            return;
+        }
+        if(traversal_mode == TraversalMode::STACKLESS)
+        {
+            batch_ray_gen(scene, camera, start, end, BatchKernel::STACKLESS);
+            return;
+        }
         for(int y = start; y < end; y++)
         {
             for(uint32_t x = 0; x < resolution.x; x++)
@@ -95,13 +162,14 @@ auto Raytracer::raytrace_scene(const Scene & scene, const Camera & camera) -> f6
     std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
     export_image();
 
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-    DEBUG_OUT(
-        "min traversal steps: " + std::to_string(min_traversal_steps) +
-        " max traversal steps: " + std::to_string(max_traversal_steps) +
-        " avg traversal steps: " + std::to_string(avg_traversal_steps)
-    );
-#endif
+    if(track_traversal_steps && traversal_mode == TraversalMode::SINGLE_RAY)
+    {
+        DEBUG_OUT(
+            "min traversal steps: " + std::to_string(traversal_step_stats.min_traversal_steps) +
+            " max traversal steps: " + std::to_string(traversal_step_stats.max_traversal_steps) +
+            " avg traversal steps: " + std::to_string(traversal_step_stats.avg_traversal_steps)
+        );
+    }
     return ms_double.count();
 }
 
@@ -123,17 +191,92 @@ auto Raytracer::phong(const PhongInfo & info) -> f32vec3
 }
 
 
+auto Raytracer::packet_ray_gen(const Scene & scene, const Camera & camera, i32 start_row, i32 end_row) -> void
+{
+    // trace the rows in blocks of PACKET_WIDTH x PACKET_WIDTH pixels, blocks on the image border
+    // are only partially filled and have the lanes outside of the image inactive
+    for(i32 block_y = start_row; block_y < end_row; block_y += PACKET_WIDTH)
+    {
+        for(u32 block_x = 0; block_x < resolution.x; block_x += PACKET_WIDTH)
+        {
+            RayPacket packet = {};
+            for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                const u32 x = block_x + lane % PACKET_WIDTH;
+                const i32 y = block_y + i32(lane / PACKET_WIDTH);
+                if(x >= resolution.x || y >= end_row) { continue; }
+                packet.set_ray(lane, camera.get_ray({x, u32(y)}, resolution));
+            }
+            packet.compute_intervals();
+
+            const auto hits = scene.raytracing_scene.bvh.get_nearest_intersections({
+                .packet = packet,
+                .interval_culling = packet_interval_culling,
+                .min_active_rays = PACKET_SIZE / 4
+            });
+
+            for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                if((packet.active_mask & (1u << lane)) == 0u) { continue; }
+                const u32 x = block_x + lane % PACKET_WIDTH;
+                const u32 y = u32(block_y) + lane / PACKET_WIDTH;
+                f32vec3 color = shade(scene, packet.get_ray(lane), hits.at(lane));
+                //NOTE(msakmary) flip the image along the X axis (so it's not upside down)
+                color_buffer.at((resolution.y - y - 1) * resolution.x + x) = color; 
+            }
+        }
+    }
+}
+
+auto Raytracer::batch_ray_gen(const Scene & scene, const Camera & camera, i32 start_row, i32 end_row, BatchKernel kernel) -> void
+{
+    std::vector<Ray> rays;
+    rays.reserve(static_cast<size_t>(end_row - start_row) * resolution.x);
+    for(i32 y = start_row; y < end_row; y++)
+    {
+        for(u32 x = 0; x < resolution.x; x++)
+        {
+            rays.push_back(camera.get_ray({x, u32(y)}, resolution));
+        }
+    }
+
+    std::vector<Hit> hits(rays.size());
+    scene.raytracing_scene.intersect(rays, hits, {.kernel = kernel});
+
+    for(size_t i = 0; i < rays.size(); i++)
+    {
+        const u32 x = u32(i % resolution.x);
+        const u32 y = u32(start_row) + u32(i / resolution.x);
+        //NOTE(msakmary) flip the image along the X axis (so it's not upside down)
+        color_buffer.at((resolution.y - y - 1) * resolution.x + x) = shade(scene, rays.at(i), hits.at(i)); 
+    }
+}
+
 auto Raytracer::ray_gen(const Scene & scene, const Ray & ray) -> f32vec3
 {
-    const f32vec3 light_position = scene.light_position;
-    auto hit = trace_ray(scene, ray);
+    Hit hit;
+    // the traversal steps are only counted by the flattened scene BVH
+    if(track_traversal_steps && !scene.raytracing_scene.is_instanced())
+    {
+        TraversalStats stats{};
+        hit = scene.raytracing_scene.bvh.get_nearest_intersection(ray, stats);
+        const i32 traversal_steps = stats.get_traversal_steps();
+        traversal_step_stats.avg_traversal_steps += f32(traversal_steps) / f32(resolution.x * resolution.y);
+        traversal_step_stats.min_traversal_steps = glm::min(traversal_step_stats.min_traversal_steps, traversal_steps);
+        traversal_step_stats.max_traversal_steps = glm::max(traversal_step_stats.max_traversal_steps, traversal_steps);
+    } 
+    else 
+    {
+        hit = trace_ray(scene, ray);
+    }
 
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-    avg_traversal_steps += f32(hit.traversal_steps) / f32(resolution.x * resolution.y);
-    min_traversal_steps = glm::min(min_traversal_steps, hit.traversal_steps);
-    max_traversal_steps = glm::max(max_traversal_steps, hit.traversal_steps);
-#endif
+    return shade(scene, ray, hit);
+}
 
+auto Raytracer::shade(const Scene & scene, const Ray & ray, const Hit & hit) -> f32vec3
+{
+    const f32vec3 light_position = scene.light_position;
+    if(capture_rays) { capture_ray(ray, RayKind::PRIMARY, INFINITY, hit); }
     if(!hit.hit) 
     {
         return f32vec3(0.0f, 0.0f, 0.0f);
@@ -142,18 +285,17 @@ auto Raytracer::ray_gen(const Scene & scene, const Ray & ray) -> f32vec3
     {
         return (hit.normal + f32vec3(1.0f)) * 0.5f;
     }
-#ifdef TRACK_TRAVERSE_STEP_COUNT
     // else 
     // {
-    //     return get_pseudocolor_cool_warm(hit.traversal_steps, 30, 150);
+    //     return get_pseudocolor_cool_warm(traversal_steps, 30, 150);
     // }
-#endif
 
 
     auto hit_position = ray.start + (ray.direction * hit.distance) + (0.005f * hit.normal);
     Ray to_light = Ray(hit_position, light_position - hit_position);
     f32 distance_to_light = glm::distance(hit_position, light_position);
     auto shadow_hit = trace_ray(scene, to_light);
+    if(capture_rays) { capture_ray(to_light, RayKind::SHADOW, distance_to_light * 0.98f, shadow_hit); }
 
     // is in shadow
     if(shadow_hit.distance > 0.0f && shadow_hit.distance < distance_to_light * 0.98f)
@@ -172,5 +314,19 @@ auto Raytracer::ray_gen(const Scene & scene, const Ray & ray) -> f32vec3
 auto Raytracer::trace_ray(const Scene & scene, const Ray & ray) -> Hit
 {
     Hit closest_hit {};
-    return scene.raytracing_scene.bvh.get_nearest_intersection(ray);
-}
\ No newline at end of file
+    return scene.raytracing_scene.get_nearest_intersection(ray);
+}
+
+auto Raytracer::capture_ray(const Ray & ray, RayKind kind, f32 t_max, const Hit & hit) -> void
+{
+    captured_rays.push_back(CapturedRay{
+        .start = ray.start,
+        .direction = ray.direction,
+        .t_min = 0.0f,
+        .t_max = t_max,
+        .kind = kind,
+        .hit = hit.hit ? 1u : 0u,
+        .distance = hit.distance,
+        .normal = hit.normal
+    });
+}
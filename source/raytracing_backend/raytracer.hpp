@@ -1,7 +1,10 @@
+#pragma once
+
 #include "../types.hpp"
 #include "../utils.hpp"
 #include "../rendering_backend/camera.hpp"
 #include "scene.hpp"
+#include "ray_capture.hpp"
 
 struct PhongInfo{
     f32vec3 light_position;
@@ -10,6 +13,26 @@ struct PhongInfo{
     const Ray & ray;
 };
 
+struct TraversalStepStats
+{
+    f32 avg_traversal_steps = 0.0f;
+    i32 max_traversal_steps = 0;
+    i32 min_traversal_steps = INT32_MAX;
+};
+
+enum TraversalMode : i32
+{
+    SINGLE_RAY = 0,
+    // primary rays are traced in blocks of PACKET_WIDTH x PACKET_WIDTH pixels
+    PACKET = 1,
+    // all primary rays of a thread are traced together as one stream, the whole stream walks the tree depth first
+    STREAM = 2,
+    // the traversals of several primary rays are interleaved to hide memory latency
+    INTERLEAVED = 3,
+    // single ray traversal using parent and sibling links instead of a traversal stack
+    STACKLESS = 4,
+};
+
 struct Raytracer
 {
     std::vector<f32vec3> color_buffer;
@@ -17,17 +40,37 @@ struct Raytracer
     Raytracer(const u32vec2 resolution);
     auto raytrace_scene(const Scene & scene, const Camera & camera) -> f64;
     auto export_image() -> void;
+    // path of the HDR image written by export_image after every raytrace_scene call
+    auto set_export_path(const std::string & path) -> void;
+    auto set_thread_count(u32 count) -> void;
     auto update_resolution(u32vec2 resolution) -> void;
+    // when enabled primary rays are traced with the instrumented traversal kernel
+    // this is only supported by the single ray traversal mode
+    auto set_track_traversal_steps(bool track) -> void;
+    auto set_traversal_mode(TraversalMode mode) -> void;
+    auto set_packet_interval_culling(bool enable) -> void;
+    // when enabled every ray traced by raytrace_scene is recorded together with its hit result
+    auto set_capture_rays(bool capture) -> void;
+    // rays captured by the last raytrace_scene call, in the order they were traced
+    [[nodiscard]] auto get_captured_rays() const -> const std::vector<CapturedRay> &;
+    [[nodiscard]] auto get_traversal_step_stats() const -> const TraversalStepStats &;
     private: 
-#ifdef TRACK_TRAVERSE_STEP_COUNT
-    f32 avg_traversal_steps = 0.0f;
-    i32 max_traversal_steps = 0;
-    i32 min_traversal_steps = INT32_MAX;
-#endif
+        bool track_traversal_steps = false;
+        std::string export_path = "out.hdr";
+        u32 thread_count = 1;
+        bool packet_interval_culling = true;
+        bool capture_rays = false;
+        std::vector<CapturedRay> captured_rays;
+        TraversalMode traversal_mode = TraversalMode::SINGLE_RAY;
+        TraversalStepStats traversal_step_stats;
         u32vec2 resolution;
 
         auto ray_gen(const Scene & scene, const Ray & ray) -> f32vec3;
+        auto packet_ray_gen(const Scene & scene, const Camera & camera, i32 start_row, i32 end_row) -> void;
+        auto batch_ray_gen(const Scene & scene, const Camera & camera, i32 start_row, i32 end_row, BatchKernel kernel) -> void;
+        auto shade(const Scene & scene, const Ray & ray, const Hit & hit) -> f32vec3;
         auto trace_ray(const Scene & scene, const Ray & ray) -> Hit;
+        auto capture_ray(const Ray & ray, RayKind kind, f32 t_max, const Hit & hit) -> void;
         auto phong(const PhongInfo & info) -> f32vec3;
 };
 
@@ -1,13 +1,16 @@
 #include "scene.hpp"
 
 #include <stack>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <string>
 
 void Scene::process_mesh(const ProcessMeshInfo & info)
 {
-    auto & new_mesh = info.object.meshes.emplace_back(RuntimeMesh{});
+    auto & new_mesh = info.runtime_mesh;
     new_mesh.vertices.reserve(info.mesh->mNumVertices);
-    new_mesh.indices.reserve(static_cast<std::vector<u32>::size_type>(info.mesh->mNumFaces) * 3); // expect triangles
+    f32mat4x4 m_model = info.transform;
     for(u32 vertex = 0; vertex < info.mesh->mNumVertices; vertex++)
     {
         f32vec3 pre_transform_position{ 
@@ -26,51 +29,25 @@ void Scene::process_mesh(const ProcessMeshInfo & info)
             .position = pre_transform_position,
             .normal = pre_transform_normal,
         });
-    }
 
-    raytracing_scene.primitives.reserve(raytracing_scene.primitives.size() + info.mesh->mNumFaces);
-    f32mat4x4 m_model = info.object.transform;
+        // Raytracing data - every mesh writes only into its own ranges of the preallocated positions and indices
+        raytracing_scene.positions[info.first_vertex + vertex] = m_model * f32vec4(pre_transform_position, 1.0f);
+    }
 
+    new_mesh.first_index = static_cast<u32>(info.first_index);
+    new_mesh.index_count = info.mesh->mNumFaces * 3;
     // NOTE(msakmary) I am assuming triangles here
     for(u32 face = 0; face < info.mesh->mNumFaces; face++)
     {
         aiFace face_obj = info.mesh->mFaces[face];
-
-        new_mesh.indices.emplace_back(face_obj.mIndices[0]);
-        new_mesh.indices.emplace_back(face_obj.mIndices[1]);
-        new_mesh.indices.emplace_back(face_obj.mIndices[2]);
-
-        const auto v0 = info.mesh->mVertices[face_obj.mIndices[0]];
-        const auto v1 = info.mesh->mVertices[face_obj.mIndices[1]];
-        const auto v2 = info.mesh->mVertices[face_obj.mIndices[2]];
-            
-        f32vec4 pre_transform_v0{ v0.x, v0.y, v0.z, 1.0f };
-        f32vec4 pre_transform_v1{ v1.x, v1.y, v1.z, 1.0f };
-        f32vec4 pre_transform_v2{ v2.x, v2.y, v2.z, 1.0f };
-
-        f32vec3 post_transform_v0 = m_model * pre_transform_v0;
-        f32vec3 post_transform_v1 = m_model * pre_transform_v1;
-        f32vec3 post_transform_v2 = m_model * pre_transform_v2;
-
-        f32vec3 normal{
-            glm::normalize(
-                glm::cross(
-                    post_transform_v1 - post_transform_v0, 
-                    post_transform_v2 - post_transform_v0
-                )
-            )
-        };
-        // Raytracing data
-        raytracing_scene.primitives.emplace_back(Triangle{
-            .v0 = post_transform_v0,
-            .v1 = post_transform_v1,
-            .v2 = post_transform_v2,
-            .normal = normal
-        });
+        for(u32 corner = 0; corner < 3; corner++)
+        {
+            raytracing_scene.indices[info.first_index + face * 3 + corner] = static_cast<u32>(info.first_vertex + face_obj.mIndices[corner]);
+        }
     }
 }
 
-void Scene::process_scene(const aiScene * scene)
+void Scene::process_scene(const aiScene * scene, SceneGeometry geometry)
 {
     auto mat_assimp_to_glm = [](const aiMatrix4x4 & mat) -> f32mat4x4
     {
@@ -84,6 +61,24 @@ void Scene::process_scene(const aiScene * scene)
 
     node_stack.push({scene->mRootNode, aiMatrix4x4()});
 
+    // Planning pass - walks the node graph, creates the runtime objects with their (still empty) meshes
+    // and assigns every mesh its range of vertices and indices. Objects are referenced by index as the vector still grows.
+    // Instanced scenes assign the ranges only to the first reference of every assimp mesh, the other references
+    // become instances of it
+    struct MeshTask
+    {
+        const aiMesh * mesh;
+        size_t object_index;
+        size_t mesh_index;
+        size_t first_vertex;
+        size_t first_index;
+    };
+    std::vector<MeshTask> mesh_tasks;
+    static constexpr u32 NOT_CONVERTED = ~0u;
+    // raytracing mesh of every assimp mesh of an instanced scene
+    std::vector<u32> raytracing_mesh_indices(geometry == SceneGeometry::INSTANCED ? scene->mNumMeshes : 0, NOT_CONVERTED);
+    size_t vertex_count = raytracing_scene.positions.size();
+    size_t index_count = raytracing_scene.indices.size();
     while(!node_stack.empty())
     {
         auto [node, parent_transform] = node_stack.top();
@@ -93,14 +88,44 @@ void Scene::process_scene(const aiScene * scene)
             auto & new_scene_object = runtime_scene_objects.emplace_back(RuntimeSceneObject{
                 .transform = mat_assimp_to_glm(parent_transform)
             });
+            new_scene_object.meshes.resize(node->mNumMeshes);
 
             for(u32 i = 0; i < node->mNumMeshes; i++)
             {
-                process_mesh({
-                    .mesh = scene->mMeshes[node->mMeshes[i]],
-                    .scene = scene,
-                    .object = new_scene_object
+                const aiMesh * mesh = scene->mMeshes[node->mMeshes[i]];
+                if(geometry == SceneGeometry::INSTANCED)
+                {
+                    u32 & raytracing_mesh_index = raytracing_mesh_indices.at(node->mMeshes[i]);
+                    if(raytracing_mesh_index != NOT_CONVERTED)
+                    {
+                        const auto & raytracing_mesh = raytracing_scene.meshes.at(raytracing_mesh_index);
+                        new_scene_object.meshes.at(i).first_index = raytracing_mesh.first_index;
+                        new_scene_object.meshes.at(i).index_count = raytracing_mesh.index_count;
+                        raytracing_scene.instances.push_back(BVHInstance{
+                            .transform = new_scene_object.transform,
+                            .mesh_index = raytracing_mesh_index
+                        });
+                        continue;
+                    }
+                    raytracing_mesh_index = static_cast<u32>(raytracing_scene.meshes.size());
+                    raytracing_scene.meshes.push_back(RaytracingMesh{
+                        .first_index = static_cast<u32>(index_count),
+                        .index_count = mesh->mNumFaces * 3
+                    });
+                    raytracing_scene.instances.push_back(BVHInstance{
+                        .transform = new_scene_object.transform,
+                        .mesh_index = raytracing_mesh_index
+                    });
+                }
+                mesh_tasks.push_back(MeshTask{
+                    .mesh = mesh,
+                    .object_index = runtime_scene_objects.size() - 1,
+                    .mesh_index = i,
+                    .first_vertex = vertex_count,
+                    .first_index = index_count
                 });
+                vertex_count += mesh->mNumVertices;
+                index_count += static_cast<size_t>(mesh->mNumFaces) * 3; // expect triangles
             }
         }
         node_stack.pop();
@@ -111,10 +136,49 @@ void Scene::process_scene(const aiScene * scene)
             node_stack.push({child, node_transform});
         }
     }
+    raytracing_scene.positions.resize(vertex_count);
+    raytracing_scene.indices.resize(index_count);
+
+    // Conversion pass - meshes differ wildly in size so the threads pick the next mesh from a shared
+    // counter instead of getting fixed chunks
+    std::atomic<size_t> next_task = 0;
+    auto task = [&]()
+    {
+        for(size_t task_idx = next_task++; task_idx < mesh_tasks.size(); task_idx = next_task++)
+        {
+            const auto & mesh_task = mesh_tasks.at(task_idx);
+            auto & object = runtime_scene_objects.at(mesh_task.object_index);
+            process_mesh({
+                .mesh = mesh_task.mesh,
+                .scene = scene,
+                .transform = geometry == SceneGeometry::INSTANCED ? f32mat4x4(1.0f) : object.transform,
+                .runtime_mesh = object.meshes.at(mesh_task.mesh_index),
+                .first_vertex = mesh_task.first_vertex,
+                .first_index = mesh_task.first_index
+            });
+        }
+    };
+    const size_t thread_count = glm::clamp(size_t(std::thread::hardware_concurrency()), size_t(1), glm::max(mesh_tasks.size(), size_t(1)));
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for(size_t i = 0; i < thread_count; i++)
+    {
+        threads.push_back(std::thread(task));
+    }
+    for(auto & thread : threads)
+    {
+        thread.join();
+    }
 };
 
-Scene::Scene(const std::string & scene_path)
+Scene::Scene(const std::string & scene_path, SceneGeometry geometry)
 {
+    if(is_binary_scene_file(scene_path))
+    {
+        load_binary(scene_path);
+        return;
+    }
+
     Assimp::Importer importer;
     const aiScene * scene = importer.ReadFile( 
         scene_path,
@@ -132,10 +196,126 @@ Scene::Scene(const std::string & scene_path)
         return;
     }
 
-    process_scene(scene);
+    process_scene(scene, geometry);
+}
+
+auto Scene::build_bvh(const ConstructBVHInfo & info, BVHCache * cache) -> BVHStats
+{
+    if(raytracing_scene.is_instanced())
+    {
+        // NOTE(msakmary) the bottom level BVHs reference the positions of the whole scene so every cached
+        // bottom level would store its own copy of them - instanced scenes are always built
+        std::vector<IndexedTriangles> meshes;
+        meshes.reserve(raytracing_scene.meshes.size());
+        for(size_t mesh_index = 0; mesh_index < raytracing_scene.meshes.size(); mesh_index++)
+        {
+            meshes.push_back(raytracing_scene.get_mesh_triangles(mesh_index));
+        }
+        return raytracing_scene.instanced_bvh.construct({
+            .meshes = meshes,
+            .instances = raytracing_scene.instances,
+            .bvh_info = info
+        });
+    }
+    // NOTE(msakmary) the scene triangles never change once loaded so the BVH can reuse the decisions of its previous
+    // build when only the leaf joining parameters were changed
+    if(cache == nullptr)
+    {
+        return raytracing_scene.bvh.rebuild(raytracing_scene.get_triangles(), info);
+    }
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    const std::string key = cache->get_key(raytracing_scene.get_triangles(), info);
+    BVHStats stats = {};
+    if(cache->load(key, raytracing_scene.bvh, stats))
+    {
+        // NOTE(msakmary) report how long it took to get the BVH this time, not the time of the cached build
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+        stats.build_time = ms_double.count();
+        DEBUG_OUT("[Scene::build_bvh()] BVH loaded from cache entry " + key);
+        return stats;
+    }
+    stats = raytracing_scene.bvh.rebuild(raytracing_scene.get_triangles(), info);
+    cache->store(key, raytracing_scene.bvh, stats);
+    return stats;
+}
+auto RaytracingScene::get_nearest_intersection(const Ray & ray) const -> Hit
+{
+    return is_instanced() ? instanced_bvh.get_nearest_intersection(ray) : bvh.get_nearest_intersection(ray);
+}
+
+auto RaytracingScene::intersect(std::span<const Ray> rays, std::span<Hit> hits, const BatchTraceInfo & info) const -> void
+{
+    if(is_instanced())
+    {
+        instanced_bvh.intersect(rays, hits, info);
+        return;
+    }
+    bvh.intersect(rays, hits, info);
+}
+
+auto RaytracingScene::get_bvh_visualization_data() const -> std::vector<BVHVisualizationInfo>
+{
+    return is_instanced() ? instanced_bvh.get_bvh_visualization_data() : bvh.get_bvh_visualization_data();
 }
 
-auto Scene::build_bvh(const ConstructBVHInfo & info) -> BVHStats
+auto RaytracingScene::occluded(
+    std::span<const Ray> rays,
+    std::span<const f32> max_distances,
+    std::span<b32> occluded,
+    const BatchTraceInfo & info) const -> void
 {
-    return raytracing_scene.bvh.construct_bvh_from_data( raytracing_scene.primitives, info);
-}
\ No newline at end of file
+    if(!is_instanced())
+    {
+        bvh.occluded(rays, max_distances, occluded, info);
+        return;
+    }
+    // NOTE(msakmary) the instanced BVH has no any hit traversal - the nearest hit decides the occlusion
+    std::vector<Hit> hits(rays.size());
+    instanced_bvh.intersect(rays, hits, info);
+    for(size_t i = 0; i < rays.size(); i++)
+    {
+        occluded[i] = static_cast<b32>(hits[i].hit && hits[i].distance < max_distances[i]);
+    }
+}
+
+auto RaytracingScene::get_memory_footprint() const -> BVHMemoryFootprint
+{
+    return is_instanced() ? instanced_bvh.get_memory_footprint() : bvh.get_memory_footprint();
+}
+
+auto RaytracingScene::get_bounds() const -> AABB
+{
+    AABB bounds;
+    if(!is_instanced())
+    {
+        for(const auto & position : positions) { bounds.expand_bounds(position); }
+        return bounds;
+    }
+
+    std::vector<AABB> mesh_bounds(meshes.size());
+    for(size_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++)
+    {
+        const auto & mesh = meshes.at(mesh_index);
+        for(u32 i = mesh.first_index; i < mesh.first_index + mesh.index_count; i++)
+        {
+            mesh_bounds.at(mesh_index).expand_bounds(positions.at(indices.at(i)));
+        }
+    }
+    for(const auto & instance : instances)
+    {
+        const AABB & object_bounds = mesh_bounds.at(instance.mesh_index);
+        if(!object_bounds.check_if_valid()) { continue; }
+        for(u32 corner = 0; corner < 8; corner++)
+        {
+            const f32vec3 object_corner = {
+                (corner & 1u) ? object_bounds.max_bounds.x : object_bounds.min_bounds.x,
+                (corner & 2u) ? object_bounds.max_bounds.y : object_bounds.min_bounds.y,
+                (corner & 4u) ? object_bounds.max_bounds.z : object_bounds.min_bounds.z
+            };
+            bounds.expand_bounds(f32vec3(instance.transform * f32vec4(object_corner, 1.0f)));
+        }
+    }
+    return bounds;
+}
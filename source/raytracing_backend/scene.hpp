@@ -11,6 +11,16 @@
 #include "../types.hpp"
 #include "triangle.hpp"
 #include "bvh.hpp"
+#include "bvh_cache.hpp"
+#include "instanced_bvh.hpp"
+
+// FLATTENED bakes the object transforms into world space triangles traced through a single BVH. INSTANCED keeps
+// every mesh only once in object space and traces the objects referencing it through a two level BVH
+enum SceneGeometry : i32
+{
+    FLATTENED = 0,
+    INSTANCED = 1,
+};
 
 struct Vertex
 {
@@ -18,9 +28,13 @@ struct Vertex
     f32vec3 normal;
 };
 
+// The runtime meshes don't keep their own indices - they draw a range of the index buffer shared with the
+// raytracing scene. The indices are scene global, so they already include the offset of the mesh vertices.
+// In instanced scenes only the first runtime mesh of every mesh keeps the vertices, the others draw the same range
 struct RuntimeMesh
 {
-    std::vector<u32> indices;
+    u32 first_index;
+    u32 index_count;
     std::vector<Vertex> vertices;
 };
 
@@ -31,18 +45,59 @@ struct RuntimeSceneObject
     std::vector<RuntimeMesh> meshes;
 };
 
+// Range of the object space indices of one mesh of an instanced scene
+struct RaytracingMesh
+{
+    u32 first_index;
+    u32 index_count;
+};
+
 // Scene object used in raytracing
 struct RaytracingScene
 {
-    std::vector<Triangle> primitives;
+    // world space (object space in instanced scenes) positions of all vertices in the same order as the vertices of the runtime meshes
+    std::vector<f32vec3> positions;
+    // three indices into positions per triangle
+    std::vector<u32> indices;
+    // both are empty unless the scene is instanced
+    std::vector<RaytracingMesh> meshes;
+    std::vector<BVHInstance> instances;
     BVH bvh;
+    // traced instead of bvh in instanced scenes
+    InstancedBVH instanced_bvh;
+
+    [[nodiscard]] inline auto get_triangles() const -> IndexedTriangles { return {positions, indices}; }
+    [[nodiscard]] inline auto get_mesh_triangles(size_t mesh_index) const -> IndexedTriangles
+    {
+        const auto & mesh = meshes.at(mesh_index);
+        return {positions, std::span<const u32>(indices).subspan(mesh.first_index, mesh.index_count)};
+    }
+    [[nodiscard]] inline auto is_instanced() const -> bool { return !instances.empty(); }
+
+    // queries of whichever BVH the scene is traced with
+    [[nodiscard]] auto get_nearest_intersection(const Ray & ray) const -> Hit;
+    auto intersect(std::span<const Ray> rays, std::span<Hit> hits, const BatchTraceInfo & info = {}) const -> void;
+    auto occluded(
+        std::span<const Ray> rays,
+        std::span<const f32> max_distances,
+        std::span<b32> occluded,
+        const BatchTraceInfo & info = {}) const -> void;
+    [[nodiscard]] auto get_bvh_visualization_data() const -> std::vector<BVHVisualizationInfo>;
+    [[nodiscard]] auto get_memory_footprint() const -> BVHMemoryFootprint;
+    // world space bounds of all triangles
+    [[nodiscard]] auto get_bounds() const -> AABB;
 };
 
 struct ProcessMeshInfo
 {
     const aiMesh * mesh;
     const aiScene * scene;
-    RuntimeSceneObject & object;
+    // identity in instanced scenes so that the raytracing positions stay in object space
+    f32mat4x4 transform;
+    RuntimeMesh & runtime_mesh;
+    // ranges reserved for the mesh in the raytracing positions (mNumVertices) and indices (mNumFaces * 3)
+    size_t first_vertex;
+    size_t first_index;
 };
 
 struct Scene
@@ -52,11 +107,20 @@ struct Scene
     std::vector<RuntimeSceneObject> runtime_scene_objects;
     RaytracingScene raytracing_scene;
 
-    explicit Scene(const std::string & scene_path);
-    auto build_bvh(const ConstructBVHInfo & info) -> BVHStats;
+    // Loads either a binary scene file written by save_binary or any file assimp can import. Binary scene files
+    // keep the geometry they were converted with, the requested one only applies to assimp imports
+    explicit Scene(const std::string & scene_path, SceneGeometry geometry = SceneGeometry::FLATTENED);
+    // Writes the raytracing triangles and the runtime objects into a binary scene file which is later
+    // loaded without assimp. Returns false if the file could not be written
+    auto save_binary(const std::string & path) const -> bool;
+    [[nodiscard]] static auto is_binary_scene_file(const std::string & path) -> bool;
+    // with a cache the BVH is loaded from it when the same primitives were already built with the same info,
+    // otherwise the built BVH is stored into it. Instanced scenes build their two level BVH without the cache
+    auto build_bvh(const ConstructBVHInfo & info, BVHCache * cache = nullptr) -> BVHStats;
 
     private:
-        void process_scene(const aiScene * scene);
+        void process_scene(const aiScene * scene, SceneGeometry geometry);
         void process_mesh(const ProcessMeshInfo & info);
         void convert_to_raytrace_scene();
+        auto load_binary(const std::string & path) -> bool;
 };
\ No newline at end of file
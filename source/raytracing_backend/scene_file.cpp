@@ -0,0 +1,233 @@
+#include "scene.hpp"
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <cstring>
+
+// Binary scene file layout:
+//      SceneFileHeader
+//      sections - raytracing positions and indices, runtime objects, runtime meshes, runtime vertices,
+//                 raytracing meshes and instances (both empty unless the scene is instanced)
+// The positions are stored already transformed into world space (object space in instanced scenes) so loading
+// is a bulk copy out of the mapped file. Runtime meshes of all objects share the vertex section and reference
+// ranges in it and in the raytracing indices.
+// As in the BVH file the structures are stored in the native layout and the header records their sizes
+static constexpr char SCENE_FILE_MAGIC[8] = {'S', 'B', 'V', 'H', 'S', 'C', 'N', 'E'};
+static constexpr u32 SCENE_FILE_VERSION = 3;
+static constexpr u64 SCENE_FILE_SECTION_ALIGNMENT = 64;
+
+struct SceneFileSection
+{
+    u64 offset;
+    u64 count;
+};
+
+struct SceneFileObject
+{
+    f32mat4x4 transform;
+    u64 first_mesh;
+    u64 mesh_count;
+};
+
+struct SceneFileMesh
+{
+    u64 first_vertex;
+    u64 vertex_count;
+    u64 first_index;
+    u64 index_count;
+};
+
+struct SceneFileHeader
+{
+    char magic[8];
+    u32 version;
+    u32 object_size;
+    u32 mesh_size;
+    u32 vertex_size;
+    u32 instance_size;
+    u64 file_size;
+    SceneFileSection positions;
+    SceneFileSection indices;
+    SceneFileSection objects;
+    SceneFileSection meshes;
+    SceneFileSection vertices;
+    SceneFileSection raytracing_meshes;
+    SceneFileSection instances;
+};
+
+static auto align_offset(u64 offset) -> u64
+{
+    return (offset + SCENE_FILE_SECTION_ALIGNMENT - 1) / SCENE_FILE_SECTION_ALIGNMENT * SCENE_FILE_SECTION_ALIGNMENT;
+}
+
+auto Scene::is_binary_scene_file(const std::string & path) -> bool
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(SCENE_FILE_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    return file.good() && std::memcmp(magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) == 0;
+}
+
+auto Scene::save_binary(const std::string & path) const -> bool
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file.is_open()) { return false; }
+
+    // flatten the per object mesh vectors into shared sections
+    std::vector<SceneFileObject> objects;
+    std::vector<SceneFileMesh> meshes;
+    std::vector<Vertex> vertices;
+    objects.reserve(runtime_scene_objects.size());
+    for(const auto & object : runtime_scene_objects)
+    {
+        objects.push_back(SceneFileObject{
+            .transform = object.transform,
+            .first_mesh = meshes.size(),
+            .mesh_count = object.meshes.size()
+        });
+        for(const auto & mesh : object.meshes)
+        {
+            meshes.push_back(SceneFileMesh{
+                .first_vertex = vertices.size(),
+                .vertex_count = mesh.vertices.size(),
+                .first_index = mesh.first_index,
+                .index_count = mesh.index_count
+            });
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        }
+    }
+
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+    header.version = SCENE_FILE_VERSION;
+    header.object_size = sizeof(SceneFileObject);
+    header.mesh_size = sizeof(SceneFileMesh);
+    header.vertex_size = sizeof(Vertex);
+    header.instance_size = sizeof(BVHInstance);
+
+    u64 offset = align_offset(sizeof(SceneFileHeader));
+    auto place_section = [&](SceneFileSection & section, size_t count, size_t element_size)
+    {
+        section = SceneFileSection{.offset = offset, .count = count};
+        offset = align_offset(offset + count * element_size);
+    };
+    place_section(header.positions, raytracing_scene.positions.size(), sizeof(f32vec3));
+    place_section(header.indices, raytracing_scene.indices.size(), sizeof(u32));
+    place_section(header.objects, objects.size(), sizeof(SceneFileObject));
+    place_section(header.meshes, meshes.size(), sizeof(SceneFileMesh));
+    place_section(header.vertices, vertices.size(), sizeof(Vertex));
+    place_section(header.raytracing_meshes, raytracing_scene.meshes.size(), sizeof(RaytracingMesh));
+    place_section(header.instances, raytracing_scene.instances.size(), sizeof(BVHInstance));
+    header.file_size = offset;
+
+    u64 written = 0;
+    auto write_section = [&](const SceneFileSection & section, const void * data, size_t size_bytes)
+    {
+        const std::vector<char> padding(section.offset - written, 0);
+        file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size_bytes));
+        written = section.offset + size_bytes;
+    };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(SceneFileHeader));
+    written = sizeof(SceneFileHeader);
+    write_section(header.positions, raytracing_scene.positions.data(), raytracing_scene.positions.size() * sizeof(f32vec3));
+    write_section(header.indices, raytracing_scene.indices.data(), raytracing_scene.indices.size() * sizeof(u32));
+    write_section(header.objects, objects.data(), objects.size() * sizeof(SceneFileObject));
+    write_section(header.meshes, meshes.data(), meshes.size() * sizeof(SceneFileMesh));
+    write_section(header.vertices, vertices.data(), vertices.size() * sizeof(Vertex));
+    write_section(header.raytracing_meshes, raytracing_scene.meshes.data(), raytracing_scene.meshes.size() * sizeof(RaytracingMesh));
+    write_section(header.instances, raytracing_scene.instances.data(), raytracing_scene.instances.size() * sizeof(BVHInstance));
+    const std::vector<char> padding(header.file_size - written, 0);
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    return file.good();
+}
+
+auto Scene::load_binary(const std::string & path) -> bool
+{
+    const MappedFile file(path);
+    if(!file.is_valid() || file.get_size() < sizeof(SceneFileHeader))
+    {
+        DEBUG_OUT("[Scene::load_binary()] could not map " + path);
+        return false;
+    }
+
+    SceneFileHeader header;
+    std::memcpy(&header, file.get_data(), sizeof(SceneFileHeader));
+    const bool compatible =
+        std::memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) == 0 &&
+        header.version == SCENE_FILE_VERSION &&
+        header.object_size == sizeof(SceneFileObject) &&
+        header.mesh_size == sizeof(SceneFileMesh) &&
+        header.vertex_size == sizeof(Vertex) &&
+        header.instance_size == sizeof(BVHInstance) &&
+        header.file_size == file.get_size();
+    if(!compatible)
+    {
+        DEBUG_OUT("[Scene::load_binary()] " + path + " is not a scene file compatible with this build");
+        return false;
+    }
+
+    bool valid = true;
+    const auto positions = file.get_span<f32vec3>(header.positions.offset, header.positions.count, valid);
+    const auto indices = file.get_span<u32>(header.indices.offset, header.indices.count, valid);
+    const auto objects = file.get_span<SceneFileObject>(header.objects.offset, header.objects.count, valid);
+    const auto meshes = file.get_span<SceneFileMesh>(header.meshes.offset, header.meshes.count, valid);
+    const auto vertices = file.get_span<Vertex>(header.vertices.offset, header.vertices.count, valid);
+    const auto raytracing_meshes = file.get_span<RaytracingMesh>(header.raytracing_meshes.offset, header.raytracing_meshes.count, valid);
+    const auto instances = file.get_span<BVHInstance>(header.instances.offset, header.instances.count, valid);
+    // the ranges and indices are validated up front so that a broken file never leaves a partially loaded scene
+    // and the BVH builds and the traversal never index past the positions
+    valid = valid && indices.size() % 3 == 0;
+    for(const u32 index : indices)
+    {
+        valid = valid && index < positions.size();
+    }
+    for(const auto & object : objects)
+    {
+        valid = valid && object.first_mesh <= meshes.size() && object.mesh_count <= meshes.size() - object.first_mesh;
+    }
+    for(const auto & mesh : meshes)
+    {
+        valid = valid &&
+            mesh.first_vertex <= vertices.size() && mesh.vertex_count <= vertices.size() - mesh.first_vertex &&
+            mesh.first_index <= indices.size() && mesh.index_count <= indices.size() - mesh.first_index;
+    }
+    for(const auto & raytracing_mesh : raytracing_meshes)
+    {
+        valid = valid &&
+            raytracing_mesh.first_index % 3 == 0 && raytracing_mesh.index_count % 3 == 0 &&
+            raytracing_mesh.first_index <= indices.size() && raytracing_mesh.index_count <= indices.size() - raytracing_mesh.first_index;
+    }
+    for(const auto & instance : instances)
+    {
+        valid = valid && instance.mesh_index < raytracing_meshes.size();
+    }
+    if(!valid)
+    {
+        DEBUG_OUT("[Scene::load_binary()] " + path + " has data outside of the file or indices out of range");
+        return false;
+    }
+
+    raytracing_scene.positions.assign(positions.begin(), positions.end());
+    raytracing_scene.indices.assign(indices.begin(), indices.end());
+    raytracing_scene.meshes.assign(raytracing_meshes.begin(), raytracing_meshes.end());
+    raytracing_scene.instances.assign(instances.begin(), instances.end());
+    runtime_scene_objects.reserve(objects.size());
+    for(const auto & object : objects)
+    {
+        auto & new_scene_object = runtime_scene_objects.emplace_back(RuntimeSceneObject{
+            .transform = object.transform
+        });
+        new_scene_object.meshes.reserve(object.mesh_count);
+        for(const auto & mesh : meshes.subspan(object.first_mesh, object.mesh_count))
+        {
+            const auto mesh_vertices = vertices.subspan(mesh.first_vertex, mesh.vertex_count);
+            new_scene_object.meshes.push_back(RuntimeMesh{
+                .first_index = static_cast<u32>(mesh.first_index),
+                .index_count = static_cast<u32>(mesh.index_count),
+                .vertices = std::vector<Vertex>(mesh_vertices.begin(), mesh_vertices.end())
+            });
+        }
+    }
+    return true;
+}
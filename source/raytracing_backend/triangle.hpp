@@ -3,6 +3,7 @@
 #include <iterator> // For std::forward_iterator_tag
 #include <cstddef>  // For std::ptrdiff_t
 #include <stdexcept>
+#include <span>
 
 #include "../types.hpp"
 
@@ -20,9 +21,8 @@ struct Triangle
     f32vec3 v1;
     f32vec3 v2;
 
-    f32vec3 normal;
-
     // Find intersection point - from PBRT - www.pbrt.org
+    // the normal is not stored, it is computed only once the triangle is hit
     inline auto intersect_ray(const Ray & ray) const -> Hit
     {
         Hit hit = Hit{
@@ -58,7 +58,81 @@ struct Triangle
 
         hit.hit = true;
         hit.distance = tt;
-        hit.normal = normal;
+        hit.normal = glm::normalize(glm::cross(e1, e2));
+        return hit;
+    }
+
+    // Conservative intersection - hits the ray whenever it hits any triangle whose vertices are at most error away
+    // from the vertices of this one along every axis. Runs in the space of the ray (as the watertight test of Woop
+    // et al.) where such triangles stay inside of the projected triangle grown by the projected error box, so the
+    // ray hits if its origin lies inside of the grown triangle. The distance interpolates the vertex depths with
+    // the barycentrics clamped to the triangle and never leaves the depth range of its vertices
+    inline auto intersect_ray_conservative(const Ray & ray, const f32vec3 & error) const -> Hit
+    {
+        Hit hit = Hit{
+            .hit = false,
+            .distance = INFINITY,
+            .normal = f32vec3(0.0f),
+            .internal_fac = 1.0f
+        };
+
+        // the largest component of the direction is the depth axis, the other two span the projection plane
+        const f32vec3 abs_direction = glm::abs(ray.direction);
+        const i32 kz = abs_direction.x > abs_direction.y ?
+            (abs_direction.x > abs_direction.z ? 0 : 2) :
+            (abs_direction.y > abs_direction.z ? 1 : 2);
+        const i32 kx = (kz + 1) % 3;
+        const i32 ky = (kx + 1) % 3;
+        const f32 sz = 1.0f / ray.direction[kz];
+        const f32 sx = ray.direction[kx] * sz;
+        const f32 sy = ray.direction[ky] * sz;
+
+        const f32vec3 a = v0 - ray.start;
+        const f32vec3 b = v1 - ray.start;
+        const f32vec3 c = v2 - ray.start;
+        const f32 ax = a[kx] - sx * a[kz];
+        const f32 ay = a[ky] - sy * a[kz];
+        const f32 bx = b[kx] - sx * b[kz];
+        const f32 by = b[ky] - sy * b[kz];
+        const f32 cx = c[kx] - sx * c[kz];
+        const f32 cy = c[ky] - sy * c[kz];
+        // error box of the projected vertices
+        const f32 ex = error[kx] + glm::abs(sx) * error[kz];
+        const f32 ey = error[ky] + glm::abs(sy) * error[kz];
+
+        // the grown triangle is separated from the origin either by its bounds...
+        if(glm::min(ax, glm::min(bx, cx)) > ex || glm::max(ax, glm::max(bx, cx)) < -ex) { return hit; }
+        if(glm::min(ay, glm::min(by, cy)) > ey || glm::max(ay, glm::max(by, cy)) < -ey) { return hit; }
+        // ...or by one of its edges moved outwards by the support of the error box
+        const f32 u = bx * cy - by * cx;
+        const f32 v = cx * ay - cy * ax;
+        const f32 w = ax * by - ay * bx;
+        const f32 u_error = ex * glm::abs(cy - by) + ey * glm::abs(cx - bx);
+        const f32 v_error = ex * glm::abs(ay - cy) + ey * glm::abs(ax - cx);
+        const f32 w_error = ex * glm::abs(by - ay) + ey * glm::abs(bx - ax);
+        const bool front = u >= -u_error && v >= -v_error && w >= -w_error;
+        const bool back = u <= u_error && v <= v_error && w <= w_error;
+        if(!front && !back) { return hit; }
+
+        const f32 side = (front && (!back || u + v + w >= 0.0f)) ? 1.0f : -1.0f;
+        const f32 u_weight = glm::max(side * u, 0.0f);
+        const f32 v_weight = glm::max(side * v, 0.0f);
+        const f32 w_weight = glm::max(side * w, 0.0f);
+        const f32 weight_sum = u_weight + v_weight + w_weight;
+        const f32 az = a[kz] * sz;
+        const f32 bz = b[kz] * sz;
+        const f32 cz = c[kz] * sz;
+        const f32 tt = weight_sum > 0.0f ?
+            (u_weight * az + v_weight * bz + w_weight * cz) / weight_sum :
+            (az + bz + cz) / 3.0f;
+        if(tt < -error[kz] * glm::abs(sz)) { return hit; }
+
+        const f32vec3 normal = glm::cross(v1 - v0, v2 - v0);
+        const f32 normal_length = glm::length(normal);
+        hit.hit = true;
+        hit.distance = glm::max(tt, 0.0f);
+        // decoded triangles may collapse to a line, such a hit faces the ray
+        hit.normal = normal_length > 0.0f ? normal / normal_length : -glm::normalize(ray.direction);
         return hit;
     }
 
@@ -91,4 +165,25 @@ struct Triangle
             }
         }
     }
-};
\ No newline at end of file
+};
+
+// Non owning view of indexed triangles with shared vertices - every three consecutive indices
+// reference the positions of one triangle
+struct IndexedTriangles
+{
+    std::span<const f32vec3> positions;
+    std::span<const u32> indices;
+
+    [[nodiscard]] inline auto size() const -> size_t { return indices.size() / 3; }
+    [[nodiscard]] inline auto empty() const -> bool { return indices.empty(); }
+
+    [[nodiscard]] inline auto get_triangle(size_t triangle_index) const -> Triangle
+    {
+        const u32 * triangle_indices = indices.data() + triangle_index * 3;
+        return Triangle{
+            .v0 = positions[triangle_indices[0]],
+            .v1 = positions[triangle_indices[1]],
+            .v2 = positions[triangle_indices[2]]
+        };
+    }
+};
@@ -1,6 +1,7 @@
 #include "camera.hpp"
 
 #include <fstream>
+#include <cstdio>
 
 Camera::Camera(const CameraInfo & info) : 
     position{info.position}, front{info.front}, up{info.up}, aspect_ratio{info.aspect_ratio}, fov{info.fov},
@@ -17,7 +18,7 @@ void Camera::set_info(const CameraInfo & info)
     fov = info.fov;
 }
 
-void Camera::parse_view_file(const std::string file_path)
+auto Camera::parse_view_file(const std::string file_path) -> bool
 {
     std::ifstream file(file_path);
     std::string content;
@@ -29,20 +30,27 @@ void Camera::parse_view_file(const std::string file_path)
     else
     {
         DEBUG_OUT("[Camera::parse_view_file()] Error could not open the file at path: " << file_path);
-        return;
+        return false;
     }
 
-    sscanf_s(content.c_str(), "-vp %f %f %f -vd %f %f %f -vu %f %f %f -vf %f",
+    // NOTE(msakmary) only floats are parsed so the portable sscanf is safe here
+    const i32 parsed_count = std::sscanf(content.c_str(), "-vp %f %f %f -vd %f %f %f -vu %f %f %f -vf %f",
         &position.x, &position.y, &position.z,
         &front.x, &front.y, &front.z,
         &up.x, &up.y, &up.z,
         &fov);
+    if(parsed_count != 10)
+    {
+        DEBUG_OUT("[Camera::parse_view_file()] Error malformed view file at path: " << file_path);
+        return false;
+    }
 
     DEBUG_OUT("[Camera::parese_view_file()] Sucessfully parsed view file new camera params are: ");
     DEBUG_OUT("               position    : " << position.x << " " << position.y << " " << position.z);
     DEBUG_OUT("               direction   : " << front.x << " " << front.y << " " << front.z);
     DEBUG_OUT("               up          : " << up.x << " " << up.y << " " << up.z);
     DEBUG_OUT("               fov radians : " << fov << " fov degrees: " << glm::degrees(fov));
+    return true;
 }
 
 auto Camera::get_ray(u32vec2 screen_coords, u32vec2 resolution) const -> Ray
@@ -24,7 +24,8 @@ struct Camera
     void move_camera(f32 delta_time, Direction direction);
     void update_front_vector(f32 x_offset, f32 y_offset);
     void set_info(const CameraInfo & info);
-    void parse_view_file(const std::string file_path);
+    // returns false if the view file could not be read
+    auto parse_view_file(const std::string file_path) -> bool;
     [[nodiscard]] auto get_camera_position() const -> f32vec3;
     [[nodiscard]] auto get_view_matrix() const -> f32mat4x4;
     [[nodiscard]] auto get_ray(u32vec2 screen_coords, u32vec2 resolution) const -> Ray;
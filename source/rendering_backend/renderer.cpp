@@ -1,6 +1,11 @@
 #include "renderer.hpp"
 #include "camera.hpp"
 
+static auto daxa_vec3_from_glm(const f32vec3 & vec) -> daxa::f32vec3 
+{
+    return {vec.x, vec.y, vec.z};
+}
+
 Renderer::Renderer(const AppWindow & window) :
     context { .vulkan_context = {[]() {
       DEBUG_OUT("balls");
@@ -232,7 +237,7 @@ void Renderer::set_bvh_visualization_depth(i32 depth)
     context.render_info.visualized_depth = depth;
 }
 
-void Renderer::reload_bvh_data(const BVH & bvh)
+void Renderer::reload_bvh_data(const RaytracingScene & raytracing_scene)
 {
     if(context.device.is_id_valid(context.buffers.aabb_info_buffer.gpu_buffer))
     {
@@ -243,7 +248,17 @@ void Renderer::reload_bvh_data(const BVH & bvh)
         context.device.destroy_buffer(context.buffers.aabb_info_buffer.gpu_buffer);
         context.buffers.aabb_info_buffer.cpu_buffer.clear();
     }
-    context.buffers.aabb_info_buffer.cpu_buffer = bvh.get_bvh_visualization_data();
+    for(const auto & visualization_info : raytracing_scene.get_bvh_visualization_data())
+    {
+        context.buffers.aabb_info_buffer.cpu_buffer.push_back(AABBGeometryInfo{
+            .position = daxa_vec3_from_glm(visualization_info.position),
+            .scale = daxa_vec3_from_glm(visualization_info.scale),
+            .depth = static_cast<daxa::u32>(visualization_info.depth),
+#ifdef VISUALIZE_SPATIAL_SPLITS
+            .spatial = visualization_info.spatial
+#endif
+        });
+    }
     if(context.buffers.aabb_info_buffer.cpu_buffer.empty()) { return; }
 
     context.buffers.aabb_info_buffer.gpu_buffer = context.device.create_buffer({
@@ -291,29 +306,29 @@ void Renderer::reload_scene_data(const Scene & scene)
         });
         auto & object = context.render_info.objects.back();
 
-        for(auto scene_runtime_mesh : scene_runtime_object.meshes)
+        for(const auto & scene_runtime_mesh : scene_runtime_object.meshes)
         {
+            // the shared scene indices already include the vertex offset of the mesh
             object.meshes.push_back({
-                .index_buffer_offset = static_cast<u32>(scene_index_cnt),
-                .index_offset = static_cast<u32>(scene_vertex_cnt),
-                .index_count = static_cast<u32>(scene_runtime_mesh.indices.size()),
+                .index_buffer_offset = scene_runtime_mesh.first_index,
+                .index_offset = 0,
+                .index_count = scene_runtime_mesh.index_count,
             });
-            auto & mesh = object.meshes.back();
 
             context.buffers.scene_vertices.cpu_buffer.resize(scene_vertex_cnt + scene_runtime_mesh.vertices.size());
             memcpy(context.buffers.scene_vertices.cpu_buffer.data() + scene_vertex_cnt,
                    scene_runtime_mesh.vertices.data(),
                    sizeof(SceneGeometryVertices) * scene_runtime_mesh.vertices.size());
             scene_vertex_cnt += scene_runtime_mesh.vertices.size();
-
-            context.buffers.scene_indices.cpu_buffer.resize(scene_index_cnt + scene_runtime_mesh.indices.size());
-            memcpy(context.buffers.scene_indices.cpu_buffer.data() + scene_index_cnt,
-                   scene_runtime_mesh.indices.data(),
-                   sizeof(u32) * scene_runtime_mesh.indices.size());
-            scene_index_cnt += scene_runtime_mesh.indices.size();
         }
     }
 
+    // runtime meshes draw ranges of the index buffer shared with the raytracing scene
+    const auto & scene_indices = scene.raytracing_scene.indices;
+    scene_index_cnt = scene_indices.size();
+    context.buffers.scene_indices.cpu_buffer.resize(scene_index_cnt);
+    memcpy(context.buffers.scene_indices.cpu_buffer.data(), scene_indices.data(), sizeof(u32) * scene_index_cnt);
+
     context.buffers.scene_vertices.gpu_buffer = context.device.create_buffer({
         .memory_flags = daxa::MemoryFlagBits::DEDICATED_MEMORY,
         .size = static_cast<u32>(scene_vertex_cnt * sizeof(SceneGeometryVertices)),
@@ -25,7 +25,8 @@ struct Renderer
     void resize();
     void draw(const Camera & camera);
     void reload_scene_data(const Scene & scene);
-    void reload_bvh_data(const BVH & bvh);
+    // visualizes the BVH the raytracing scene is traced with - the top level one of instanced scenes
+    void reload_bvh_data(const RaytracingScene & raytracing_scene);
     void set_bvh_visualization_depth(i32 depth);
 
     private:
@@ -0,0 +1,656 @@
+// Benchmark suite - measures BVH build times and quality per builder configuration and the primary,
+// shadow and random ray throughput of the batch traversal kernels on a fixed set of scenes and views.
+// All measurements are repeated after warm-up runs and their median and variance are written to a JSON file
+#include <chrono>
+#include <thread>
+#include <random>
+#include <numbers>
+#include <fstream>
+#include <iostream>
+
+#include "tool_utils.hpp"
+#include "json_writer.hpp"
+#include "json_reader.hpp"
+#include "../raytracing_backend/scene.hpp"
+#include "../rendering_backend/camera.hpp"
+
+static constexpr u32 BENCHMARK_RESULTS_VERSION = 2;
+
+struct BenchmarkScene
+{
+    std::string path;
+    // empty when the default camera should be used
+    std::vector<std::string> views;
+    f32vec3 light_position;
+};
+
+struct BenchmarkConfig
+{
+    std::vector<BenchmarkScene> scenes;
+    std::vector<std::string> builders;
+    std::vector<std::string> kernels;
+    ConstructBVHInfo base_bvh_info;
+    SceneGeometry geometry;
+    u32vec2 resolution;
+    u32 thread_count;
+    u32 repetitions;
+    u32 warmup;
+    u32 random_ray_count;
+    u32 seed;
+};
+
+struct BuilderConfig
+{
+    std::string name;
+    ConstructBVHInfo info;
+};
+
+enum MetricKind
+{
+    // deterministic metrics describing the quality and size of the built tree
+    QUALITY,
+    // timing metrics which are noisy and so get their own threshold
+    PERFORMANCE,
+};
+
+struct Metric
+{
+    std::string name;
+    // path of object keys to the value inside of a results entry
+    std::vector<std::string> path;
+    MetricKind kind;
+    bool higher_is_better;
+};
+
+struct RegressionThresholds
+{
+    f64 quality;
+    f64 performance;
+};
+
+struct RayBatch
+{
+    std::vector<Ray> rays;
+    // only used by the occlusion batches
+    std::vector<f32> max_distances;
+};
+
+static auto print_usage() -> void
+{
+    std::cout <<
+        "usage: SBVH_benchmark (--suite <path> | --scene <path> [--view <path>]... | --compare <path>) [options]\n"
+        "  --suite <path>              suite file listing the scenes and views to benchmark\n"
+        "  --scene <path>              benchmark a single scene instead of a suite\n"
+        "  --view <path>               .view camera file of the single scene, can be repeated\n"
+        "  --output <path>             results JSON file (default benchmark_results.json)\n"
+        "  --instanced                 load the scenes instanced, quality metrics are only reported for flattened scenes\n"
+        "  --builders <list>           comma separated builder configurations sbvh,object,esc (default sbvh,object)\n"
+        "  --kernels <list>            comma separated batch kernels auto,single,packet,stream,interleaved,stackless (default auto)\n"
+        "  --resolution <WxH>          resolution of the primary ray batches (default 512x512)\n"
+        "  --threads <n>               tracing threads (default hardware concurrency)\n"
+        "  --repetitions <n>           measured repetitions of every benchmark (default 5)\n"
+        "  --warmup <n>                unmeasured warm-up runs before the repetitions (default 1)\n"
+        "  --random-rays <n>           number of random rays (default 262144)\n"
+        "  --seed <n>                  seed of the random rays (default 1337)\n"
+        "  --light \"<x> <y> <z>\"       light position of the shadow rays for the single scene (default \"-11 15 7\")\n"
+        << construct_bvh_info_usage() <<
+        "regression gate - exits with code 2 if any metric regressed against the baseline:\n"
+        "  --baseline <path>           results JSON of a previous run to compare the results against\n"
+        "  --compare <path>            compare an existing results JSON against --baseline instead of running the benchmarks\n"
+        "  --threshold <f>             allowed relative regression of SAH cost, node counts and memory (default 0.01)\n"
+        "  --perf-threshold <f>        allowed relative regression of build time and Mrays/s (default 0.05)\n"
+        "suite file format - one directive per line, # starts a comment:\n"
+        "  scene <path>                starts a new scene\n"
+        "  view <path>                 adds a view to the last scene (the default camera is used if it has none)\n"
+        "  light <x> <y> <z>           light position of the last scene\n";
+}
+
+static auto parse_suite_file(const std::string & path) -> std::vector<BenchmarkScene>
+{
+    std::ifstream file(path);
+    if(!file.is_open()) { throw std::runtime_error("[parse_suite_file()] could not open suite file " + path); }
+
+    std::vector<BenchmarkScene> scenes;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        const auto directive_end = line.find(' ');
+        if(directive_end == std::string::npos) { continue; }
+        const std::string directive = line.substr(0, directive_end);
+        std::string value = line.substr(line.find_first_not_of(' ', directive_end));
+        value.erase(value.find_last_not_of(" \r") + 1);
+
+        if(directive == "scene")
+        {
+            scenes.push_back({.path = value, .views = {}, .light_position = {-11.0f, 15.0f, 7.0f}});
+            continue;
+        }
+        if(scenes.empty()) { throw std::runtime_error("[parse_suite_file()] " + directive + " before the first scene"); }
+        if(directive == "view")       { scenes.back().views.push_back(value); }
+        else if(directive == "light") { scenes.back().light_position = parse_vec3(value); }
+        else { throw std::runtime_error("[parse_suite_file()] unknown directive " + directive); }
+    }
+    return scenes;
+}
+
+static auto get_builder_config(const std::string & name, const ConstructBVHInfo & base_info) -> BuilderConfig
+{
+    BuilderConfig config = {.name = name, .info = base_info};
+    // spatial splits are only attempted when the overlap of the object split children is above
+    // spatial_alpha - infinite alpha turns the builder into a plain binned object split builder
+    if(name == "object") { config.info.spatial_alpha = INFINITY; }
+    else if(name == "esc") { config.info.reference_splitting = ReferenceSplitting::EARLY_SPLIT_CLIPPING; }
+    else if(name != "sbvh") { throw std::runtime_error("[get_builder_config()] unknown builder " + name); }
+    return config;
+}
+
+template<typename Function>
+static auto measure_repeated(const BenchmarkConfig & config, Function && function) -> std::vector<f64>
+{
+    for(u32 i = 0; i < config.warmup; i++) { function(); }
+
+    std::vector<f64> times;
+    times.reserve(config.repetitions);
+    for(u32 i = 0; i < config.repetitions; i++)
+    {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        function();
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+        times.push_back(ms_double.count());
+    }
+    return times;
+}
+
+static auto write_statistics(JsonWriter & json, const std::string & key, const std::vector<f64> & samples) -> void
+{
+    const SampleStatistics statistics = compute_sample_statistics(samples);
+    json.begin_object(key);
+    json.value("median", statistics.median);
+    json.value("variance", statistics.variance);
+    json.value("min", statistics.min);
+    json.value("max", statistics.max);
+    json.end_object();
+}
+
+static auto make_primary_batch(const Camera & camera, u32vec2 resolution) -> RayBatch
+{
+    RayBatch batch;
+    batch.rays.reserve(static_cast<size_t>(resolution.x) * resolution.y);
+    for(u32 y = 0; y < resolution.y; y++)
+    {
+        for(u32 x = 0; x < resolution.x; x++)
+        {
+            batch.rays.push_back(camera.get_ray({x, y}, resolution));
+        }
+    }
+    return batch;
+}
+
+// shadow rays from the primary hits towards the light - offset the same way the raytracer does
+static auto make_shadow_batch(const RayBatch & primary, std::span<const Hit> primary_hits, f32vec3 light_position) -> RayBatch
+{
+    RayBatch batch;
+    for(size_t i = 0; i < primary.rays.size(); i++)
+    {
+        const Hit & hit = primary_hits[i];
+        if(!hit.hit) { continue; }
+        const Ray & ray = primary.rays.at(i);
+        const f32vec3 hit_position = ray.start + (ray.direction * hit.distance) + (0.005f * hit.normal);
+        batch.rays.emplace_back(hit_position, light_position - hit_position);
+        batch.max_distances.push_back(glm::distance(hit_position, light_position) * 0.98f);
+    }
+    return batch;
+}
+
+// incoherent rays with origins uniformly distributed in the scene bounds and uniform directions
+static auto make_random_batch(const AABB & scene_aabb, u32 ray_count, u32 seed) -> RayBatch
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+    RayBatch batch;
+    batch.rays.reserve(ray_count);
+    for(u32 i = 0; i < ray_count; i++)
+    {
+        const f32vec3 factor = {unit(generator), unit(generator), unit(generator)};
+        const f32vec3 start = glm::mix(scene_aabb.min_bounds, scene_aabb.max_bounds, factor);
+        const f32 z = 1.0f - 2.0f * unit(generator);
+        const f32 phi = 2.0f * std::numbers::pi_v<f32> * unit(generator);
+        const f32 r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+        batch.rays.emplace_back(start, f32vec3(r * std::cos(phi), r * std::sin(phi), z));
+    }
+    return batch;
+}
+
+static auto benchmark_ray_batch(
+    JsonWriter & json,
+    const std::string & key,
+    const BenchmarkConfig & config,
+    const RaytracingScene & raytracing_scene,
+    const RayBatch & batch,
+    const BatchTraceInfo & trace_info) -> void
+{
+    std::vector<f64> times;
+    if(batch.max_distances.empty())
+    {
+        std::vector<Hit> hits(batch.rays.size());
+        times = measure_repeated(config, [&]{ raytracing_scene.intersect(batch.rays, hits, trace_info); });
+    }
+    else
+    {
+        std::vector<b32> occluded(batch.rays.size());
+        times = measure_repeated(config, [&]{ raytracing_scene.occluded(batch.rays, batch.max_distances, occluded, trace_info); });
+    }
+
+    std::vector<f64> mrays_per_second;
+    for(const f64 time : times) { mrays_per_second.push_back(f64(batch.rays.size()) / (time * 1000.0)); }
+
+    json.begin_object(key);
+    json.value("ray_count", batch.rays.size());
+    write_statistics(json, "time_ms", times);
+    write_statistics(json, "mrays_per_second", mrays_per_second);
+    json.end_object();
+
+    std::cout << "    " << key << " rays : " << compute_sample_statistics(mrays_per_second).median << " Mrays/s" << std::endl;
+}
+
+static auto write_construct_bvh_info(JsonWriter & json, const ConstructBVHInfo & info) -> void
+{
+    json.begin_object("construct_info");
+    json.value("ray_primitive_intersection_cost", info.ray_primitive_intersection_cost);
+    json.value("ray_aabb_intersection_cost", info.ray_aabb_intersection_cost);
+    json.value("spatial_bin_count", info.spatial_bin_count);
+    json.value("spatial_alpha", info.spatial_alpha);
+    json.value("join_leaves", info.join_leaves);
+    json.value("max_triangles_in_leaves", info.max_triangles_in_leaves);
+    json.value("min_depth_for_join", info.min_depth_for_join);
+    json.value("quantize_leaves", info.quantize_leaves);
+    json.value("collapse_leaves", info.collapse_leaves);
+    json.value("reference_splitting", info.reference_splitting == ReferenceSplitting::EARLY_SPLIT_CLIPPING ? "esc" : "spatial");
+    json.value("early_split_budget", info.early_split_budget);
+    json.end_object();
+}
+
+static auto benchmark_scene(JsonWriter & json, const BenchmarkConfig & config, const BenchmarkScene & benchmark_scene) -> void
+{
+    std::cout << "scene " << benchmark_scene.path << std::endl;
+    Scene scene(benchmark_scene.path, config.geometry);
+    if(scene.raytracing_scene.indices.empty())
+    {
+        throw std::runtime_error("[benchmark_scene()] scene " + benchmark_scene.path + " could not be loaded or is empty");
+    }
+    scene.light_position = benchmark_scene.light_position;
+    const RayBatch random_batch = make_random_batch(scene.raytracing_scene.get_bounds(), config.random_ray_count, config.seed);
+
+    for(const auto & builder_name : config.builders)
+    {
+        const BuilderConfig builder = get_builder_config(builder_name, config.base_bvh_info);
+        std::cout << "  builder " << builder.name << std::endl;
+
+        std::vector<f64> build_times;
+        BVHStats stats;
+        for(u32 i = 0; i < config.warmup + config.repetitions; i++)
+        {
+            stats = scene.build_bvh(builder.info);
+            if(i >= config.warmup) { build_times.push_back(stats.build_time); }
+        }
+        const BVHMemoryFootprint memory = scene.raytracing_scene.get_memory_footprint();
+        std::cout << "    build time : " << compute_sample_statistics(build_times).median << " ms" << std::endl;
+
+        json.begin_object();
+        json.value("scene", benchmark_scene.path);
+        json.value("builder", builder.name);
+        write_construct_bvh_info(json, builder.info);
+
+        json.begin_object("build");
+        write_statistics(json, "build_time_ms", build_times);
+        json.value("split_cost_sum", stats.total_cost);
+        json.value("triangle_count", stats.triangle_count);
+        json.value("inner_node_count", stats.inner_node_count);
+        json.value("leaf_count", stats.leaf_count);
+        json.value("leaf_primitives_count", stats.leaf_primitives_count);
+        json.value("max_tree_depth", stats.max_tree_depth);
+        json.value("average_leaf_depth", stats.average_leaf_depth);
+        // the quality metrics are only defined over a single tree, instanced scenes miss them in the results
+        if(!scene.raytracing_scene.is_instanced())
+        {
+            const BVHQualityMetrics quality = scene.raytracing_scene.bvh.get_quality_metrics();
+            json.value("sah_cost", quality.sah_cost);
+            json.value("epo", quality.epo);
+            json.value("sibling_overlap", quality.sibling_overlap);
+            json.value("duplication_factor", quality.duplication_factor);
+            json.begin_array("leaf_size_histogram");
+            for(const u32 leaf_count : quality.leaf_size_histogram) { json.value("", leaf_count); }
+            json.end_array();
+        }
+        if(builder.info.quantize_leaves)
+        {
+            json.value("quantized_memory_ratio", stats.quantized_memory_ratio);
+            json.value("quantized_traversal_slowdown", stats.quantized_traversal_slowdown);
+        }
+        json.end_object();
+
+        json.begin_object("memory");
+        json.value("node_bytes", memory.nodes);
+        json.value("leaf_bytes", memory.leaves);
+        json.value("stackless_link_bytes", memory.stackless_links);
+        json.value("quantized_leaf_bytes", memory.quantized_leaves);
+        json.value("triangle_bytes", memory.triangles);
+        json.value("total_bytes", memory.get_total());
+        json.end_object();
+
+        auto views = benchmark_scene.views;
+        if(views.empty()) { views.emplace_back(""); }
+
+        json.begin_array("traversal");
+        for(const auto & kernel_name : config.kernels)
+        {
+            const BatchTraceInfo trace_info = {
+                .kernel = parse_batch_kernel(kernel_name),
+                .thread_count = config.thread_count
+            };
+            for(const auto & view : views)
+            {
+                std::cout << "  kernel " << kernel_name << " view " << (view.empty() ? "<default>" : view) << std::endl;
+                Camera camera = make_default_camera(config.resolution);
+                if(!view.empty() && !camera.parse_view_file(view))
+                {
+                    throw std::runtime_error("[benchmark_scene()] could not parse view file " + view);
+                }
+
+                const RayBatch primary_batch = make_primary_batch(camera, config.resolution);
+                std::vector<Hit> primary_hits(primary_batch.rays.size());
+                scene.raytracing_scene.intersect(primary_batch.rays, primary_hits, trace_info);
+                const RayBatch shadow_batch = make_shadow_batch(primary_batch, primary_hits, scene.light_position);
+
+                json.begin_object();
+                json.value("kernel", kernel_name);
+                json.value("view", view);
+                benchmark_ray_batch(json, "primary", config, scene.raytracing_scene, primary_batch, trace_info);
+                benchmark_ray_batch(json, "shadow", config, scene.raytracing_scene, shadow_batch, trace_info);
+                benchmark_ray_batch(json, "random", config, scene.raytracing_scene, random_batch, trace_info);
+                json.end_object();
+            }
+        }
+        json.end_array();
+        json.end_object();
+    }
+}
+
+static auto run_benchmarks(const CommandLine & command_line, const std::string & output_path) -> void
+{
+    BenchmarkConfig config = {
+        .scenes = {},
+        .builders = split_list(command_line.get_string("--builders", "sbvh,object")),
+        .kernels = split_list(command_line.get_string("--kernels", "auto")),
+        .base_bvh_info = parse_construct_bvh_info(command_line),
+        .geometry = command_line.has("--instanced") ? SceneGeometry::INSTANCED : SceneGeometry::FLATTENED,
+        .resolution = parse_resolution(command_line.get_string("--resolution", "512x512")),
+        .thread_count = command_line.get_u32("--threads", glm::max(std::thread::hardware_concurrency(), 1u)),
+        .repetitions = glm::max(command_line.get_u32("--repetitions", 5), 1u),
+        .warmup = command_line.get_u32("--warmup", 1),
+        .random_ray_count = command_line.get_u32("--random-rays", 512 * 512),
+        .seed = command_line.get_u32("--seed", 1337)
+    };
+
+    if(command_line.has("--suite"))
+    {
+        config.scenes = parse_suite_file(command_line.get_string("--suite", ""));
+    }
+    else
+    {
+        config.scenes.push_back({
+            .path = command_line.get_string("--scene", ""),
+            .views = command_line.get_all("--view"),
+            .light_position = parse_vec3(command_line.get_string("--light", "-11 15 7"))
+        });
+    }
+
+    std::ofstream output(output_path);
+    if(!output.is_open()) { throw std::runtime_error("[run_benchmarks()] could not open output file " + output_path); }
+
+    JsonWriter json(output);
+    json.begin_object();
+    json.value("version", BENCHMARK_RESULTS_VERSION);
+    json.value("repetitions", config.repetitions);
+    json.value("warmup", config.warmup);
+    json.value("instanced", config.geometry == SceneGeometry::INSTANCED);
+    json.value("thread_count", config.thread_count);
+    json.value("resolution_x", config.resolution.x);
+    json.value("resolution_y", config.resolution.y);
+    json.value("random_ray_count", config.random_ray_count);
+    json.value("seed", config.seed);
+    json.begin_array("results");
+    for(const auto & scene : config.scenes)
+    {
+        benchmark_scene(json, config, scene);
+    }
+    json.end_array();
+    json.end_object();
+
+    std::cout << "results written to " << output_path << std::endl;
+}
+
+static auto get_build_metrics() -> std::vector<Metric>
+{
+    return {
+        {"build time ms", {"build", "build_time_ms", "median"}, MetricKind::PERFORMANCE, false},
+        {"SAH cost", {"build", "sah_cost"}, MetricKind::QUALITY, false},
+        {"EPO", {"build", "epo"}, MetricKind::QUALITY, false},
+        {"inner node count", {"build", "inner_node_count"}, MetricKind::QUALITY, false},
+        {"leaf count", {"build", "leaf_count"}, MetricKind::QUALITY, false},
+        {"leaf primitives count", {"build", "leaf_primitives_count"}, MetricKind::QUALITY, false},
+        {"memory bytes", {"memory", "total_bytes"}, MetricKind::QUALITY, false},
+    };
+}
+
+static auto get_traversal_metrics() -> std::vector<Metric>
+{
+    return {
+        {"primary Mrays/s", {"primary", "mrays_per_second", "median"}, MetricKind::PERFORMANCE, true},
+        {"shadow Mrays/s", {"shadow", "mrays_per_second", "median"}, MetricKind::PERFORMANCE, true},
+        {"random Mrays/s", {"random", "mrays_per_second", "median"}, MetricKind::PERFORMANCE, true},
+    };
+}
+
+// true if both values have the member with the same value or both miss it
+static auto same_member(const JsonValue & first, const JsonValue & second, const std::string & key) -> bool
+{
+    const JsonValue * first_member = first.find(key);
+    const JsonValue * second_member = second.find(key);
+    if(first_member == nullptr || second_member == nullptr) { return first_member == second_member; }
+    return *first_member == *second_member;
+}
+
+// finds the entry of the array whose members under the keys have the same values as in the entry
+static auto find_matching_entry(const JsonValue * array, const JsonValue & entry, const std::vector<std::string> & keys) -> const JsonValue *
+{
+    if(array == nullptr || !array->is_array()) { return nullptr; }
+    for(const auto & candidate : array->as_array())
+    {
+        bool matches = true;
+        for(const auto & key : keys) { matches = matches && same_member(candidate, entry, key); }
+        if(matches) { return &candidate; }
+    }
+    return nullptr;
+}
+
+// the builder name alone does not identify the build, the parameters given on the command line change it too
+static const std::vector<std::string> RESULT_ENTRY_KEYS = {"scene", "builder", "construct_info"};
+static const std::vector<std::string> TRAVERSAL_ENTRY_KEYS = {"kernel", "view"};
+// results measured with different values of these are not comparable
+static const std::vector<std::string> RESULTS_HEADER_KEYS = {"instanced", "thread_count", "resolution_x", "resolution_y", "random_ray_count", "seed"};
+
+static auto get_result_label(const JsonValue & entry) -> std::string
+{
+    return entry.find_string("scene") + " [" + entry.find_string("builder") + "]";
+}
+
+static auto get_traversal_label(const std::string & label, const JsonValue & traversal) -> std::string
+{
+    const std::string view = traversal.find_string("view");
+    return label + " " + traversal.find_string("kernel") + " " + (view.empty() ? "<default>" : view);
+}
+
+// reports the entries of the baseline the current results have no match for, returns their number
+template<typename GetLabel>
+static auto report_missing_entries(const JsonValue * current, const JsonValue * baseline, const std::vector<std::string> & keys, GetLabel && get_label) -> u32
+{
+    if(baseline == nullptr || !baseline->is_array()) { return 0; }
+    u32 missing = 0;
+    for(const auto & baseline_entry : baseline->as_array())
+    {
+        if(find_matching_entry(current, baseline_entry, keys) != nullptr) { continue; }
+        missing++;
+        std::cout << "MISSING    " << get_label(baseline_entry) << " is in the baseline but not in the results" << std::endl;
+    }
+    return missing;
+}
+
+// prints the comparison of all metrics of the entry, returns the number of regressed metrics and of the metrics
+// missing from the current entry
+static auto compare_metrics(
+    const std::string & label,
+    const JsonValue & current,
+    const JsonValue & baseline,
+    const std::vector<Metric> & metrics,
+    const RegressionThresholds & thresholds) -> u32
+{
+    u32 regressions = 0;
+    for(const auto & metric : metrics)
+    {
+        const auto current_value = current.find_number(metric.path);
+        const auto baseline_value = baseline.find_number(metric.path);
+        if(!baseline_value.has_value()) { continue; }
+        if(!current_value.has_value())
+        {
+            regressions++;
+            std::cout << "MISSING    " << label << " " << metric.name << " is in the baseline but not in the results" << std::endl;
+            continue;
+        }
+        if(baseline_value.value() == 0.0) { continue; }
+
+        const f64 change = (current_value.value() - baseline_value.value()) / glm::abs(baseline_value.value());
+        const f64 threshold = metric.kind == MetricKind::QUALITY ? thresholds.quality : thresholds.performance;
+        const bool regressed = metric.higher_is_better ? change < -threshold : change > threshold;
+        if(regressed) { regressions++; }
+
+        std::cout << (regressed ? "REGRESSION " : "           ") << label << " " << metric.name << " : "
+                  << baseline_value.value() << " -> " << current_value.value()
+                  << " (" << (change >= 0.0 ? "+" : "") << change * 100.0 << "%)" << std::endl;
+    }
+    return regressions;
+}
+
+// compares every scene and builder configuration and every traversal kernel and view present in both
+// results, returns the total number of regressed metrics plus the entries and metrics of the baseline the
+// results miss
+static auto compare_results(const JsonValue & current, const JsonValue & baseline, const RegressionThresholds & thresholds) -> u32
+{
+    const auto * current_results = current.find("results");
+    if(current_results == nullptr || !current_results->is_array())
+    {
+        throw std::runtime_error("[compare_results()] results file has no results array");
+    }
+
+    if(current.find_number({"version"}) != baseline.find_number({"version"}))
+    {
+        throw std::runtime_error("[compare_results()] results and baseline were written by different benchmark versions");
+    }
+    for(const auto & key : RESULTS_HEADER_KEYS)
+    {
+        if(!same_member(current, baseline, key))
+        {
+            throw std::runtime_error("[compare_results()] results and baseline were measured with different " + key);
+        }
+    }
+
+    u32 regressions = report_missing_entries(current_results, baseline.find("results"), RESULT_ENTRY_KEYS, get_result_label);
+    for(const auto & entry : current_results->as_array())
+    {
+        const std::string label = get_result_label(entry);
+        const auto * baseline_entry = find_matching_entry(baseline.find("results"), entry, RESULT_ENTRY_KEYS);
+        if(baseline_entry == nullptr)
+        {
+            std::cout << "           " << label << " has no baseline" << std::endl;
+            continue;
+        }
+        regressions += compare_metrics(label, entry, *baseline_entry, get_build_metrics(), thresholds);
+
+        const auto * traversals = entry.find("traversal");
+        regressions += report_missing_entries(
+            traversals, baseline_entry->find("traversal"), TRAVERSAL_ENTRY_KEYS,
+            [&](const JsonValue & traversal) { return get_traversal_label(label, traversal); });
+        if(traversals == nullptr || !traversals->is_array()) { continue; }
+        for(const auto & traversal : traversals->as_array())
+        {
+            const std::string traversal_label = get_traversal_label(label, traversal);
+            const auto * baseline_traversal = find_matching_entry(baseline_entry->find("traversal"), traversal, TRAVERSAL_ENTRY_KEYS);
+            if(baseline_traversal == nullptr)
+            {
+                std::cout << "           " << traversal_label << " has no baseline" << std::endl;
+                continue;
+            }
+            regressions += compare_metrics(traversal_label, traversal, *baseline_traversal, get_traversal_metrics(), thresholds);
+        }
+    }
+    return regressions;
+}
+
+static auto run(const CommandLine & command_line) -> int
+{
+    std::string results_path = command_line.get_string("--compare", "");
+    if(results_path.empty())
+    {
+        results_path = command_line.get_string("--output", "benchmark_results.json");
+        run_benchmarks(command_line, results_path);
+    }
+
+    if(!command_line.has("--baseline")) { return 0; }
+
+    const RegressionThresholds thresholds = {
+        .quality = command_line.get_f32("--threshold", 0.01f),
+        .performance = command_line.get_f32("--perf-threshold", 0.05f)
+    };
+    const u32 regressions = compare_results(
+        parse_json_file(results_path),
+        parse_json_file(command_line.get_string("--baseline", "")),
+        thresholds);
+
+    if(regressions > 0)
+    {
+        std::cout << regressions << " metrics regressed against the baseline or are missing from the results" << std::endl;
+        return 2;
+    }
+    std::cout << "no regressions against the baseline" << std::endl;
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    const CommandLine command_line(argc, argv);
+    const bool has_input = command_line.has("--suite") || command_line.has("--scene") || command_line.has("--compare");
+    if(command_line.has("--help") || !has_input)
+    {
+        print_usage();
+        return command_line.has("--help") ? 0 : 1;
+    }
+    // a comparison without a baseline has nothing to compare against
+    if(command_line.has("--compare") && !command_line.has("--baseline"))
+    {
+        std::cerr << "[SBVH_benchmark] --compare requires --baseline" << std::endl;
+        print_usage();
+        return 1;
+    }
+
+    try
+    {
+        return run(command_line);
+    }
+    catch(const std::exception & exception)
+    {
+        std::cerr << "[SBVH_benchmark] " << exception.what() << std::endl;
+        return 1;
+    }
+}
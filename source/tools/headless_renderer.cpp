@@ -0,0 +1,229 @@
+// Headless batch renderer - loads a scene, builds the BVH and renders one or more .view cameras
+// into HDR images without any windowing or GPU dependencies
+#include <chrono>
+#include <thread>
+#include <iostream>
+
+#include "tool_utils.hpp"
+#include "../raytracing_backend/scene.hpp"
+#include "../raytracing_backend/raytracer.hpp"
+#include "../raytracing_backend/ray_capture.hpp"
+#include "../raytracing_backend/bvh_calibration.hpp"
+#include "../rendering_backend/camera.hpp"
+
+static auto print_usage() -> void
+{
+    std::cout <<
+        "usage: SBVH_headless --scene <path> [options]\n"
+        "  --scene <path>              scene file loadable by assimp or a binary scene file\n"
+        "  --convert-scene <path>      write the loaded scene into a binary scene file and exit without rendering\n"
+        "  --instanced                 keep meshes referenced by several objects only once and trace them through a two level BVH\n"
+        "  --view <path>               .view camera file, can be repeated to render multiple views\n"
+        "  --resolution <WxH>          output resolution (default 800x800)\n"
+        "  --output <prefix>           output image prefix, images are written as <prefix>_<view>.hdr (default out)\n"
+        "  --threads <n>               render threads (default hardware concurrency)\n"
+        "  --mode <name>               traversal mode single|packet|stream|interleaved|stackless (default single)\n"
+        "  --light \"<x> <y> <z>\"       light position (default \"-11 15 7\")\n"
+        "  --capture <prefix>          capture all traced rays with their hits into <prefix>_<view>.rays for SBVH_replay\n"
+        "  --load-bvh <path>           map a .bvh file instead of building the BVH, the build parameters are ignored\n"
+        "  --save-bvh <path>           write the built BVH into a .bvh file\n"
+        "  --bvh-cache <dir>           load the BVH from the cache directory if it was already built, store it otherwise\n"
+        "  --bvh-cache-size <MiB>      size limit of the cache directory (default 4096)\n"
+        "  --calibrate-costs           derive the SAH intersection costs from microbenchmarks and fitted primary ray traces\n"
+        "                              of the first view, the costs passed on the command line only serve as the base\n"
+        << construct_bvh_info_usage();
+}
+
+static auto run(const CommandLine & command_line) -> int
+{
+    const std::string scene_path = command_line.get_string("--scene", "");
+    const u32vec2 resolution = parse_resolution(command_line.get_string("--resolution", "800x800"));
+    const std::string output_prefix = command_line.get_string("--output", "out");
+    const u32 thread_count = command_line.get_u32("--threads", glm::max(std::thread::hardware_concurrency(), 1u));
+    const TraversalMode traversal_mode = parse_traversal_mode(command_line.get_string("--mode", "single"));
+
+    auto load_start = std::chrono::high_resolution_clock::now();
+    Scene scene(scene_path, command_line.has("--instanced") ? SceneGeometry::INSTANCED : SceneGeometry::FLATTENED);
+    auto load_end = std::chrono::high_resolution_clock::now();
+    if(scene.raytracing_scene.indices.empty())
+    {
+        std::cerr << "[SBVH_headless] scene " << scene_path << " could not be loaded or is empty" << std::endl;
+        return 1;
+    }
+    std::chrono::duration<double, std::milli> load_time = load_end - load_start;
+    std::cout << "scene load time             : " << load_time.count() << " ms" << std::endl;
+
+    if(command_line.has("--convert-scene"))
+    {
+        const std::string binary_scene_path = command_line.get_string("--convert-scene", "");
+        if(!scene.save_binary(binary_scene_path))
+        {
+            std::cerr << "[SBVH_headless] could not write binary scene " << binary_scene_path << std::endl;
+            return 1;
+        }
+        std::cout << "converted " << scene_path << " into " << binary_scene_path << std::endl;
+        return 0;
+    }
+
+    scene.light_position = parse_vec3(command_line.get_string("--light", "-11 15 7"));
+    if(scene.raytracing_scene.is_instanced() && (command_line.has("--load-bvh") || command_line.has("--save-bvh")))
+    {
+        std::cerr << "[SBVH_headless] BVH files are not supported for instanced scenes" << std::endl;
+        return 1;
+    }
+    if(scene.raytracing_scene.is_instanced())
+    {
+        std::cout << "scene instances             : " << scene.raytracing_scene.instances.size() << " of "
+                  << scene.raytracing_scene.meshes.size() << " meshes" << std::endl;
+    }
+
+    ConstructBVHInfo bvh_info = parse_construct_bvh_info(command_line);
+    if(command_line.has("--calibrate-costs") && !command_line.has("--load-bvh"))
+    {
+        // the fit traces the primary rays of the first view at a reduced resolution, instanced scenes
+        // only get the microbenchmarked costs as the fit builds the single level BVH
+        std::vector<Ray> calibration_rays;
+        Camera calibration_camera = make_default_camera(resolution);
+        const auto calibration_views = command_line.get_all("--view");
+        if(!calibration_views.empty() && !calibration_camera.parse_view_file(calibration_views.front()))
+        {
+            std::cerr << "[SBVH_headless] could not parse view file " << calibration_views.front() << std::endl;
+            return 1;
+        }
+        if(!scene.raytracing_scene.is_instanced())
+        {
+            const u32vec2 calibration_resolution = glm::min(resolution, u32vec2(256, 256));
+            calibration_rays.reserve(static_cast<size_t>(calibration_resolution.x) * calibration_resolution.y);
+            for(u32 y = 0; y < calibration_resolution.y; y++)
+            {
+                for(u32 x = 0; x < calibration_resolution.x; x++)
+                {
+                    calibration_rays.push_back(calibration_camera.get_ray({x, y}, calibration_resolution));
+                }
+            }
+        }
+        auto calibration_start = std::chrono::high_resolution_clock::now();
+        const SAHCostCalibration calibration = calibrate_sah_costs({
+            .base_info = bvh_info,
+            .triangles = calibration_rays.empty() ? IndexedTriangles{} : scene.raytracing_scene.get_triangles(),
+            .rays = calibration_rays,
+            .trace_info = {.thread_count = thread_count}
+        });
+        auto calibration_end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> calibration_time = calibration_end - calibration_start;
+        bvh_info = calibration.info;
+        std::cout << "ray-AABB test               : " << calibration.ray_aabb_test_ns << " ns" << std::endl;
+        std::cout << "ray-triangle test           : " << calibration.ray_triangle_test_ns << " ns" << std::endl;
+        if(calibration.fit_build_count > 0)
+        {
+            std::cout << "fitted trace time           : " << calibration.fitted_trace_time << " ms (microbenchmarked costs "
+                      << calibration.microbenchmarked_trace_time << " ms, " << calibration.fit_build_count << " builds)" << std::endl;
+        }
+        std::cout << "calibrated costs            : --primitive-cost " << bvh_info.ray_primitive_intersection_cost
+                  << " --aabb-cost " << bvh_info.ray_aabb_intersection_cost << std::endl;
+        std::cout << "calibration time            : " << calibration_time.count() << " ms" << std::endl;
+    }
+
+    BVHStats bvh_stats = {};
+    if(command_line.has("--load-bvh"))
+    {
+        const std::string bvh_path = command_line.get_string("--load-bvh", "");
+        auto bvh_load_start = std::chrono::high_resolution_clock::now();
+        if(!scene.raytracing_scene.bvh.load_from_file(bvh_path, bvh_stats))
+        {
+            std::cerr << "[SBVH_headless] could not load BVH file " << bvh_path << std::endl;
+            return 1;
+        }
+        auto bvh_load_end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> bvh_load_time = bvh_load_end - bvh_load_start;
+        std::cout << "BVH file load time          : " << bvh_load_time.count() << " ms" << std::endl;
+    }
+    else if(command_line.has("--bvh-cache"))
+    {
+        BVHCache cache({
+            .directory = command_line.get_string("--bvh-cache", ""),
+            .max_size_bytes = u64(command_line.get_u32("--bvh-cache-size", 4096)) * 1024 * 1024
+        });
+        bvh_stats = scene.build_bvh(bvh_info, &cache);
+    }
+    else
+    {
+        bvh_stats = scene.build_bvh(bvh_info);
+    }
+    print_bvh_stats(bvh_stats);
+    if(!scene.raytracing_scene.is_instanced()) { print_bvh_quality_metrics(scene.raytracing_scene.bvh.get_quality_metrics()); }
+
+    if(command_line.has("--save-bvh"))
+    {
+        const std::string bvh_path = command_line.get_string("--save-bvh", "");
+        if(!scene.raytracing_scene.bvh.save_to_file(bvh_path, bvh_stats))
+        {
+            std::cerr << "[SBVH_headless] could not write BVH file " << bvh_path << std::endl;
+            return 1;
+        }
+    }
+
+    Raytracer raytracer(resolution);
+    raytracer.set_thread_count(thread_count);
+    raytracer.set_traversal_mode(traversal_mode);
+    raytracer.set_capture_rays(command_line.has("--capture"));
+
+    Camera camera = make_default_camera(resolution);
+
+    auto views = command_line.get_all("--view");
+    // without any view file render the default camera of the interactive application
+    if(views.empty()) { views.emplace_back(""); }
+
+    f64 total_render_time = 0.0;
+    for(size_t view_idx = 0; view_idx < views.size(); view_idx++)
+    {
+        const auto & view = views.at(view_idx);
+        if(!view.empty() && !camera.parse_view_file(view))
+        {
+            std::cerr << "[SBVH_headless] could not parse view file " << view << std::endl;
+            return 1;
+        }
+
+        const std::string image_path = output_prefix + "_" + std::to_string(view_idx) + ".hdr";
+        raytracer.set_export_path(image_path);
+        const f64 render_time = raytracer.raytrace_scene(scene, camera);
+        total_render_time += render_time;
+
+        const f64 mrays_per_second = f64(resolution.x) * f64(resolution.y) / (render_time * 1000.0);
+        std::cout << "view " << (view.empty() ? "<default>" : view) << " -> " << image_path
+                  << " : " << render_time << " ms (" << mrays_per_second << " Mrays/s)" << std::endl;
+
+        if(command_line.has("--capture"))
+        {
+            const std::string capture_path = command_line.get_string("--capture", "") + "_" + std::to_string(view_idx) + ".rays";
+            if(!save_ray_capture(capture_path, raytracer.get_captured_rays()))
+            {
+                std::cerr << "[SBVH_headless] could not write ray capture " << capture_path << std::endl;
+                return 1;
+            }
+            std::cout << "captured " << raytracer.get_captured_rays().size() << " rays into " << capture_path << std::endl;
+        }
+    }
+    std::cout << "total render time           : " << total_render_time << " ms" << std::endl;
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    const CommandLine command_line(argc, argv);
+    if(command_line.has("--help") || !command_line.has("--scene"))
+    {
+        print_usage();
+        return command_line.has("--help") ? 0 : 1;
+    }
+
+    try
+    {
+        return run(command_line);
+    }
+    catch(const std::exception & exception)
+    {
+        std::cerr << "[SBVH_headless] " << exception.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <optional>
+#include <stdexcept>
+#include <cctype>
+#include <string_view>
+
+#include "../types.hpp"
+
+// Minimal JSON document model used by the tools to read back their own results
+struct JsonValue
+{
+    using Array = std::vector<JsonValue>;
+    // members are kept in the file order
+    using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+    std::variant<std::nullptr_t, bool, f64, std::string, Array, Object> value = nullptr;
+
+    [[nodiscard]] auto is_number() const -> bool { return std::holds_alternative<f64>(value); }
+    [[nodiscard]] auto is_string() const -> bool { return std::holds_alternative<std::string>(value); }
+    [[nodiscard]] auto is_array() const -> bool { return std::holds_alternative<Array>(value); }
+    [[nodiscard]] auto is_object() const -> bool { return std::holds_alternative<Object>(value); }
+
+    [[nodiscard]] auto as_number() const -> f64 { return std::get<f64>(value); }
+    [[nodiscard]] auto as_string() const -> const std::string & { return std::get<std::string>(value); }
+    [[nodiscard]] auto as_array() const -> const Array & { return std::get<Array>(value); }
+
+    // returns nullptr if this is not an object or it has no member with the key
+    [[nodiscard]] auto find(const std::string & key) const -> const JsonValue *
+    {
+        if(!is_object()) { return nullptr; }
+        for(const auto & [member_key, member] : std::get<Object>(value))
+        {
+            if(member_key == key) { return &member; }
+        }
+        return nullptr;
+    }
+
+    // follows the path of object keys, returns empty optional if any of them is missing or the value is not a number
+    [[nodiscard]] auto find_number(const std::vector<std::string> & path) const -> std::optional<f64>
+    {
+        const JsonValue * current = this;
+        for(const auto & key : path)
+        {
+            current = current->find(key);
+            if(current == nullptr) { return std::nullopt; }
+        }
+        if(!current->is_number()) { return std::nullopt; }
+        return current->as_number();
+    }
+
+    [[nodiscard]] auto find_string(const std::string & key) const -> std::string
+    {
+        const JsonValue * member = find(key);
+        return (member != nullptr && member->is_string()) ? member->as_string() : std::string();
+    }
+
+    // deep comparison, objects only compare equal with their members in the same order
+    [[nodiscard]] auto operator==(const JsonValue & other) const -> bool = default;
+};
+
+struct JsonParser
+{
+    explicit JsonParser(std::string text) : text{std::move(text)} {}
+
+    auto parse() -> JsonValue
+    {
+        JsonValue result = parse_value();
+        skip_whitespace();
+        if(position != text.size()) { error("unexpected trailing characters"); }
+        return result;
+    }
+
+    private:
+        std::string text;
+        size_t position = 0;
+
+        [[noreturn]] auto error(const std::string & message) const -> void
+        {
+            throw std::runtime_error("[JsonParser] " + message + " at offset " + std::to_string(position));
+        }
+
+        auto skip_whitespace() -> void
+        {
+            while(position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) { position++; }
+        }
+
+        auto peek() -> char
+        {
+            skip_whitespace();
+            if(position >= text.size()) { error("unexpected end of input"); }
+            return text[position];
+        }
+
+        auto expect(char character) -> void
+        {
+            if(peek() != character) { error(std::string("expected ") + character); }
+            position++;
+        }
+
+        auto consume_literal(const std::string & literal) -> bool
+        {
+            if(text.compare(position, literal.size(), literal) != 0) { return false; }
+            position += literal.size();
+            return true;
+        }
+
+        auto parse_value() -> JsonValue
+        {
+            const char character = peek();
+            if(character == '{') { return parse_object(); }
+            if(character == '[') { return parse_array(); }
+            if(character == '"') { return JsonValue{parse_string()}; }
+            if(consume_literal("true"))  { return JsonValue{true}; }
+            if(consume_literal("false")) { return JsonValue{false}; }
+            if(consume_literal("null"))  { return JsonValue{nullptr}; }
+            return parse_number();
+        }
+
+        auto parse_object() -> JsonValue
+        {
+            expect('{');
+            JsonValue::Object object;
+            if(peek() == '}') { position++; return JsonValue{std::move(object)}; }
+            while(true)
+            {
+                if(peek() != '"') { error("expected object key"); }
+                std::string key = parse_string();
+                expect(':');
+                object.emplace_back(std::move(key), parse_value());
+                if(peek() == ',') { position++; continue; }
+                expect('}');
+                return JsonValue{std::move(object)};
+            }
+        }
+
+        auto parse_array() -> JsonValue
+        {
+            expect('[');
+            JsonValue::Array array;
+            if(peek() == ']') { position++; return JsonValue{std::move(array)}; }
+            while(true)
+            {
+                array.push_back(parse_value());
+                if(peek() == ',') { position++; continue; }
+                expect(']');
+                return JsonValue{std::move(array)};
+            }
+        }
+
+        auto parse_string() -> std::string
+        {
+            expect('"');
+            std::string result;
+            while(position < text.size() && text[position] != '"')
+            {
+                char character = text[position++];
+                if(character == '\\')
+                {
+                    if(position >= text.size()) { break; }
+                    const char escaped = text[position++];
+                    switch(escaped)
+                    {
+                        case 'n': { character = '\n'; break; }
+                        case 't': { character = '\t'; break; }
+                        case 'r': { character = '\r'; break; }
+                        // NOTE(msakmary) the tools never write unicode escapes, keep them as they are
+                        case 'u': { result += "\\u"; continue; }
+                        default:  { character = escaped; }
+                    }
+                }
+                result += character;
+            }
+            if(position >= text.size()) { error("unterminated string"); }
+            position++;
+            return result;
+        }
+
+        auto parse_number() -> JsonValue
+        {
+            const size_t start = position;
+            while(position < text.size() && std::string_view("+-0123456789.eE").find(text[position]) != std::string_view::npos)
+            {
+                position++;
+            }
+            if(start == position) { error("unexpected character"); }
+            return JsonValue{std::stod(text.substr(start, position - start))};
+        }
+};
+
+inline auto parse_json_file(const std::string & path) -> JsonValue
+{
+    std::ifstream file(path);
+    if(!file.is_open()) { throw std::runtime_error("[parse_json_file()] could not open " + path); }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return JsonParser(buffer.str()).parse();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <cmath>
+#include <type_traits>
+
+// Minimal streaming JSON writer used by the tools to produce machine readable results.
+// Keys are ignored for values written directly into arrays
+struct JsonWriter
+{
+    explicit JsonWriter(std::ostream & out) : out{out}
+    {
+        out << std::setprecision(9);
+    }
+
+    auto begin_object(const std::string & key = "") -> void
+    {
+        write_prefix(key);
+        out << "{";
+        first_in_scope.push_back(true);
+    }
+
+    auto end_object() -> void
+    {
+        end_scope();
+        out << "}";
+        if(first_in_scope.empty()) { out << "\n"; }
+    }
+
+    auto begin_array(const std::string & key = "") -> void
+    {
+        write_prefix(key);
+        out << "[";
+        first_in_scope.push_back(true);
+    }
+
+    auto end_array() -> void
+    {
+        end_scope();
+        out << "]";
+    }
+
+    auto value(const std::string & key, const std::string & string) -> void
+    {
+        write_prefix(key);
+        write_string(string);
+    }
+
+    auto value(const std::string & key, const char * string) -> void { value(key, std::string(string)); }
+
+    auto value(const std::string & key, bool boolean) -> void
+    {
+        write_prefix(key);
+        out << (boolean ? "true" : "false");
+    }
+
+    auto value(const std::string & key, double number) -> void
+    {
+        write_prefix(key);
+        // NOTE(msakmary) JSON has no representation of inf and nan
+        if(std::isfinite(number)) { out << number; }
+        else                      { out << "null"; }
+    }
+
+    template<typename T>
+    requires std::is_integral_v<T>
+    auto value(const std::string & key, T number) -> void
+    {
+        write_prefix(key);
+        out << number;
+    }
+
+    private:
+        std::ostream & out;
+        // one entry per open object or array - false once the scope has at least one member
+        std::vector<bool> first_in_scope;
+
+        auto write_prefix(const std::string & key) -> void
+        {
+            if(first_in_scope.empty()) { return; }
+            if(!first_in_scope.back()) { out << ","; }
+            first_in_scope.back() = false;
+            out << "\n" << std::string(first_in_scope.size() * 2, ' ');
+            if(!key.empty())
+            {
+                write_string(key);
+                out << ": ";
+            }
+        }
+
+        auto end_scope() -> void
+        {
+            const bool empty = first_in_scope.back();
+            first_in_scope.pop_back();
+            if(!empty) { out << "\n" << std::string(first_in_scope.size() * 2, ' '); }
+        }
+
+        auto write_string(const std::string & string) -> void
+        {
+            out << "\"";
+            for(const char character : string)
+            {
+                switch(character)
+                {
+                    case '"':  { out << "\\\""; break; }
+                    case '\\': { out << "\\\\"; break; }
+                    case '\n': { out << "\\n"; break; }
+                    case '\t': { out << "\\t"; break; }
+                    default:   { out << character; }
+                }
+            }
+            out << "\"";
+        }
+};
@@ -0,0 +1,376 @@
+// Microbenchmarks of the geometric kernels used by the BVH builder and the traversal. Every kernel is run
+// over seeded synthetic triangle sets so that changes to a single kernel can be measured in isolation
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SBVH_HAS_CYCLE_COUNTER
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SBVH_HAS_CYCLE_COUNTER
+#endif
+
+#include "tool_utils.hpp"
+#include "json_writer.hpp"
+#include "../raytracing_backend/bvh.hpp"
+
+// NOTE(msakmary) results of the kernels are accumulated into this so that the compiler can't remove the measured loops
+static volatile u64 benchmark_sink = 0;
+
+// Returns the time stamp counter - it ticks at a constant rate which may differ from the actual core
+// clock when the CPU boosts, cycles/op are therefore only comparable between runs on the same machine
+static inline auto read_cycle_counter() -> u64
+{
+#ifdef SBVH_HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0ull;
+#endif
+}
+
+struct Dataset
+{
+    std::string name;
+    std::vector<Triangle> triangles;
+    std::vector<AABB> aabbs;
+    // one ray per triangle aimed at its neighbourhood so that roughly half of the rays hit
+    std::vector<Ray> rays;
+    std::vector<types::Polygon> polygons;
+};
+
+struct MicrobenchmarkConfig
+{
+    u32 element_count;
+    u32 repetitions;
+    u32 warmup;
+    u32 seed;
+};
+
+struct MicrobenchmarkResult
+{
+    std::string kernel;
+    std::string dataset;
+    SampleStatistics ns_per_op;
+    SampleStatistics cycles_per_op;
+};
+
+// runs the kernel on all elements of the dataset, returns the accumulated results which are fed into the sink
+using KernelLoop = std::function<u64(const Dataset & dataset)>;
+
+struct Kernel
+{
+    std::string name;
+    KernelLoop loop;
+};
+
+// the per element function is inlined into the loop so that only one indirect call is made per dataset pass
+template<typename Function>
+static auto make_kernel(const std::string & name, Function function) -> Kernel
+{
+    return Kernel{
+        .name = name,
+        .loop = [function](const Dataset & dataset) -> u64
+        {
+            u64 accumulated = 0;
+            for(u32 element = 0; element < u32(dataset.triangles.size()); element++)
+            {
+                accumulated += function(dataset, element);
+            }
+            return accumulated;
+        }
+    };
+}
+
+static auto print_usage() -> void
+{
+    std::cout <<
+        "usage: SBVH_microbenchmark [options]\n"
+        "  --kernels <list>            comma separated kernels to run (default all)\n"
+        "                              intersect_ray,ray_box_intersection,project_primitive_into_bin_fast,\n"
+        "                              project_primitive_into_bin_slow,clip_axis_plane,SAH\n"
+        "  --datasets <list>           comma separated datasets random,degenerate,axis_aligned,sliver (default all)\n"
+        "  --count <n>                 triangles in every dataset (default 65536)\n"
+        "  --repetitions <n>           measured repetitions of every kernel (default 10)\n"
+        "  --warmup <n>                unmeasured warm-up runs before the repetitions (default 2)\n"
+        "  --seed <n>                  seed of the datasets (default 1337)\n"
+        "  --output <path>             optional results JSON file\n";
+}
+
+static auto make_triangle(const f32vec3 & v0, const f32vec3 & v1, const f32vec3 & v2) -> Triangle
+{
+    return Triangle{
+        .v0 = v0,
+        .v1 = v1,
+        .v2 = v2
+    };
+}
+
+static auto make_dataset(const std::string & name, const MicrobenchmarkConfig & config) -> Dataset
+{
+    std::mt19937 generator(config.seed);
+    std::uniform_real_distribution<f32> coord(-1.0f, 1.0f);
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+    auto random_point = [&]() -> f32vec3 { return {coord(generator), coord(generator), coord(generator)}; };
+
+    Dataset dataset = {.name = name};
+    dataset.triangles.reserve(config.element_count);
+    for(u32 i = 0; i < config.element_count; i++)
+    {
+        const f32vec3 v0 = random_point();
+        const f32vec3 v1 = random_point();
+        f32vec3 v2 = random_point();
+        if(name == "random")
+        {
+            dataset.triangles.push_back(make_triangle(v0, v1, v2));
+        }
+        else if(name == "degenerate")
+        {
+            // alternate between triangles collapsed into a point and into a line
+            if(i % 2 == 0) { dataset.triangles.push_back(make_triangle(v0, v0, v0)); }
+            else           { dataset.triangles.push_back(make_triangle(v0, v1, glm::mix(v0, v1, unit(generator)))); }
+        }
+        else if(name == "axis_aligned")
+        {
+            auto triangle = make_triangle(v0, v1, v2);
+            const Axis axis = static_cast<Axis>(i % 3);
+            triangle.v1[axis] = triangle.v0[axis];
+            triangle.v2[axis] = triangle.v0[axis];
+            dataset.triangles.push_back(make_triangle(triangle.v0, triangle.v1, triangle.v2));
+        }
+        else if(name == "sliver")
+        {
+            // long thin triangles spanning big part of their bounding box - worst case for the AABB fit
+            v2 = glm::mix(v0, v1, unit(generator)) + random_point() * 1e-3f;
+            dataset.triangles.push_back(make_triangle(v0, v1, v2));
+        }
+        else
+        {
+            throw std::runtime_error("[make_dataset()] unknown dataset " + name);
+        }
+    }
+
+    dataset.aabbs.reserve(config.element_count);
+    dataset.rays.reserve(config.element_count);
+    dataset.polygons.reserve(config.element_count);
+    for(const auto & triangle : dataset.triangles)
+    {
+        dataset.aabbs.emplace_back(triangle);
+        dataset.polygons.push_back({triangle.v0, triangle.v1, triangle.v2});
+
+        const f32vec3 centroid = (triangle.v0 + triangle.v1 + triangle.v2) / 3.0f;
+        const f32vec3 target = centroid + random_point() * 0.25f;
+        const f32vec3 start = glm::normalize(random_point()) * 3.0f;
+        dataset.rays.emplace_back(start, target - start);
+    }
+    return dataset;
+}
+
+// projection info which splits the triangle AABB in half along the axis chosen by the element index
+template<typename Function>
+static auto with_projection_info(const Dataset & dataset, u32 element, Function && function) -> u64
+{
+    const Axis axis = static_cast<Axis>(element % 3);
+    const AABB & parent_aabb = dataset.aabbs[element];
+    AABB left_aabb;
+    AABB right_aabb;
+    function(ProjectPrimitiveInfo{
+        .triangle = dataset.triangles[element],
+        .splitting_axis = axis,
+        .left_plane_axis_coord = parent_aabb.min_bounds[axis],
+        .right_plane_axis_coord = parent_aabb.get_axis_centroid(axis),
+        .parent_aabb = parent_aabb,
+        .left_aabb = left_aabb,
+        .right_aabb = right_aabb
+    });
+    return u64(left_aabb.check_if_valid()) + u64(right_aabb.check_if_valid());
+}
+
+static auto get_kernels() -> std::vector<Kernel>
+{
+    // NOTE(msakmary) project_primitive_into_bin_slow is not static yet so it needs an instance
+    static BVH bvh;
+    static types::Polygon clipped_polygon;
+    clipped_polygon.reserve(16);
+
+    return {
+        make_kernel("intersect_ray", [](const Dataset & dataset, u32 element) -> u64
+        {
+            return u64(dataset.triangles[element].intersect_ray(dataset.rays[element]).hit);
+        }),
+        make_kernel("ray_box_intersection", [](const Dataset & dataset, u32 element) -> u64
+        {
+            return u64(dataset.aabbs[element].ray_box_intersection(dataset.rays[element]).hit);
+        }),
+        make_kernel("project_primitive_into_bin_fast", [](const Dataset & dataset, u32 element) -> u64
+        {
+            return with_projection_info(dataset, element, [](const ProjectPrimitiveInfo & info)
+                { BVH::project_primitive_into_bin_fast(info); });
+        }),
+        make_kernel("project_primitive_into_bin_slow", [](const Dataset & dataset, u32 element) -> u64
+        {
+            return with_projection_info(dataset, element, [](const ProjectPrimitiveInfo & info)
+                { bvh.project_primitive_into_bin_slow(info); });
+        }),
+        make_kernel("clip_axis_plane", [](const Dataset & dataset, u32 element) -> u64
+        {
+            const Axis axis = static_cast<Axis>(element % 3);
+            BVH::clip_axis_plane(ClipAxisPlaneInfo{
+                .curr_polygon = &clipped_polygon,
+                .back_polygon = &dataset.polygons[element],
+                .clip_axis = axis,
+                .clip_coord = dataset.aabbs[element].get_axis_centroid(axis),
+                .far = element % 2 == 1
+            });
+            return u64(clipped_polygon.size());
+        }),
+        make_kernel("SAH", [](const Dataset & dataset, u32 element) -> u64
+        {
+            const AABB & left_aabb = dataset.aabbs[element];
+            const AABB & right_aabb = dataset.aabbs[(element + 1) % dataset.aabbs.size()];
+            const f32 left_area = left_aabb.get_area();
+            const f32 right_area = right_aabb.get_area();
+            const f32 cost = SAH({
+                .left_primitive_count = element % 64 + 1,
+                .right_primitive_count = (element * 7) % 64 + 1,
+                .left_aabb_area = left_area,
+                .right_aabb_area = right_area,
+                .parent_aabb_area = left_area + right_area + 1.0f,
+                .ray_aabb_test_cost = 3.0f,
+                .ray_tri_test_cost = 2.0f
+            });
+            return u64(cost > 4.0f);
+        }),
+    };
+}
+
+static auto run_kernel(const Kernel & kernel, const Dataset & dataset, const MicrobenchmarkConfig & config) -> MicrobenchmarkResult
+{
+    const u32 element_count = u32(dataset.triangles.size());
+    auto run_once = [&]() -> std::pair<f64, f64>
+    {
+        const u64 start_cycles = read_cycle_counter();
+        auto start_time = std::chrono::high_resolution_clock::now();
+        const u64 accumulated = kernel.loop(dataset);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        const u64 end_cycles = read_cycle_counter();
+        benchmark_sink = benchmark_sink + accumulated;
+
+        std::chrono::duration<double, std::nano> ns_double = end_time - start_time;
+        return {ns_double.count() / f64(element_count), f64(end_cycles - start_cycles) / f64(element_count)};
+    };
+
+    for(u32 i = 0; i < config.warmup; i++) { run_once(); }
+
+    std::vector<f64> ns_per_op;
+    std::vector<f64> cycles_per_op;
+    for(u32 i = 0; i < config.repetitions; i++)
+    {
+        const auto [ns, cycles] = run_once();
+        ns_per_op.push_back(ns);
+        cycles_per_op.push_back(cycles);
+    }
+    return MicrobenchmarkResult{
+        .kernel = kernel.name,
+        .dataset = dataset.name,
+        .ns_per_op = compute_sample_statistics(ns_per_op),
+        .cycles_per_op = compute_sample_statistics(cycles_per_op)
+    };
+}
+
+static auto write_results(const std::string & path, const MicrobenchmarkConfig & config, const std::vector<MicrobenchmarkResult> & results) -> void
+{
+    std::ofstream output(path);
+    if(!output.is_open()) { throw std::runtime_error("[write_results()] could not open output file " + path); }
+
+    JsonWriter json(output);
+    json.begin_object();
+    json.value("element_count", config.element_count);
+    json.value("repetitions", config.repetitions);
+    json.value("warmup", config.warmup);
+    json.value("seed", config.seed);
+    json.begin_array("results");
+    for(const auto & result : results)
+    {
+        json.begin_object();
+        json.value("kernel", result.kernel);
+        json.value("dataset", result.dataset);
+        json.value("ns_per_op", result.ns_per_op.median);
+        json.value("ns_per_op_variance", result.ns_per_op.variance);
+#ifdef SBVH_HAS_CYCLE_COUNTER
+        json.value("cycles_per_op", result.cycles_per_op.median);
+#endif
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+static auto run(const CommandLine & command_line) -> int
+{
+    const MicrobenchmarkConfig config = {
+        .element_count = glm::max(command_line.get_u32("--count", 65536), 1u),
+        .repetitions = glm::max(command_line.get_u32("--repetitions", 10), 1u),
+        .warmup = command_line.get_u32("--warmup", 2),
+        .seed = command_line.get_u32("--seed", 1337)
+    };
+    const auto dataset_names = split_list(command_line.get_string("--datasets", "random,degenerate,axis_aligned,sliver"));
+    const auto kernel_names = split_list(command_line.get_string("--kernels", ""));
+
+    std::vector<Kernel> kernels;
+    for(const auto & kernel : get_kernels())
+    {
+        if(kernel_names.empty() || std::find(kernel_names.begin(), kernel_names.end(), kernel.name) != kernel_names.end())
+        {
+            kernels.push_back(kernel);
+        }
+    }
+    if(kernels.empty()) { throw std::runtime_error("[run()] no kernel matches the --kernels list"); }
+
+    std::vector<MicrobenchmarkResult> results;
+    std::cout << std::left << std::setw(34) << "kernel" << std::setw(14) << "dataset"
+              << std::setw(12) << "ns/op" << std::setw(12) << "cycles/op" << "variance" << std::endl;
+    for(const auto & dataset_name : dataset_names)
+    {
+        const Dataset dataset = make_dataset(dataset_name, config);
+        for(const auto & kernel : kernels)
+        {
+            const auto & result = results.emplace_back(run_kernel(kernel, dataset, config));
+            std::cout << std::left << std::setw(34) << result.kernel << std::setw(14) << result.dataset
+                      << std::setw(12) << result.ns_per_op.median << std::setw(12) << result.cycles_per_op.median
+                      << result.ns_per_op.variance << std::endl;
+        }
+    }
+
+    if(command_line.has("--output"))
+    {
+        const std::string output_path = command_line.get_string("--output", "");
+        write_results(output_path, config, results);
+        std::cout << "results written to " << output_path << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    const CommandLine command_line(argc, argv);
+    if(command_line.has("--help"))
+    {
+        print_usage();
+        return 0;
+    }
+
+    try
+    {
+        return run(command_line);
+    }
+    catch(const std::exception & exception)
+    {
+        std::cerr << "[SBVH_microbenchmark] " << exception.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,208 @@
+// Replays a captured ray set against a BVH build - reports the throughput of the selected traversal kernels
+// and verifies that the hits match the reference hits stored in the capture either bit for bit or within tolerance
+#include <bit>
+#include <chrono>
+#include <thread>
+#include <iostream>
+
+#include "tool_utils.hpp"
+#include "../raytracing_backend/scene.hpp"
+#include "../raytracing_backend/ray_capture.hpp"
+
+// only this many mismatches are printed, the rest is just counted
+static constexpr u32 MAX_REPORTED_MISMATCHES = 10;
+
+struct ReplayBatch
+{
+    // indices of the rays in the capture
+    std::vector<size_t> capture_indices;
+    std::vector<Ray> rays;
+    std::vector<f32> max_distances;
+};
+
+struct ReplayConfig
+{
+    std::vector<std::string> kernels;
+    u32 thread_count;
+    u32 repetitions;
+    u32 warmup;
+    // zero requires bit exact hits
+    f32 tolerance;
+};
+
+static auto print_usage() -> void
+{
+    std::cout <<
+        "usage: SBVH_replay --scene <path> --rays <path> [options]\n"
+        "  --scene <path>              scene the rays were captured in\n"
+        "  --rays <path>               ray capture file written by SBVH_headless --capture\n"
+        "  --instanced                 load the scene instanced, use it for rays captured in an instanced scene\n"
+        "  --kernels <list>            comma separated batch kernels auto,single,packet,stream,interleaved,stackless (default auto)\n"
+        "  --tolerance <f>             allowed relative difference of hit distances and normals, 0 requires bit exact hits (default 0)\n"
+        "  --threads <n>               tracing threads (default hardware concurrency)\n"
+        "  --repetitions <n>           measured repetitions (default 5)\n"
+        "  --warmup <n>                unmeasured warm-up runs before the repetitions (default 1)\n"
+        << construct_bvh_info_usage();
+}
+
+static auto values_match(f32 value, f32 reference, f32 tolerance) -> bool
+{
+    if(tolerance == 0.0f) { return std::bit_cast<u32>(value) == std::bit_cast<u32>(reference); }
+    return glm::abs(value - reference) <= tolerance * glm::max(1.0f, glm::abs(reference));
+}
+
+static auto hits_match(const Hit & hit, const CapturedRay & reference, f32 tolerance) -> bool
+{
+    if(hit.hit != (reference.hit != 0u)) { return false; }
+    // misses carry no other information worth comparing
+    if(!hit.hit) { return true; }
+    return
+        values_match(hit.distance, reference.distance, tolerance) &&
+        values_match(hit.normal.x, reference.normal.x, tolerance) &&
+        values_match(hit.normal.y, reference.normal.y, tolerance) &&
+        values_match(hit.normal.z, reference.normal.z, tolerance);
+}
+
+// shadow rays are replayed as occlusion queries - reference is occluded the same way the raytracer decides it
+static auto is_reference_occluded(const CapturedRay & reference) -> bool
+{
+    return reference.hit != 0u && reference.distance > reference.t_min && reference.distance < reference.t_max;
+}
+
+static auto make_batch(const std::vector<CapturedRay> & capture, RayKind kind) -> ReplayBatch
+{
+    ReplayBatch batch;
+    for(size_t i = 0; i < capture.size(); i++)
+    {
+        if(capture.at(i).kind != kind) { continue; }
+        batch.capture_indices.push_back(i);
+        batch.rays.push_back(capture.at(i).get_ray());
+        batch.max_distances.push_back(capture.at(i).t_max);
+    }
+    return batch;
+}
+
+static auto replay_kernel(
+    const std::string & kernel_name,
+    const ReplayConfig & config,
+    const RaytracingScene & raytracing_scene,
+    const std::vector<CapturedRay> & capture,
+    const ReplayBatch & primary,
+    const ReplayBatch & shadow) -> u64
+{
+    const BatchTraceInfo trace_info = {
+        .kernel = parse_batch_kernel(kernel_name),
+        .thread_count = config.thread_count
+    };
+    std::vector<Hit> primary_hits(primary.rays.size());
+    std::vector<b32> shadow_occluded(shadow.rays.size());
+
+    std::vector<f64> mrays_per_second;
+    for(u32 i = 0; i < config.warmup + config.repetitions; i++)
+    {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        raytracing_scene.intersect(primary.rays, primary_hits, trace_info);
+        raytracing_scene.occluded(shadow.rays, shadow.max_distances, shadow_occluded, trace_info);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> ms_double = end_time - start_time;
+        if(i >= config.warmup)
+        {
+            mrays_per_second.push_back(f64(capture.size()) / (ms_double.count() * 1000.0));
+        }
+    }
+
+    u64 mismatches = 0;
+    auto report_mismatch = [&](size_t capture_index, const std::string & message)
+    {
+        if(mismatches < MAX_REPORTED_MISMATCHES)
+        {
+            std::cout << "    mismatch in ray " << capture_index << " : " << message << std::endl;
+        }
+        mismatches++;
+    };
+
+    for(size_t i = 0; i < primary.rays.size(); i++)
+    {
+        const auto & reference = capture.at(primary.capture_indices.at(i));
+        const auto & hit = primary_hits.at(i);
+        if(!hits_match(hit, reference, config.tolerance))
+        {
+            report_mismatch(primary.capture_indices.at(i),
+                "hit " + std::to_string(hit.hit) + " distance " + std::to_string(hit.distance) +
+                " reference hit " + std::to_string(reference.hit) + " distance " + std::to_string(reference.distance));
+        }
+    }
+    for(size_t i = 0; i < shadow.rays.size(); i++)
+    {
+        const auto & reference = capture.at(shadow.capture_indices.at(i));
+        if((shadow_occluded.at(i) != 0u) != is_reference_occluded(reference))
+        {
+            report_mismatch(shadow.capture_indices.at(i),
+                "occluded " + std::to_string(shadow_occluded.at(i)) + " reference " + std::to_string(is_reference_occluded(reference)));
+        }
+    }
+
+    const SampleStatistics statistics = compute_sample_statistics(mrays_per_second);
+    std::cout << "kernel " << kernel_name << " : " << statistics.median << " Mrays/s (variance " << statistics.variance << ") "
+              << mismatches << " mismatches" << std::endl;
+    return mismatches;
+}
+
+static auto run(const CommandLine & command_line) -> int
+{
+    const ReplayConfig config = {
+        .kernels = split_list(command_line.get_string("--kernels", "auto")),
+        .thread_count = command_line.get_u32("--threads", glm::max(std::thread::hardware_concurrency(), 1u)),
+        .repetitions = glm::max(command_line.get_u32("--repetitions", 5), 1u),
+        .warmup = command_line.get_u32("--warmup", 1),
+        .tolerance = command_line.get_f32("--tolerance", 0.0f)
+    };
+
+    const std::string rays_path = command_line.get_string("--rays", "");
+    std::vector<CapturedRay> capture;
+    if(!load_ray_capture(rays_path, capture))
+    {
+        std::cerr << "[SBVH_replay] could not load ray capture " << rays_path << std::endl;
+        return 1;
+    }
+    const ReplayBatch primary = make_batch(capture, RayKind::PRIMARY);
+    const ReplayBatch shadow = make_batch(capture, RayKind::SHADOW);
+    std::cout << "captured rays               : " << capture.size()
+              << " (" << primary.rays.size() << " primary, " << shadow.rays.size() << " shadow)" << std::endl;
+
+    const std::string scene_path = command_line.get_string("--scene", "");
+    Scene scene(scene_path, command_line.has("--instanced") ? SceneGeometry::INSTANCED : SceneGeometry::FLATTENED);
+    if(scene.raytracing_scene.indices.empty())
+    {
+        std::cerr << "[SBVH_replay] scene " << scene_path << " could not be loaded or is empty" << std::endl;
+        return 1;
+    }
+    print_bvh_stats(scene.build_bvh(parse_construct_bvh_info(command_line)));
+
+    u64 total_mismatches = 0;
+    for(const auto & kernel_name : config.kernels)
+    {
+        total_mismatches += replay_kernel(kernel_name, config, scene.raytracing_scene, capture, primary, shadow);
+    }
+    return total_mismatches == 0 ? 0 : 2;
+}
+
+int main(int argc, char ** argv)
+{
+    const CommandLine command_line(argc, argv);
+    if(command_line.has("--help") || !command_line.has("--scene") || !command_line.has("--rays"))
+    {
+        print_usage();
+        return command_line.has("--help") ? 0 : 1;
+    }
+
+    try
+    {
+        return run(command_line);
+    }
+    catch(const std::exception & exception)
+    {
+        std::cerr << "[SBVH_replay] " << exception.what() << std::endl;
+        return 1;
+    }
+}
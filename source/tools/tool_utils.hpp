@@ -0,0 +1,263 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+
+#include "../types.hpp"
+#include "../raytracing_backend/bvh.hpp"
+#include "../raytracing_backend/raytracer.hpp"
+
+// Minimal parser of "--flag value" style command line arguments shared by the headless tools.
+// A flag which is not followed by a value (the next argument is another flag) is a boolean switch
+struct CommandLine
+{
+    CommandLine(int argc, char ** argv)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            std::string flag = argv[i];
+            std::string value;
+            if(i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0)
+            {
+                value = argv[++i];
+            }
+            arguments.emplace_back(flag, value);
+        }
+    }
+
+    [[nodiscard]] auto has(const std::string & flag) const -> bool
+    {
+        for(const auto & [argument_flag, value] : arguments)
+        {
+            if(argument_flag == flag) { return true; }
+        }
+        return false;
+    }
+
+    // returns the value of the last occurrence of the flag
+    [[nodiscard]] auto get_string(const std::string & flag, const std::string & default_value) const -> std::string
+    {
+        std::string result = default_value;
+        for(const auto & [argument_flag, value] : arguments)
+        {
+            if(argument_flag == flag) { result = value; }
+        }
+        return result;
+    }
+
+    // returns the values of all occurrences of the flag in order
+    [[nodiscard]] auto get_all(const std::string & flag) const -> std::vector<std::string>
+    {
+        std::vector<std::string> result;
+        for(const auto & [argument_flag, value] : arguments)
+        {
+            if(argument_flag == flag) { result.push_back(value); }
+        }
+        return result;
+    }
+
+    [[nodiscard]] auto get_f32(const std::string & flag, f32 default_value) const -> f32
+    {
+        return has(flag) ? std::stof(get_string(flag, "")) : default_value;
+    }
+
+    [[nodiscard]] auto get_i32(const std::string & flag, i32 default_value) const -> i32
+    {
+        return has(flag) ? std::stoi(get_string(flag, "")) : default_value;
+    }
+
+    [[nodiscard]] auto get_u32(const std::string & flag, u32 default_value) const -> u32
+    {
+        return has(flag) ? static_cast<u32>(std::stoul(get_string(flag, ""))) : default_value;
+    }
+
+    private:
+        std::vector<std::pair<std::string, std::string>> arguments;
+};
+
+inline auto parse_reference_splitting(const std::string & name) -> ReferenceSplitting
+{
+    if(name == "spatial") { return ReferenceSplitting::SPATIAL_SPLITS; }
+    if(name == "esc")     { return ReferenceSplitting::EARLY_SPLIT_CLIPPING; }
+    throw std::runtime_error("[parse_reference_splitting()] unknown reference splitting " + name);
+}
+
+// BVH build parameters shared by all of the tools - defaults match the ones of the interactive application
+inline auto parse_construct_bvh_info(const CommandLine & command_line) -> ConstructBVHInfo
+{
+    return ConstructBVHInfo{
+        .ray_primitive_intersection_cost = command_line.get_f32("--primitive-cost", 2.0f),
+        .ray_aabb_intersection_cost = command_line.get_f32("--aabb-cost", 3.0f),
+        .spatial_bin_count = command_line.get_u32("--spatial-bins", 8),
+        .spatial_alpha = command_line.get_f32("--spatial-alpha", 10e-5f),
+        .join_leaves = !command_line.has("--no-join-leaves"),
+        .max_triangles_in_leaves = command_line.get_i32("--max-leaf-triangles", 0),
+        .min_depth_for_join = command_line.get_i32("--min-join-depth", 0),
+        .quantize_leaves = command_line.has("--quantize-leaves"),
+        .collapse_leaves = command_line.has("--collapse-leaves"),
+        .reference_splitting = parse_reference_splitting(command_line.get_string("--splitting", "spatial")),
+        .early_split_budget = command_line.get_f32("--early-split-budget", 0.3f)
+    };
+}
+
+inline auto construct_bvh_info_usage() -> std::string
+{
+    return 
+        "  --primitive-cost <f>        SAH ray-triangle intersection cost (default 2.0)\n"
+        "  --aabb-cost <f>             SAH ray-AABB intersection cost (default 3.0)\n"
+        "  --spatial-bins <n>          number of spatial split bins (default 8)\n"
+        "  --spatial-alpha <f>         spatial split overlap threshold (default 10e-5)\n"
+        "  --no-join-leaves            disable joining of small leaves\n"
+        "  --max-leaf-triangles <n>    max triangles in joined leaves (default 0)\n"
+        "  --min-join-depth <n>        min depth at which leaves are joined (default 0)\n"
+        "  --quantize-leaves           store the leaf triangles quantized to 16 bits\n"
+        "  --collapse-leaves           form the leaves by a bottom up SAH collapse of the full tree instead of joining,\n"
+        "                              up to --max-leaf-triangles rounded up to a multiple of 4\n"
+        "  --splitting <name>          reference splitting spatial|esc - spatial splits during the build or early split\n"
+        "                              clipping of large triangles before an object split build (default spatial)\n"
+        "  --early-split-budget <f>    additional references of the early split clipping per triangle (default 0.3)\n";
+}
+
+inline auto parse_traversal_mode(const std::string & name) -> TraversalMode
+{
+    if(name == "single")      { return TraversalMode::SINGLE_RAY; }
+    if(name == "packet")      { return TraversalMode::PACKET; }
+    if(name == "stream")      { return TraversalMode::STREAM; }
+    if(name == "interleaved") { return TraversalMode::INTERLEAVED; }
+    if(name == "stackless")   { return TraversalMode::STACKLESS; }
+    throw std::runtime_error("[parse_traversal_mode()] unknown traversal mode " + name);
+}
+
+inline auto parse_batch_kernel(const std::string & name) -> BatchKernel
+{
+    if(name == "auto")        { return BatchKernel::AUTO; }
+    if(name == "single")      { return BatchKernel::SINGLE_RAY; }
+    if(name == "packet")      { return BatchKernel::PACKET; }
+    if(name == "stream")      { return BatchKernel::STREAM; }
+    if(name == "interleaved") { return BatchKernel::INTERLEAVED; }
+    if(name == "stackless")   { return BatchKernel::STACKLESS; }
+    throw std::runtime_error("[parse_batch_kernel()] unknown batch kernel " + name);
+}
+
+// splits comma separated list of values
+inline auto split_list(const std::string & list) -> std::vector<std::string>
+{
+    std::vector<std::string> result;
+    size_t start = 0;
+    while(start <= list.size())
+    {
+        const size_t end = std::min(list.find(',', start), list.size());
+        if(end > start) { result.push_back(list.substr(start, end - start)); }
+        start = end + 1;
+    }
+    return result;
+}
+
+// parses resolution in the WIDTHxHEIGHT format
+inline auto parse_resolution(const std::string & resolution) -> u32vec2
+{
+    const auto separator = resolution.find('x');
+    if(separator == std::string::npos)
+    {
+        throw std::runtime_error("[parse_resolution()] resolution must be in the WIDTHxHEIGHT format");
+    }
+    return {
+        static_cast<u32>(std::stoul(resolution.substr(0, separator))),
+        static_cast<u32>(std::stoul(resolution.substr(separator + 1)))
+    };
+}
+
+// parses vector passed as a single quoted "x y z" value
+inline auto parse_vec3(const std::string & value) -> f32vec3
+{
+    f32vec3 result;
+    if(std::sscanf(value.c_str(), "%f %f %f", &result.x, &result.y, &result.z) != 3)
+    {
+        throw std::runtime_error("[parse_vec3()] vector must be in the \"x y z\" format, got " + value);
+    }
+    return result;
+}
+
+// camera of the interactive application before any view file is loaded
+inline auto make_default_camera(u32vec2 resolution) -> Camera
+{
+    return Camera({
+        .position = {0.0, 0.0, 500.0},
+        .front = {0.0, 0.0, -1.0},
+        .up = {0.0, 1.0, 0.0},
+        .aspect_ratio = f32(resolution.x) / f32(resolution.y),
+        .fov = glm::radians(50.0f)
+    });
+}
+
+inline auto print_bvh_stats(const BVHStats & stats) -> void
+{
+    std::cout << "triangle count              : " << stats.triangle_count << "\n"
+              << "inner node count            : " << stats.inner_node_count << "\n"
+              << "leaf primitives count       : " << stats.leaf_primitives_count << "\n"
+              << "leaf count                  : " << stats.leaf_count << "\n"
+              << "average leaf depth          : " << stats.average_leaf_depth << "\n"
+              << "average primitives in leaf  : " << stats.average_primitives_in_leaf << "\n"
+              << "max tree depth              : " << stats.max_tree_depth << "\n"
+              << "total cost                  : " << stats.total_cost << "\n"
+              << "build time                  : " << stats.build_time << " ms" << std::endl;
+    if(stats.quantized_memory_ratio > 0.0f)
+    {
+        std::cout << "quantized memory ratio      : " << stats.quantized_memory_ratio << "\n"
+                  << "quantized traversal slowdown: " << stats.quantized_traversal_slowdown << std::endl;
+    }
+}
+
+inline auto print_bvh_quality_metrics(const BVHQualityMetrics & metrics) -> void
+{
+    std::cout << "SAH cost                    : " << metrics.sah_cost << "\n"
+              << "EPO                         : " << metrics.epo << "\n"
+              << "sibling overlap             : " << metrics.sibling_overlap << "\n"
+              << "duplication factor          : " << metrics.duplication_factor << "\n"
+              << "leaf sizes                  :";
+    for(size_t size = 1; size < metrics.leaf_size_histogram.size(); size++)
+    {
+        if(metrics.leaf_size_histogram[size] > 0) { std::cout << " " << size << ":" << metrics.leaf_size_histogram[size]; }
+    }
+    std::cout << "\n"
+              << "quality metrics time        : " << metrics.compute_time << " ms" << std::endl;
+}
+
+struct SampleStatistics
+{
+    f64 median;
+    f64 variance;
+    f64 min;
+    f64 max;
+};
+
+// median and unbiased sample variance of the repeated measurements
+inline auto compute_sample_statistics(std::vector<f64> samples) -> SampleStatistics
+{
+    if(samples.empty()) { return SampleStatistics{0.0, 0.0, 0.0, 0.0}; }
+    std::sort(samples.begin(), samples.end());
+    const size_t count = samples.size();
+    const f64 median = count % 2 == 1 ?
+        samples.at(count / 2) :
+        (samples.at(count / 2 - 1) + samples.at(count / 2)) / 2.0;
+
+    f64 mean = 0.0;
+    for(const f64 sample : samples) { mean += sample / f64(count); }
+    f64 variance = 0.0;
+    if(count > 1)
+    {
+        for(const f64 sample : samples) { variance += (sample - mean) * (sample - mean); }
+        variance /= f64(count - 1);
+    }
+    return SampleStatistics{
+        .median = median,
+        .variance = variance,
+        .min = samples.front(),
+        .max = samples.back()
+    };
+}
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "types.hpp"
-#include <daxa/types.hpp>
 
 // returns new vector whose each component is the minimum of the respective components in v1 and v2
 inline auto component_wise_min(const f32vec3 & v1, const f32vec3 & v2) -> f32vec3
@@ -14,10 +13,13 @@ inline auto component_wise_max(const f32vec3 & v1, const f32vec3 & v2) -> f32vec
     return { glm::max(v1.x, v2.x), glm::max(v1.y, v2.y), glm::max(v1.z, v2.z)};
 }
 
-inline auto daxa_vec3_from_glm(const f32vec3 & vec) -> daxa::f32vec3 
-{
-    return {vec.x, vec.y, vec.z};
-}
+// hints the CPU to start fetching the cache line containing address
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define PREFETCH(address) _mm_prefetch(reinterpret_cast<const char *>(address), _MM_HINT_T0)
+#else
+#define PREFETCH(address) __builtin_prefetch(address)
+#endif
 
 #ifdef LOG_DEBUG
 #include <iostream>